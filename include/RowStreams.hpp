@@ -4,10 +4,21 @@
 // Include this file if you are lazy and just want to use everything
 
 #include "RowStreams/TextFlatFileReader.hpp"
+#include "RowStreams/ParallelTextFileReader.hpp"
+#include "RowStreams/AsyncBoundary.hpp"
+#include "RowStreams/Morsels.hpp"
 #include "RowStreams/TextflatFileWriter.hpp"
+#include "RowStreams/BinaryFlatFileReader.hpp"
+#include "RowStreams/BinaryFlatFileWriter.hpp"
 #include "RowStreams/ColumnDefHelpers.hpp"
 #include "RowStreams/ColumnSetter.hpp"
 #include "RowStreams/ColumnAdder.hpp"
+#include "RowStreams/Filter.hpp"
+#include "RowStreams/GroupBy.hpp"
+#include "RowStreams/Join.hpp"
+#include "RowStreams/Sort.hpp"
+#include "RowStreams/Limit.hpp"
 #include "RowStreams/Functions.hpp"
+#include "RowStreams/Schema.hpp"
 
 #endif
\ No newline at end of file
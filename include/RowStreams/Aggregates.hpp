@@ -0,0 +1,347 @@
+#ifndef ROWSTREAMS_AGGREGATES_HPP
+#define ROWSTREAMS_AGGREGATES_HPP
+
+#include "RowStreams/Row.hpp"
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/ColumnDefHelpers.hpp"
+#include <vector>
+#include <string>
+#include <boost/static_assert.hpp>
+
+namespace RowStreams
+{
+	/// A value computed over the rows of a group, like a sum or a count.
+	/// Its running state lives in a buffer the aggregate does not own, so
+	/// that a GroupBy can keep the state of every group inline in its hash
+	/// table, and write it to disk as is. States are plain bytes that can be
+	/// copied with memcpy, and start 8 byte aligned.
+	class Aggregate
+	{
+		std::string name_;
+
+	protected:
+		/// Input column, if any.
+		std::string column_;
+		size_t index_;
+		size_t offset_;
+		/// Place of the result in the output rows.
+		size_t outIndex_;
+		size_t outOffset_;
+
+	public:
+		Aggregate(const std::string & name, const std::string & column)
+			: name_(name), column_(column), index_(size_t(-1)), offset_(size_t(-1)),
+			outIndex_(size_t(-1)), outOffset_(size_t(-1))
+		{
+		}
+
+		virtual ~Aggregate()
+		{
+		}
+
+		virtual Aggregate * clone() const = 0;
+
+		/// Size of the state in bytes.
+		virtual size_t stateSize() const = 0;
+
+		/// Appends the column of the result to the output rows.
+		virtual void addColumn(RowDef & rowDef) const = 0;
+
+		/// Sets up a state for a group with no rows yet.
+		virtual void init(char * state) const = 0;
+
+		/// Adds an input row to a state. Null values are skipped.
+		virtual void update(char * state, const Row & row) const = 0;
+
+		/// Adds the rows summed up by another state to a state.
+		virtual void merge(char * state, const char * other) const = 0;
+
+		/// Stores the result in an output row, or leaves it null.
+		virtual void result(const char * state, Row & out) const = 0;
+
+		const std::string & name() const
+		{
+			return name_;
+		}
+
+		/// Appends the name of the input column to names.
+		void columns(std::vector<std::string> & names) const
+		{
+			if(!column_.empty())
+				names.push_back(column_);
+		}
+
+		/// Finds the input column and the place of the result.
+		void bind(const RowDef & input, const RowDef & output)
+		{
+			if(!column_.empty())
+			{
+				index_ = input.index(column_);
+				offset_ = input.offset(column_);
+			}
+			outIndex_ = output.index(name_);
+			outOffset_ = output.offset(name_);
+		}
+	};
+
+	namespace AggregateDetail
+	{
+		/// Running state of the aggregates that keep a single value.
+		template<class T>
+		struct ValueState
+		{
+			T value;
+			bool seen;
+		};
+
+		struct AvgState
+		{
+			double total;
+			long long count;
+		};
+
+		template<class T>
+		struct Plus
+		{
+			static T apply(T current, T value)
+			{
+				return current + value;
+			}
+		};
+
+		template<class T>
+		struct Least
+		{
+			static T apply(T current, T value)
+			{
+				return value < current ? value : current;
+			}
+		};
+
+		template<class T>
+		struct Greatest
+		{
+			static T apply(T current, T value)
+			{
+				return current < value ? value : current;
+			}
+		};
+
+		/// Sum, min and max: a value combined with every non-null input
+		/// value by Combine. Null if the group has no such value.
+		template<class T, template<class> class Combine>
+		class ValueAggregate : public Aggregate
+		{
+			typedef ValueState<T> State;
+			/// States are copied and spilled as bytes, which external values
+			/// like strings do not live in.
+			BOOST_STATIC_ASSERT(!ValueStorage<T>::external);
+
+		public:
+			ValueAggregate(const std::string & name, const std::string & column)
+				: Aggregate(name, column)
+			{
+			}
+
+			Aggregate * clone() const
+			{
+				return new ValueAggregate(*this);
+			}
+
+			size_t stateSize() const
+			{
+				return sizeof(State);
+			}
+
+			void addColumn(RowDef & rowDef) const
+			{
+				rowDef.add(ColumnDefTpl<T>(name()));
+			}
+
+			void init(char * state) const
+			{
+				State & s = *reinterpret_cast<State*>(state);
+				s.value = T();
+				s.seen = false;
+			}
+
+			void update(char * state, const Row & row) const
+			{
+				if(row.isNull(index_))
+					return;
+				State & s = *reinterpret_cast<State*>(state);
+				const T value = row.get<T>(index_, offset_);
+				s.value = s.seen ? Combine<T>::apply(s.value, value) : value;
+				s.seen = true;
+			}
+
+			void merge(char * state, const char * other) const
+			{
+				State & s = *reinterpret_cast<State*>(state);
+				const State & o = *reinterpret_cast<const State*>(other);
+				if(!o.seen)
+					return;
+				s.value = s.seen ? Combine<T>::apply(s.value, o.value) : o.value;
+				s.seen = true;
+			}
+
+			void result(const char * state, Row & out) const
+			{
+				const State & s = *reinterpret_cast<const State*>(state);
+				if(s.seen)
+					out.set(outIndex_, outOffset_, s.value);
+			}
+		};
+
+		/// Number of rows, or of non-null values of a column.
+		class Count : public Aggregate
+		{
+		public:
+			Count(const std::string & name, const std::string & column)
+				: Aggregate(name, column)
+			{
+			}
+
+			Aggregate * clone() const
+			{
+				return new Count(*this);
+			}
+
+			size_t stateSize() const
+			{
+				return sizeof(long long);
+			}
+
+			void addColumn(RowDef & rowDef) const
+			{
+				rowDef.add(ColumnDefTpl<long long>(name()));
+			}
+
+			void init(char * state) const
+			{
+				*reinterpret_cast<long long*>(state) = 0;
+			}
+
+			void update(char * state, const Row & row) const
+			{
+				if(column_.empty() || !row.isNull(index_))
+					++*reinterpret_cast<long long*>(state);
+			}
+
+			void merge(char * state, const char * other) const
+			{
+				*reinterpret_cast<long long*>(state) += *reinterpret_cast<const long long*>(other);
+			}
+
+			void result(const char * state, Row & out) const
+			{
+				out.set(outIndex_, outOffset_, *reinterpret_cast<const long long*>(state));
+			}
+		};
+
+		/// Mean of the non-null values of a column, as a double.
+		template<class T>
+		class Avg : public Aggregate
+		{
+		public:
+			Avg(const std::string & name, const std::string & column)
+				: Aggregate(name, column)
+			{
+			}
+
+			Aggregate * clone() const
+			{
+				return new Avg(*this);
+			}
+
+			size_t stateSize() const
+			{
+				return sizeof(AvgState);
+			}
+
+			void addColumn(RowDef & rowDef) const
+			{
+				rowDef.add(ColumnDefTpl<double>(name()));
+			}
+
+			void init(char * state) const
+			{
+				AvgState & s = *reinterpret_cast<AvgState*>(state);
+				s.total = 0;
+				s.count = 0;
+			}
+
+			void update(char * state, const Row & row) const
+			{
+				if(row.isNull(index_))
+					return;
+				AvgState & s = *reinterpret_cast<AvgState*>(state);
+				s.total += double(row.get<T>(index_, offset_));
+				++s.count;
+			}
+
+			void merge(char * state, const char * other) const
+			{
+				AvgState & s = *reinterpret_cast<AvgState*>(state);
+				const AvgState & o = *reinterpret_cast<const AvgState*>(other);
+				s.total += o.total;
+				s.count += o.count;
+			}
+
+			void result(const char * state, Row & out) const
+			{
+				const AvgState & s = *reinterpret_cast<const AvgState*>(state);
+				if(s.count)
+					out.set(outIndex_, outOffset_, s.total / double(s.count));
+			}
+		};
+	}
+
+	/// Aggregates for GroupBy, named after their input column by default:
+	/// group_by(ColumnNames() << "a").aggregate(Aggregates::sum<double>("b"))
+	/// adds a column sum_b.
+	namespace Aggregates
+	{
+		/// Sum of the values of a column, of the same type as the column.
+		template<class T>
+		AggregateDetail::ValueAggregate<T, AggregateDetail::Plus> sum(const std::string & column,
+			const std::string & name = std::string())
+		{
+			return AggregateDetail::ValueAggregate<T, AggregateDetail::Plus>(name.empty() ? "sum_" + column : name, column);
+		}
+
+		template<class T>
+		AggregateDetail::ValueAggregate<T, AggregateDetail::Least> min(const std::string & column,
+			const std::string & name = std::string())
+		{
+			return AggregateDetail::ValueAggregate<T, AggregateDetail::Least>(name.empty() ? "min_" + column : name, column);
+		}
+
+		template<class T>
+		AggregateDetail::ValueAggregate<T, AggregateDetail::Greatest> max(const std::string & column,
+			const std::string & name = std::string())
+		{
+			return AggregateDetail::ValueAggregate<T, AggregateDetail::Greatest>(name.empty() ? "max_" + column : name, column);
+		}
+
+		template<class T>
+		AggregateDetail::Avg<T> avg(const std::string & column, const std::string & name = std::string())
+		{
+			return AggregateDetail::Avg<T>(name.empty() ? "avg_" + column : name, column);
+		}
+
+		/// Number of rows in the group, as a long long.
+		AggregateDetail::Count count(const std::string & name = "count")
+		{
+			return AggregateDetail::Count(name, std::string());
+		}
+
+		/// Number of non-null values of a column.
+		AggregateDetail::Count count_values(const std::string & column, const std::string & name = std::string())
+		{
+			return AggregateDetail::Count(name.empty() ? "count_" + column : name, column);
+		}
+	}
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,347 @@
+#ifndef ROWSTREAMS_ASYNC_BOUNDARY_HPP
+#define ROWSTREAMS_ASYNC_BOUNDARY_HPP
+
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/RowBatch.hpp"
+#include "RowStreams/PipelinePlan.hpp"
+#include "RowStreams/Doorbell.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/thread/thread.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+
+namespace RowStreams
+{
+	/// Runs everything up the stream from it on a thread of its own, so that
+	/// the stages on either side of the boundary work at the same time and the
+	/// pipeline goes at the speed of its slowest part.
+	///
+	/// Batches cross over through lock free single producer, single consumer
+	/// rings. Only a fixed number of batches exist, so the upstream thread is
+	/// never more than that many batches ahead, which is the backpressure.
+	/// Rows given back downstream cross over through a third ring and are
+	/// released up the stream by the upstream thread, since sources are not
+	/// thread safe.
+	template<class Source>
+	class AsyncBoundary
+	{
+		typedef boost::lockfree::spsc_queue<RowBatch*> BatchRing;
+		typedef boost::lockfree::spsc_queue<Row*> RowRing;
+
+		/// Row source. We don't own it, so no deletes.
+		Source * source_;
+		size_t batches_;
+		RowDef rowDef_;
+
+		std::vector<RowBatch*> carriers_;
+		/// Batches filled up the stream.
+		boost::scoped_ptr<BatchRing> full_;
+		/// Batches emptied down the stream, to be filled again.
+		boost::scoped_ptr<BatchRing> empty_;
+		/// Rows given back down the stream.
+		boost::scoped_ptr<RowRing> released_;
+		Doorbell doorbell_;
+
+		boost::thread producer_;
+		/// Set by the upstream thread once it is done, error_ included.
+		boost::atomic<bool> done_;
+		boost::atomic<bool> stopping_;
+		std::string error_;
+
+		// Only used down the stream.
+		bool started_;
+		/// The upstream thread has been joined, so the source can be called directly.
+		bool finished_;
+		/// Batch rows are currently handed out from by next().
+		RowBatch current_;
+		size_t currentRow_;
+
+		// Only used by the upstream thread.
+		RowBatch releasing_;
+
+		AsyncBoundary & operator=(const AsyncBoundary &);
+
+		bool producerReady()
+		{
+			return empty_->read_available() || released_->read_available() || stopping_;
+		}
+
+		bool consumerReady()
+		{
+			return full_->read_available() || done_;
+		}
+
+		bool releaseReady()
+		{
+			return released_->write_available() || done_;
+		}
+
+		/// Releases up the stream the rows given back so far. Upstream thread only,
+		/// or once it has been joined.
+		void returnRows()
+		{
+			Row * row;
+			while(released_->pop(row))
+			{
+				releasing_.add(row);
+				if(releasing_.full())
+					source_->releaseBatch(releasing_);
+			}
+			if(!releasing_.empty())
+				source_->releaseBatch(releasing_);
+		}
+
+		void produce()
+		{
+			try
+			{
+				for(;;)
+				{
+					doorbell_.wait(boost::bind(&AsyncBoundary::producerReady, this));
+					returnRows();
+					if(stopping_)
+						break;
+
+					RowBatch * batch;
+					if(!empty_->pop(batch))
+						continue;
+					if(!source_->nextBatch(*batch))
+						break;
+					// Never full, it has room for every batch.
+					full_->push(batch);
+					doorbell_.ring();
+				}
+			}
+			catch(std::exception & e)
+			{
+				error_ = e.what();
+			}
+			catch(...)
+			{
+				error_ = "Unknown exception caught";
+			}
+			done_ = true;
+			doorbell_.ring();
+		}
+
+		void start()
+		{
+			started_ = true;
+			producer_ = boost::thread(boost::bind(&AsyncBoundary::produce, this));
+		}
+
+		/// Joins the upstream thread once it is done, and releases what it left behind.
+		void finish()
+		{
+			producer_.join();
+			finished_ = true;
+			returnRows();
+			if(!error_.empty())
+				throw std::runtime_error(error_);
+		}
+
+		void halt()
+		{
+			if(started_ && !finished_)
+			{
+				stopping_ = true;
+				doorbell_.ring();
+				producer_.join();
+				finished_ = true;
+			}
+		}
+
+		void giveBack(Row * row)
+		{
+			if(finished_)
+			{
+				source_->release(row);
+				return;
+			}
+
+			while(!released_->push(row))
+			{
+				doorbell_.ring();
+				doorbell_.wait(boost::bind(&AsyncBoundary::releaseReady, this));
+				if(done_ && !released_->write_available())
+				{
+					finish();
+					source_->release(row);
+					return;
+				}
+			}
+		}
+
+		/// Gives back the rows of the current batch that were dropped from
+		/// its selection, which next() never hands out.
+		void releaseDropped()
+		{
+			if(current_.selected() == current_.size())
+				return;
+
+			bool selected[RowBatch::CAPACITY] = {};
+			for(size_t index = 0; index != current_.selected(); ++index)
+				selected[current_.selection()[index]] = true;
+			for(size_t index = 0; index != current_.size(); ++index)
+			{
+				if(!selected[index])
+					giveBack(current_.row(index));
+			}
+		}
+
+	public:
+		/// batches is the number of batches that can be on their way at once.
+		explicit AsyncBoundary(size_t batches)
+			: source_(0), batches_(std::max(batches, size_t(1))), done_(false), stopping_(false),
+			started_(false), finished_(false), currentRow_(0)
+		{
+		}
+
+		AsyncBoundary(const AsyncBoundary & other)
+			: source_(0), batches_(other.batches_), done_(false), stopping_(false),
+			started_(false), finished_(false), currentRow_(0)
+		{
+		}
+
+		~AsyncBoundary()
+		{
+			halt();
+			for(std::vector<RowBatch*>::iterator carrier = carriers_.begin(); carrier != carriers_.end(); ++carrier)
+				delete *carrier;
+		}
+
+		void source(Source * source)
+		{
+			source_ = source;
+		}
+
+		void init()
+		{
+			source_->init();
+			rowDef_ = source_->rowDef();
+
+			full_.reset(new BatchRing(batches_));
+			empty_.reset(new BatchRing(batches_));
+			released_.reset(new RowRing(2 * batches_ * RowBatch::CAPACITY));
+			for(size_t index = 0; index != batches_; ++index)
+			{
+				carriers_.push_back(new RowBatch);
+				empty_->push(carriers_.back());
+			}
+		}
+
+		/// Planning happens before the upstream thread starts.
+		bool plan(PipelinePlan & plan)
+		{
+			if(!plan.layout)
+				plan.layout = &rowDef_;
+			return source_->plan(plan);
+		}
+
+		/// Stops the upstream thread, and then the stream up from it, from
+		/// this thread. No more rows come out.
+		void stop()
+		{
+			halt();
+			finished_ = true;
+			returnRows();
+			source_->stop();
+		}
+
+		const RowDef & rowDef()
+		{
+			return rowDef_;
+		}
+
+		bool nextBatch(RowBatch & batch)
+		{
+			batch.clear();
+			if(finished_)
+				return false;
+			if(!started_)
+				start();
+
+			RowBatch * carrier;
+			while(!full_->pop(carrier))
+			{
+				// done_ is read first, so nothing can be pushed after seeing it.
+				if(done_ && !full_->read_available())
+				{
+					finish();
+					return false;
+				}
+				doorbell_.wait(boost::bind(&AsyncBoundary::consumerReady, this));
+			}
+
+			batch.assign(*carrier);
+			carrier->clear();
+			empty_->push(carrier);
+			doorbell_.ring();
+			return true;
+		}
+
+		void releaseBatch(RowBatch & batch)
+		{
+			for(size_t index = 0; index != batch.size(); ++index)
+				giveBack(batch.row(index));
+			batch.clear();
+			doorbell_.ring();
+		}
+
+		Row * next()
+		{
+			while(currentRow_ == current_.selected())
+			{
+				releaseDropped();
+				currentRow_ = 0;
+				if(!nextBatch(current_))
+					return 0;
+			}
+			return current_.selectedRow(currentRow_++);
+		}
+
+		void release(Row * row)
+		{
+			giveBack(row);
+			doorbell_.ring();
+		}
+	};
+
+	/// Bridge class used in the pipeline construction syntax.
+	class AsyncBoundaryPrototype
+	{
+		size_t batches_;
+	public:
+		template<class Source>
+		struct ForSource
+		{
+			typedef AsyncBoundary<Source> Type;
+		};
+
+		AsyncBoundaryPrototype(size_t batches)
+			: batches_(batches)
+		{
+		}
+
+		template<class Source>
+		AsyncBoundary<Source> create() const
+		{
+			return AsyncBoundary<Source>(batches_);
+		}
+	};
+
+	/// Runs the stages before it on their own thread, with at most batches
+	/// batches on their way down from there at once:
+	/// read_text_file(...) >> async_boundary() >> set_column(...) >> write_text_file(...)
+	AsyncBoundaryPrototype async_boundary(size_t batches = 4)
+	{
+		return AsyncBoundaryPrototype(batches);
+	}
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,287 @@
+#ifndef ROWSTREAMS_BINARY_FLAT_FILE_READER_HPP
+#define ROWSTREAMS_BINARY_FLAT_FILE_READER_HPP
+
+#include "RowStreams/Row.hpp"
+#include "RowStreams/Pipeline.hpp"
+#include "RowStreams/RowPool.hpp"
+#include "RowStreams/RowBatch.hpp"
+#include "RowStreams/BinaryLayout.hpp"
+#include "RowStreams/ZoneMap.hpp"
+#include "RowStreams/RowPredicate.hpp"
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <boost/lexical_cast.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+namespace RowStreams
+{
+	/// Reads rows from a binary file written by BinaryFlatFileWriter. The
+	/// columns come from the header of the file, and the file is memory
+	/// mapped, so that every row is a copy of its bytes out of the mapping
+	/// and nothing is parsed. Checksums, if the file has them, are checked
+	/// a block at a time as the rows of the block are first needed.
+	///
+	/// The reader takes the predicates of the filters down the stream, and
+	/// skips the blocks whose zone maps tell that none of their rows meet
+	/// them, without touching their rows, or checking their checksums.
+	class BinaryFlatFileReader
+	{
+		RowDef         rowDef_;
+		std::string    fileName_;
+		BinaryChecksums checksums_;
+		BinaryLayout   layout_;
+
+		boost::iostreams::mapped_file_source mapped_;
+		/// Unread part of the mapping.
+		const char *   pos_;
+		const char *   end_;
+		/// Number of blocks read so far, for error messages.
+		size_t         blockNumber_;
+
+		/// Rows, null bitmaps, offsets in the heap and heap of the current
+		/// block.
+		const char *   records_;
+		const char *   nulls_;
+		const char *   offsets_;
+		const char *   strings_;
+		size_t         stringsSize_;
+		size_t         blockRows_;
+		/// Next row of the block to be read.
+		size_t         blockRow_;
+		bool           eof_;
+
+		/// Predicates of the filters down the stream, checked on every block,
+		/// then on every row.
+		PushedPredicates predicates_;
+		size_t         skippedBlocks_;
+		RowPool        pool_;
+
+		/// Moves on to the next block with rows. Returns false at end of file.
+		bool nextBlock()
+		{
+			while(!eof_)
+			{
+				BinaryBlockHeader header;
+				if(size_t(end_ - pos_) < sizeof(header))
+					throw std::runtime_error("Truncated file "+fileName_);
+				::memcpy(&header, pos_, sizeof(header));
+				pos_ += sizeof(header);
+				++blockNumber_;
+				if(header.rows == 0)
+				{
+					eof_ = true;
+					break;
+				}
+
+				if(header.size > boost::uint64_t(end_ - pos_) || header.size < layout_.blockSize(header.rows)
+					|| (!layout_.external() && header.size != layout_.blockSize(header.rows)))
+					throw std::runtime_error("Truncated file "+fileName_);
+				const char * block = pos_;
+				pos_ += size_t(header.size);
+				if(!predicates_.empty()
+					&& !predicates_.mayMatch(ZoneMap((const ColumnZone*)block, rowDef_.numColumns())))
+				{
+					++skippedBlocks_;
+					continue;
+				}
+				if(checksums_ == BINARY_CHECKSUMS && BinaryLayout::checksum(block, size_t(header.size)) != header.checksum)
+				{
+					throw std::runtime_error("Checksum mismatch in block "
+						+boost::lexical_cast<std::string>(blockNumber_)+" of "+fileName_);
+				}
+
+				records_ = block + layout_.zonesSize();
+				nulls_ = records_ + layout_.recordSize() * header.rows;
+				offsets_ = block + layout_.offsetsAt(header.rows);
+				strings_ = block + layout_.stringsAt(header.rows);
+				stringsSize_ = size_t(header.size) - layout_.stringsAt(header.rows);
+				blockRows_ = header.rows;
+				blockRow_ = 0;
+				return true;
+			}
+			blockRows_ = blockRow_ = 0;
+			return false;
+		}
+
+		/// Copies the next row of the block into row. Returns false, leaving
+		/// row to be used again, if it does not meet the predicates. Strings
+		/// are only copied out of the mapping, which goes away on stop(), for
+		/// the rows that do.
+		bool unpack(Row & row)
+		{
+			boost::uint64_t begin = 0, end = 0;
+			if(layout_.external())
+			{
+				::memcpy(&begin, offsets_ + sizeof(begin) * blockRow_, sizeof(begin));
+				::memcpy(&end, offsets_ + sizeof(end) * (blockRow_ + 1), sizeof(end));
+			}
+			if(begin > end || end > stringsSize_ || !layout_.unpack(records_ + layout_.recordSize() * blockRow_,
+				nulls_ + layout_.nullsSize() * blockRow_, strings_ + begin, size_t(end - begin), row))
+			{
+				throw std::runtime_error("Bad strings in block "
+					+boost::lexical_cast<std::string>(blockNumber_)+" of "+fileName_);
+			}
+			++blockRow_;
+			if(!predicates_.empty() && !predicates_(row))
+				return false;
+			layout_.own(row);
+			return true;
+		}
+
+	public:
+		BinaryFlatFileReader(const std::string & fileName)
+			: fileName_(fileName), checksums_(BINARY_NO_CHECKSUMS), pos_(0), end_(0), blockNumber_(0),
+			records_(0), nulls_(0), offsets_(0), strings_(0), stringsSize_(0), blockRows_(0), blockRow_(0), eof_(false),
+			skippedBlocks_(0)
+		{
+		}
+
+		BinaryFlatFileReader(const BinaryFlatFileReader & other)
+			: rowDef_(other.rowDef_), fileName_(other.fileName_), checksums_(BINARY_NO_CHECKSUMS), pos_(0), end_(0),
+			blockNumber_(0), records_(0), nulls_(0), offsets_(0), strings_(0), stringsSize_(0), blockRows_(0),
+			blockRow_(0), eof_(false), skippedBlocks_(0)
+		{
+		}
+
+		BinaryFlatFileReader & operator=(const BinaryFlatFileReader & other)
+		{
+			rowDef_ = other.rowDef_;
+			fileName_ = other.fileName_;
+			return *this;
+		}
+
+		void init()
+		{
+			try
+			{
+				mapped_.open(fileName_);
+			}
+			catch(std::exception &)
+			{
+				throw std::runtime_error("Failed to map "+fileName_);
+			}
+			pos_ = mapped_.data();
+			end_ = pos_ + mapped_.size();
+
+			pos_ += BinaryLayout::readHeader(pos_, end_ - pos_, fileName_, rowDef_, checksums_);
+			if(pos_ > end_)
+				throw std::runtime_error("Truncated file "+fileName_);
+			layout_.init(rowDef_);
+			pool_.rowDef(&rowDef_);
+			blockNumber_ = 0;
+			blockRows_ = blockRow_ = 0;
+			eof_ = false;
+			skippedBlocks_ = 0;
+		}
+
+		/// Rows are created with the planned layout, so that they have room
+		/// for the columns added down the stream. The predicates that only
+		/// read columns of the file are taken, to skip blocks and rows.
+		bool plan(PipelinePlan & plan)
+		{
+			if(plan.layout)
+				pool_.rowDef(plan.layout);
+			predicates_.take(plan.predicates, rowDef_);
+			return true;
+		}
+
+		Row * next()
+		{
+			Row * row = 0;
+			for(;;)
+			{
+				if(blockRow_ == blockRows_ && !nextBlock())
+				{
+					if(row)
+						pool_.release(row);
+					return 0;
+				}
+
+				// A row that fails the predicates is used again for the next one.
+				if(!row)
+					row = pool_.acquire();
+				if(unpack(*row))
+					return row;
+			}
+		}
+
+		/// Takes back a row handed out by next() for reuse.
+		void release(Row * row)
+		{
+			pool_.release(row);
+		}
+
+		bool nextBatch(RowBatch & batch)
+		{
+			batch.clear();
+			while(!batch.full())
+			{
+				if(blockRow_ == blockRows_ && !nextBlock())
+					break;
+
+				const size_t count = std::min(blockRows_ - blockRow_, RowBatch::CAPACITY - batch.size());
+				Row * row = 0;
+				for(size_t index = 0; index != count; ++index)
+				{
+					if(!row)
+						row = pool_.acquire();
+					if(unpack(*row))
+					{
+						batch.add(row);
+						row = 0;
+					}
+				}
+				if(row)
+					pool_.release(row);
+			}
+			return !batch.empty();
+		}
+
+		void releaseBatch(RowBatch & batch)
+		{
+			for(size_t index = 0; index != batch.size(); ++index)
+				pool_.release(batch.row(index));
+			batch.clear();
+		}
+
+		/// Stops reading: the file is closed, and no more rows come out.
+		void stop()
+		{
+			blockRows_ = blockRow_ = 0;
+			pos_ = end_ = 0;
+			eof_ = true;
+			mapped_.close();
+		}
+
+		/// This can be removed with a bit of work, but for now, everybody needs to define
+		/// a way to set the source module.
+		template<class T>
+		void source(T*)
+		{
+		}
+
+		const RowDef & rowDef()
+		{
+			return rowDef_;
+		}
+
+		/// Number of blocks so far whose rows were never read, as no row
+		/// could meet the predicates.
+		size_t skippedBlocks() const
+		{
+			return skippedBlocks_;
+		}
+	};
+
+	/// Bridge used in the pipeline construction syntax. The columns of the
+	/// rows are those the file was written with.
+	PartialPipeline<BinaryFlatFileReader> read_binary_file(const std::string & fileName)
+	{
+		return PartialPipeline<BinaryFlatFileReader>(NoModule(), BinaryFlatFileReader(fileName));
+	}
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,212 @@
+#ifndef ROWSTREAMS_BINARY_FLAT_FILE_WRITER_HPP
+#define ROWSTREAMS_BINARY_FLAT_FILE_WRITER_HPP
+
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/RowBatch.hpp"
+#include "RowStreams/PipelinePlan.hpp"
+#include "RowStreams/BinaryLayout.hpp"
+#include "RowStreams/ZoneMap.hpp"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <boost/cstdint.hpp>
+
+namespace RowStreams
+{
+	/// Stores a row stream in a binary file, as laid out by BinaryLayout,
+	/// for a BinaryFlatFileReader to read back with no parsing at all.
+	/// Every column of the rows is written, and every block gets a zone map
+	/// with the range of the numbers and the count of nulls in each column.
+	template<class Source>
+	class BinaryFlatFileWriter
+	{
+		/// Number of rows in every block but the last.
+		enum { BLOCK_ROWS = 4096 };
+
+		/// Row source. We don't own it, so no deletes.
+		Source * source_;
+		std::string fileName_;
+		BinaryChecksums checksums_;
+		std::ofstream ofs_;
+		RowDef rowDef_;
+		BinaryLayout layout_;
+		ZoneMapBuilder zones_;
+		/// The block being filled: room for the zones, then the bytes of
+		/// every row, then the null bitmaps, which are kept apart until the
+		/// block is written since the block may not be full, as are the
+		/// heap of strings and the offsets of the rows in it.
+		std::vector<char> block_;
+		std::vector<char> nulls_;
+		std::vector<boost::uint64_t> offsets_;
+		std::vector<char> strings_;
+		size_t blockRows_;
+
+		BinaryFlatFileWriter & operator=(const BinaryFlatFileWriter &);
+
+		char * record(size_t row)
+		{
+			return &block_[0] + layout_.zonesSize() + layout_.recordSize() * row;
+		}
+
+		/// Writes the rows of the block, and starts the next one.
+		void flush()
+		{
+			BinaryBlockHeader header;
+			header.rows = boost::uint32_t(blockRows_);
+			header.size = layout_.blockSize(blockRows_, strings_.size());
+			header.checksum = 0;
+			if(block_.size() < size_t(header.size))
+				block_.resize(size_t(header.size));
+
+			zones_.write(&block_[0]);
+			char * nulls = record(blockRows_);
+			const size_t nullsSize = layout_.nullsSize() * blockRows_;
+			::memcpy(nulls, &nulls_[0], nullsSize);
+			char * strings = &block_[0] + layout_.stringsAt(blockRows_);
+			::memset(nulls + nullsSize, 0, strings - nulls - nullsSize);
+			if(layout_.external())
+			{
+				offsets_[blockRows_] = strings_.size();
+				::memcpy(&block_[0] + layout_.offsetsAt(blockRows_), &offsets_[0], sizeof(boost::uint64_t) * (blockRows_ + 1));
+				if(!strings_.empty())
+					::memcpy(strings, &strings_[0], strings_.size());
+			}
+			::memset(strings + strings_.size(), 0, &block_[0] + size_t(header.size) - strings - strings_.size());
+
+			if(checksums_ == BINARY_CHECKSUMS)
+				header.checksum = BinaryLayout::checksum(&block_[0], size_t(header.size));
+			ofs_.write((const char*)&header, sizeof(header));
+			ofs_.write(&block_[0], std::streamsize(header.size));
+			blockRows_ = 0;
+			strings_.clear();
+			zones_.clear();
+		}
+
+	public:
+		BinaryFlatFileWriter(const std::string & fileName, BinaryChecksums checksums)
+			: source_(0), fileName_(fileName), checksums_(checksums), blockRows_(0)
+		{
+		}
+
+		BinaryFlatFileWriter(const BinaryFlatFileWriter & other)
+			: source_(0), fileName_(other.fileName_), checksums_(other.checksums_), blockRows_(0)
+		{
+		}
+
+		void source(Source * source)
+		{
+			source_ = source;
+		}
+
+		void init()
+		{
+			source_->init();
+
+			ofs_.open(fileName_.c_str(), std::ios::out | std::ios::binary);
+			if(!ofs_)
+				throw std::runtime_error("Could not open file "+fileName_);
+
+			rowDef_ = source_->rowDef();
+			layout_.init(rowDef_);
+			zones_.init(rowDef_);
+			block_.resize(layout_.blockSize(BLOCK_ROWS));
+			nulls_.resize(layout_.nullsSize() * BLOCK_ROWS);
+			offsets_.resize(layout_.external() ? BLOCK_ROWS + 1 : 0);
+			strings_.clear();
+			blockRows_ = 0;
+		}
+
+		/// Starts the plan with the layout of the rows that get here. Every
+		/// column is written.
+		bool plan(PipelinePlan & plan)
+		{
+			if(!plan.layout)
+				plan.layout = &rowDef_;
+			plan.allColumns = true;
+			plan.usedColumns.clear();
+			source_->plan(plan);
+			return false;
+		}
+
+		void run()
+		{
+			std::vector<char> header;
+			BinaryLayout::writeHeader(rowDef_, checksums_, header);
+			ofs_.write(&header[0], std::streamsize(header.size()));
+
+			RowBatch batch;
+			while(source_->nextBatch(batch))
+			{
+				writeBatch(batch);
+				source_->releaseBatch(batch);
+			}
+
+			if(blockRows_)
+				flush();
+			// A block with no rows ends the file.
+			BinaryBlockHeader end;
+			end.rows = 0;
+			end.checksum = 0;
+			end.size = 0;
+			ofs_.write((const char*)&end, sizeof(end));
+			ofs_.flush();
+			if(!ofs_)
+				throw std::runtime_error("Could not write to file "+fileName_);
+		}
+
+		void writeRow(const Row & row)
+		{
+			if(layout_.external())
+				offsets_[blockRows_] = strings_.size();
+			layout_.pack(row, record(blockRows_), &nulls_[layout_.nullsSize() * blockRows_], strings_);
+			zones_.add(row);
+			if(++blockRows_ == BLOCK_ROWS)
+				flush();
+		}
+
+		/// Writes the selected rows of a batch.
+		void writeBatch(const RowBatch & batch)
+		{
+			for(size_t index = 0; index != batch.selected(); ++index)
+				writeRow(*batch.selectedRow(index));
+		}
+	};
+
+	/// Bridge class used in the pipeline construction syntax.
+	class BinaryFlatFileWriterPrototype
+	{
+		std::string fileName_;
+		BinaryChecksums checksums_;
+	public:
+
+		template<class Source>
+		struct ForSource
+		{
+			typedef BinaryFlatFileWriter<Source> Type;
+		};
+
+		BinaryFlatFileWriterPrototype(const std::string & fileName, BinaryChecksums checksums)
+			: fileName_(fileName), checksums_(checksums)
+		{
+		}
+
+		template<class Source>
+		BinaryFlatFileWriter<Source> create() const
+		{
+			return BinaryFlatFileWriter<Source>(fileName_, checksums_);
+		}
+	};
+
+	/// Writes rows for read_binary_file() to read back without parsing:
+	/// read_text_file(...) >> write_binary_file("out.rows", BINARY_CHECKSUMS)
+	BinaryFlatFileWriterPrototype write_binary_file(const std::string & fileName,
+		BinaryChecksums checksums = BINARY_NO_CHECKSUMS)
+	{
+		return BinaryFlatFileWriterPrototype(fileName, checksums);
+	}
+
+} // end namespace RowStreams
+
+#endif
\ No newline at end of file
@@ -0,0 +1,301 @@
+#ifndef ROWSTREAMS_BINARY_LAYOUT_HPP
+#define ROWSTREAMS_BINARY_LAYOUT_HPP
+
+#include "RowStreams/Row.hpp"
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/ColumnDefHelpers.hpp"
+#include "RowStreams/ZoneMap.hpp"
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstring>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/crc.hpp>
+
+namespace RowStreams
+{
+	/// Whether a binary file carries a checksum for each block of rows.
+	enum BinaryChecksums
+	{
+		BINARY_NO_CHECKSUMS,
+		/// Every block gets a CRC-32, checked by the reader as it gets to it.
+		BINARY_CHECKSUMS
+	};
+
+	/// Header of every block of rows in a binary file.
+	struct BinaryBlockHeader
+	{
+		/// Number of rows, zero for the block that ends the file, which has
+		/// nothing past its header.
+		boost::uint32_t rows;
+		/// CRC-32 of the rest of the block, or zero without checksums.
+		boost::uint32_t checksum;
+		/// Size of the rest of the block.
+		boost::uint64_t size;
+	};
+
+	/// How rows are stored in binary files, so that reading them back is a
+	/// copy rather than parsing.
+	///
+	/// The file starts with a header: 8 magic bytes, a 32 bit tag telling
+	/// the byte order, the version, the flags, the number of columns and the
+	/// size of a row, then the offset, size, type name and name of every
+	/// column. Blocks of rows follow, each a BinaryBlockHeader, a ColumnZone
+	/// per column, the bytes of every row as laid out by the RowDef, then the
+	/// null bitmap of every row as a Row keeps it, in whole 64 bit words,
+	/// where a zero bit means that the column is null. Readers
+	/// skip the blocks whose zones tell that no row meets their predicates.
+	/// Rows with external columns, like long strings, are followed by the
+	/// 64 bit offset of the bytes of every row in a heap, plus that of its
+	/// end, then the heap itself, where the bytes of each row are those its
+	/// columns point to, in column order. Every part is padded to a
+	/// multiple of 8 bytes, so that a mapping of the file has the values
+	/// aligned. A block with no rows ends the file.
+	///
+	/// Values are stored in the byte order and layout of the machine that
+	/// wrote them, and a reader that would lay them out differently refuses
+	/// the file.
+	class BinaryLayout
+	{
+		enum { VERSION = 4, FLAG_CHECKSUMS = 1, ENDIAN_TAG = 0x01020304 };
+
+		std::vector<const ColumnDef*> externalColumns_;
+		size_t numColumns_;
+		size_t rowSize_;
+		size_t recordSize_;
+		size_t nullsSize_;
+		size_t zonesSize_;
+
+		static size_t padded(size_t size)
+		{
+			return (size + 7) / 8 * 8;
+		}
+
+		static const char * magic()
+		{
+			return "RSBINROW";
+		}
+
+		static void write32(boost::uint32_t value, std::vector<char> & out)
+		{
+			out.insert(out.end(), (const char*)&value, (const char*)&value + sizeof(value));
+		}
+
+		static void writeString(const std::string & value, std::vector<char> & out)
+		{
+			write32(boost::uint32_t(value.size()), out);
+			out.insert(out.end(), value.begin(), value.end());
+		}
+
+		/// Reads the header of a file one field at a time, never past its end.
+		class HeaderReader
+		{
+			const char * pos_;
+			const char * end_;
+			const std::string & fileName_;
+
+		public:
+			HeaderReader(const char * data, size_t size, const std::string & fileName)
+				: pos_(data), end_(data + size), fileName_(fileName)
+			{
+			}
+
+			const char * read(size_t size)
+			{
+				if(size_t(end_ - pos_) < size)
+					throw std::runtime_error("Truncated header in "+fileName_);
+				const char * field = pos_;
+				pos_ += size;
+				return field;
+			}
+
+			boost::uint32_t read32()
+			{
+				boost::uint32_t value;
+				::memcpy(&value, read(sizeof(value)), sizeof(value));
+				return value;
+			}
+
+			std::string readString()
+			{
+				const size_t size = read32();
+				return std::string(read(size), size);
+			}
+
+			const char * pos() const
+			{
+				return pos_;
+			}
+		};
+
+	public:
+		BinaryLayout()
+			: numColumns_(0), rowSize_(0), recordSize_(0), nullsSize_(0), zonesSize_(0)
+		{
+		}
+
+		void init(const RowDef & rowDef)
+		{
+			externalColumns_.clear();
+			for(RowDef::ConstAttrIter column = rowDef.begin(); column != rowDef.end(); ++column)
+			{
+				if((*column)->encoded())
+					throw std::runtime_error("Column "+(*column)->name()+" is dictionary encoded and cannot be stored");
+				if((*column)->external())
+					externalColumns_.push_back(*column);
+			}
+			numColumns_ = rowDef.numColumns();
+			rowSize_ = rowDef.size();
+			recordSize_ = padded(rowSize_);
+			nullsSize_ = (numColumns_ + Row::NULL_WORD_BITS - 1) / Row::NULL_WORD_BITS * sizeof(Row::NullWord);
+			zonesSize_ = numColumns_ * sizeof(ColumnZone);
+		}
+
+		/// Size of the zones at the start of a block.
+		size_t zonesSize() const
+		{
+			return zonesSize_;
+		}
+
+		/// Size of the bytes of a row in a block.
+		size_t recordSize() const
+		{
+			return recordSize_;
+		}
+
+		/// Size of the null bitmap of a row.
+		size_t nullsSize() const
+		{
+			return nullsSize_;
+		}
+
+		/// Whether blocks have a heap.
+		bool external() const
+		{
+			return !externalColumns_.empty();
+		}
+
+		/// Where the offsets in the heap start in a block.
+		size_t offsetsAt(size_t rows) const
+		{
+			return zonesSize_ + recordSize_ * rows + padded(nullsSize_ * rows);
+		}
+
+		/// Where the heap starts in a block.
+		size_t stringsAt(size_t rows) const
+		{
+			return offsetsAt(rows) + (external() ? sizeof(boost::uint64_t) * (rows + 1) : 0);
+		}
+
+		/// Size of a block of rows, without its header.
+		size_t blockSize(size_t rows, size_t stringsSize = 0) const
+		{
+			return stringsAt(rows) + padded(stringsSize);
+		}
+
+		/// Copies a row into its bytes and its null bitmap in a block, and
+		/// appends the bytes its columns point to onto the heap.
+		void pack(const Row & row, char * record, char * nulls, std::vector<char> & strings) const
+		{
+			::memcpy(record, row.buffer(), rowSize_);
+			row.storeValid(reinterpret_cast<Row::NullWord*>(nulls), numColumns_);
+			for(std::vector<const ColumnDef*>::const_iterator column = externalColumns_.begin();
+				column != externalColumns_.end(); ++column)
+				(*column)->stash(row, strings);
+		}
+
+		/// Copies a row out of a block, with its columns pointing to the size
+		/// bytes of the heap at strings. Columns past those of the file are
+		/// left as they are. Returns false if the columns point to another
+		/// number of bytes.
+		bool unpack(const char * record, const char * nulls, const char * strings, size_t size, Row & row) const
+		{
+			::memcpy(row.buffer(), record, rowSize_);
+			row.assignValid(reinterpret_cast<const Row::NullWord*>(nulls), numColumns_);
+			for(std::vector<const ColumnDef*>::const_iterator column = externalColumns_.begin();
+				column != externalColumns_.end(); ++column)
+			{
+				const size_t taken = (*column)->attach(row, strings);
+				if(taken > size)
+					return false;
+				strings += taken;
+				size -= taken;
+			}
+			return size == 0;
+		}
+
+		/// Copies the bytes the columns of a row point to into its arena.
+		void own(Row & row) const
+		{
+			for(std::vector<const ColumnDef*>::const_iterator column = externalColumns_.begin();
+				column != externalColumns_.end(); ++column)
+				(*column)->own(row);
+		}
+
+		static boost::uint32_t checksum(const char * data, size_t size)
+		{
+			boost::crc_32_type crc;
+			crc.process_bytes(data, size);
+			return crc.checksum();
+		}
+
+		/// Appends the header of a file of rows laid out by rowDef.
+		static void writeHeader(const RowDef & rowDef, BinaryChecksums checksums, std::vector<char> & out)
+		{
+			out.insert(out.end(), magic(), magic() + 8);
+			write32(ENDIAN_TAG, out);
+			write32(VERSION, out);
+			write32(checksums == BINARY_CHECKSUMS ? FLAG_CHECKSUMS : 0, out);
+			write32(boost::uint32_t(rowDef.numColumns()), out);
+			write32(boost::uint32_t(rowDef.size()), out);
+			for(RowDef::ConstAttrIter column = rowDef.begin(); column != rowDef.end(); ++column)
+			{
+				write32(boost::uint32_t((*column)->offset()), out);
+				write32(boost::uint32_t((*column)->size()), out);
+				writeString((*column)->typeName(), out);
+				writeString((*column)->name(), out);
+			}
+			out.resize(padded(out.size()));
+		}
+
+		/// Rebuilds the RowDef of a file from its header, and returns the
+		/// size of the header.
+		static size_t readHeader(const char * data, size_t size, const std::string & fileName,
+			RowDef & rowDef, BinaryChecksums & checksums)
+		{
+			HeaderReader reader(data, size, fileName);
+			if(::memcmp(reader.read(8), magic(), 8))
+				throw std::runtime_error("Not a binary row file: "+fileName);
+			if(reader.read32() != ENDIAN_TAG)
+				throw std::runtime_error("Byte order of "+fileName+" does not match");
+			if(reader.read32() != VERSION)
+				throw std::runtime_error("Unknown version of "+fileName);
+			checksums = (reader.read32() & FLAG_CHECKSUMS) ? BINARY_CHECKSUMS : BINARY_NO_CHECKSUMS;
+
+			const size_t numColumns = reader.read32();
+			const size_t rowSize = reader.read32();
+			rowDef = RowDef();
+			for(size_t index = 0; index != numColumns; ++index)
+			{
+				const size_t offset = reader.read32();
+				const size_t columnSize = reader.read32();
+				const std::string typeName = reader.readString();
+				const std::string name = reader.readString();
+
+				boost::scoped_ptr<ColumnDef> columnDef(new_column_def(typeName, name));
+				if(!columnDef.get())
+					throw std::runtime_error("Column "+name+" of "+fileName+" has unknown type "+typeName);
+				rowDef.add(*columnDef);
+				if(rowDef.offset(index) != offset || columnDef->size() != columnSize)
+					throw std::runtime_error("Layout of "+fileName+" does not match");
+			}
+			if(rowDef.size() != rowSize)
+				throw std::runtime_error("Layout of "+fileName+" does not match");
+
+			return padded(reader.pos() - data);
+		}
+	};
+}
+
+#endif
\ No newline at end of file
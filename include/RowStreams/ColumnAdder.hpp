@@ -1,10 +1,17 @@
 #ifndef ROWSTREAMS_COLUMN_ADDER_HPP
 #define ROWSTREAMS_COLUMN_ADDER_HPP
 
+#include "RowStreams/RowBatch.hpp"
+#include "RowStreams/PipelinePlan.hpp"
+#include "RowStreams/StageTraits.hpp"
 #include <string>
 
 namespace RowStreams
 {
+	/// Adds a column, null in every row, at the end of the rows.
+	/// When the stream has been planned, rows come with room for the column
+	/// already and nothing needs to be done per row; otherwise every row is
+	/// switched to the new RowDef, which may grow its buffer.
 	template<class Source, class ColumnType>
 	class ColumnAdder
 	{
@@ -12,10 +19,12 @@ namespace RowStreams
 		Source * source_;
 		std::string name_;
 		RowDef rowDef_;
+		/// Whether rows come laid out for the end of the stream.
+		bool planned_;
 
 	public:
 		ColumnAdder(const std::string & name)
-			: source_(0), name_(name)
+			: source_(0), name_(name), planned_(false)
 		{
 		}
 
@@ -23,6 +32,16 @@ namespace RowStreams
 		{
 			source_->init();
 			rowDef_ = source_->rowDef() << column_def<ColumnType>(name_);
+			planned_ = false;
+		}
+
+		bool plan(PipelinePlan & plan)
+		{
+			if(!plan.layout)
+				plan.layout = &rowDef_;
+			plan.withhold(name_);
+			planned_ = source_->plan(plan);
+			return planned_;
 		}
 
 		void source(Source * source)
@@ -34,18 +53,52 @@ namespace RowStreams
 		Row * next()
 		{
 			Row * row = source_->next();
-			if(row)
+			if(row && !planned_)
 				row->rowDef(&rowDef_);
 
 			return row;
 		}
 
+		void release(Row * row)
+		{
+			source_->release(row);
+		}
+
+		bool nextBatch(RowBatch & batch)
+		{
+			if(!source_->nextBatch(batch))
+				return false;
+
+			if(!planned_)
+			{
+				for(size_t index = 0; index != batch.size(); ++index)
+					batch.row(index)->rowDef(&rowDef_);
+			}
+			return true;
+		}
+
+		void releaseBatch(RowBatch & batch)
+		{
+			source_->releaseBatch(batch);
+		}
+
+		void stop()
+		{
+			source_->stop();
+		}
+
 		const RowDef & rowDef() const
 		{
 			return rowDef_;
 		}
 	};
 
+	template<class Source, class ColumnType>
+	struct StageTraits<ColumnAdder<Source, ColumnType> >
+	{
+		enum { replicable = true };
+	};
+
 	template<class ColumnType>
 	class ColumnAdderPrototype
 	{
@@ -0,0 +1,190 @@
+#ifndef ROWSTREAMS_COLUMN_BATCH_HPP
+#define ROWSTREAMS_COLUMN_BATCH_HPP
+
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/Row.hpp"
+#include "RowStreams/RowBatch.hpp"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <boost/cstdint.hpp>
+
+namespace RowStreams
+{
+	/// Column major (structure of arrays) layout for the rows of a RowBatch.
+	/// The values of each column sit in their own contiguous, aligned array,
+	/// with a separate validity bitmap, so that numeric code can stream through
+	/// them and be vectorized by the compiler. Rows are converted to and from
+	/// this layout with gather() and scatter().
+	class ColumnBatch
+	{
+	public:
+		enum { CAPACITY = RowBatch::CAPACITY, ALIGNMENT = 64 };
+		typedef boost::uint64_t Word;
+		enum { WORD_BITS = 64, WORDS = CAPACITY / WORD_BITS };
+
+	private:
+		struct Column
+		{
+			const ColumnDef * columnDef;
+			/// Offset of the values array in storage_.
+			size_t values;
+			/// A bit per value, where zero means it is null.
+			Word valid[WORDS];
+		};
+
+		std::vector<Column> columns_;
+		/// Position in columns_ of each column of the RowDef, or -1 if not laid out.
+		std::vector<size_t> positions_;
+		std::vector<char> storage_;
+		char * base_;
+		size_t size_;
+
+		ColumnBatch(const ColumnBatch &);
+		ColumnBatch & operator=(const ColumnBatch &);
+
+		/// Common sizes are spelled out so the copies compile down to single moves.
+		static void copyValue(char * dest, const char * src, size_t size)
+		{
+			switch(size)
+			{
+			case 1: *dest = *src; break;
+			case 2: ::memcpy(dest, src, 2); break;
+			case 4: ::memcpy(dest, src, 4); break;
+			case 8: ::memcpy(dest, src, 8); break;
+			default: ::memcpy(dest, src, size); break;
+			}
+		}
+
+	public:
+		ColumnBatch()
+			: base_(0), size_(0)
+		{
+		}
+
+		/// Lays out all the columns of a RowDef.
+		void layout(const RowDef & rowDef)
+		{
+			std::vector<size_t> indices;
+			for(size_t index = 0; index != rowDef.numColumns(); ++index)
+				indices.push_back(index);
+			layout(rowDef, indices);
+		}
+
+		/// Lays out only the given columns of a RowDef, by index.
+		void layout(const RowDef & rowDef, const std::vector<size_t> & indices)
+		{
+			columns_.clear();
+			positions_.assign(rowDef.numColumns(), size_t(-1));
+
+			size_t total = 0;
+			for(std::vector<size_t>::const_iterator index = indices.begin(); index != indices.end(); ++index)
+			{
+				Column column;
+				column.columnDef = *(rowDef.begin() + *index);
+				column.values = total;
+				std::fill(column.valid, column.valid + WORDS, Word(0));
+				total += (column.columnDef->size() * CAPACITY + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+				positions_[*index] = columns_.size();
+				columns_.push_back(column);
+			}
+
+			storage_.assign(total + ALIGNMENT, 0);
+			const size_t misalignment = reinterpret_cast<size_t>(&storage_[0]) % ALIGNMENT;
+			base_ = &storage_[0] + (misalignment ? ALIGNMENT - misalignment : 0);
+			size_ = 0;
+		}
+
+		size_t size() const
+		{
+			return size_;
+		}
+
+		bool hasColumn(size_t index) const
+		{
+			return index < positions_.size() && positions_[index] != size_t(-1);
+		}
+
+		/// Values of a column, by RowDef index.
+		template<class T>
+		T * values(size_t index)
+		{
+			return reinterpret_cast<T*>(base_ + columns_[positions_[index]].values);
+		}
+
+		template<class T>
+		const T * values(size_t index) const
+		{
+			return reinterpret_cast<const T*>(base_ + columns_[positions_[index]].values);
+		}
+
+		/// Validity bitmap of a column, by RowDef index.
+		Word * valid(size_t index)
+		{
+			return columns_[positions_[index]].valid;
+		}
+
+		const Word * valid(size_t index) const
+		{
+			return columns_[positions_[index]].valid;
+		}
+
+		bool isNull(size_t index, size_t row) const
+		{
+			return !(valid(index)[row / WORD_BITS] >> (row % WORD_BITS) & 1);
+		}
+
+		/// Copies the selected rows of a batch into the column arrays.
+		void gather(const RowBatch & batch)
+		{
+			size_ = batch.selected();
+			for(std::vector<Column>::iterator column = columns_.begin(); column != columns_.end(); ++column)
+			{
+				const size_t index = column->columnDef->index();
+				const size_t offset = column->columnDef->offset();
+				const size_t size = column->columnDef->size();
+				char * dest = base_ + column->values;
+
+				std::fill(column->valid, column->valid + WORDS, Word(0));
+				for(size_t row = 0; row != size_; ++row, dest += size)
+				{
+					const Row & source = *batch.selectedRow(row);
+					copyValue(dest, source.buffer() + offset, size);
+					column->valid[row / WORD_BITS] |= Word(!source.isNull(index)) << (row % WORD_BITS);
+				}
+			}
+		}
+
+		/// Copies the column arrays back into the selected rows of a batch.
+		void scatter(RowBatch & batch) const
+		{
+			for(std::vector<Column>::const_iterator column = columns_.begin(); column != columns_.end(); ++column)
+				scatterColumn(*column, batch);
+		}
+
+		/// Copies a single column back into the selected rows of a batch.
+		void scatter(size_t index, RowBatch & batch) const
+		{
+			scatterColumn(columns_[positions_[index]], batch);
+		}
+
+	private:
+		void scatterColumn(const Column & column, RowBatch & batch) const
+		{
+			const size_t index = column.columnDef->index();
+			const size_t offset = column.columnDef->offset();
+			const size_t size = column.columnDef->size();
+			const char * src = base_ + column.values;
+
+			for(size_t row = 0; row != size_; ++row, src += size)
+			{
+				Row & dest = *batch.selectedRow(row);
+				copyValue(dest.buffer() + offset, src, size);
+				dest.setNull(index, !(column.valid[row / WORD_BITS] >> (row % WORD_BITS) & 1));
+			}
+		}
+	};
+}
+
+#endif
\ No newline at end of file
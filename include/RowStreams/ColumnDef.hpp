@@ -1,11 +1,16 @@
 #ifndef ROWSTREAMS_COLUMN_DEF_HPP
 #define ROWSTREAMS_COLUMN_DEF_HPP
 
+#include "RowStreams/ValueParser.hpp"
 #include <string>
+#include <vector>
+#include <cstring>
 
 namespace RowStreams
 {
 	class Row;
+	class OutputBuffer;
+	struct ColumnZone;
 	/// Information about the data type of a column, as well as utilities
 	/// to perform operations on the column value.
 	class ColumnDef
@@ -22,14 +27,48 @@ namespace RowStreams
 
 		virtual ~ColumnDef(){}
 
-		virtual void parseString(const char * value, Row & row) const = 0;
+		/// Parses a field that is not necessarily NUL-terminated, for example
+		/// a view straight into a memory mapped file. The value is left null
+		/// unless the result is PARSE_OK.
+		virtual ParseResult parseString(const char * value, size_t length, Row & row) const = 0;
 		virtual std::string toString(Row & row) const = 0;
+		/// Appends the value as text, or nothing at all if it is null.
+		virtual void format(const Row & row, OutputBuffer & out) const = 0;
+		/// Writes size() bytes that compare with memcmp in the order of the
+		/// values, for sorting. The value must not be null.
+		virtual void normalize(const Row & row, char * key) const = 0;
+		/// Name of the type of the values, as written in binary files.
+		virtual const char * typeName() const = 0;
+		/// Widens the zone of a block to the value of a row, which must not
+		/// be null.
+		virtual void widen(const Row & row, ColumnZone & zone) const = 0;
+		/// Whether values point to bytes outside the buffer of the row, like
+		/// those of StringRef. Stages that keep the bytes of rows for longer
+		/// than the rows themselves keep those apart, see stash().
+		virtual bool external() const = 0;
+		/// Whether values are codes that only mean something in this
+		/// process, like those of DictString, and do not sort by their bytes.
+		virtual bool encoded() const = 0;
+		/// Copies the bytes the value of a row points to into the arena of
+		/// the row, for values parsed from text that does not outlive it.
+		virtual void own(Row & row) const = 0;
+		/// Appends the bytes the value of a row points to onto heap, for
+		/// values copied elsewhere without them. Nothing is appended unless
+		/// the column is external and the value is not null.
+		virtual void stash(const Row & row, std::vector<char> & heap) const = 0;
+		/// Points the value of a row, copied in without the bytes stash()
+		/// appended for it, to those bytes at data. Returns their number.
+		virtual size_t attach(Row & row, const char * data) const = 0;
 		virtual size_t size() const = 0;
 		virtual size_t alignment() const = 0;
 		virtual ColumnDef * clone() const = 0;
 
+		ParseResult parseString(const char * value, Row & row) const
+		{
+			return parseString(value, ::strlen(value), row);
+		}
 
-		std::string name()
+		std::string name() const
 		{
 			return name_;
 		}
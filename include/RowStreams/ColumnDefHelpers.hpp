@@ -3,8 +3,13 @@
 
 #include "RowStreams/Row.hpp"
 #include "RowStreams/ValueParser.hpp"
-#include <sstream>
+#include "RowStreams/ValueFormatter.hpp"
+#include "RowStreams/ValueNormalizer.hpp"
+#include "RowStreams/ValueTypeName.hpp"
+#include "RowStreams/ZoneMap.hpp"
+#include "RowStreams/StringRef.hpp"
 #include <boost/type_traits.hpp>
+#include <boost/cstdint.hpp>
 
 namespace RowStreams
 {
@@ -18,19 +23,85 @@ namespace RowStreams
 		{
 		}
 
-		void parseString(const char * str, Row & row) const
+		using ColumnDef::parseString;
+
+		ParseResult parseString(const char * str, size_t length, Row & row) const
 		{
 			ValueParser<T> parser;
-			T value = parser(str);
-			row.set(index(), offset(), value);
+			T value;
+			const ParseResult result = parser.parse(str, length, value);
+			if(result == PARSE_OK)
+				row.set(index(), offset(), value);
+			return result;
 		}
 
 		std::string toString(Row & row) const
 		{
-			std::ostringstream oss;
+			OutputBuffer out;
+			format(row, out);
+			return std::string(out.data(), out.size());
+		}
+
+		void format(const Row & row, OutputBuffer & out) const
+		{
 			if(!row.isNull(index()))
-				oss << row.get<T>(index(), offset());
-			return oss.str();
+			{
+				ValueFormatter<T> formatter;
+				formatter.format(row.get<T>(index(), offset()), out);
+			}
+		}
+
+		void normalize(const Row & row, char * key) const
+		{
+			ValueNormalizer<T> normalizer;
+			normalizer.normalize(row.get<T>(index(), offset()), key);
+		}
+
+		void widen(const Row & row, ColumnZone & zone) const
+		{
+			ValueZone<T>::widen(row.get<T>(index(), offset()), zone);
+		}
+
+		bool external() const
+		{
+			return ValueStorage<T>::external;
+		}
+
+		bool encoded() const
+		{
+			return ValueStorage<T>::encoded;
+		}
+
+		void own(Row & row) const
+		{
+			if(ValueStorage<T>::external && !row.isNull(index()))
+			{
+				T value = row.get<T>(index(), offset());
+				ValueStorage<T>::own(value, row.arena());
+				row.set(index(), offset(), value);
+			}
+		}
+
+		void stash(const Row & row, std::vector<char> & heap) const
+		{
+			if(ValueStorage<T>::external && !row.isNull(index()))
+				ValueStorage<T>::stash(row.get<T>(index(), offset()), heap);
+		}
+
+		size_t attach(Row & row, const char * data) const
+		{
+			if(!ValueStorage<T>::external || row.isNull(index()))
+				return 0;
+			T value = row.get<T>(index(), offset());
+			const size_t size = ValueStorage<T>::attach(value, data);
+			row.set(index(), offset(), value);
+			return size;
+		}
+
+		const char * typeName() const
+		{
+			ValueTypeName<T> typeName;
+			return typeName.name();
 		}
 
 		size_t size() const
@@ -60,6 +131,35 @@ namespace RowStreams
 		return attr1->name() == attr2->name();
 	}
 
+	/// Creates the definition of a column from the name of its type, as
+	/// given by ColumnDef::typeName(). Returns null for types that have no
+	/// name of their own.
+	ColumnDef * new_column_def(const std::string & typeName, const std::string & name)
+	{
+#define ROWSTREAMS_NEW_COLUMN_DEF(type) \
+		if(typeName == ValueTypeName<type>().name()) \
+			return new ColumnDefTpl<type>(name);
+
+		ROWSTREAMS_NEW_COLUMN_DEF(bool)
+		ROWSTREAMS_NEW_COLUMN_DEF(char)
+		ROWSTREAMS_NEW_COLUMN_DEF(boost::int8_t)
+		ROWSTREAMS_NEW_COLUMN_DEF(boost::uint8_t)
+		ROWSTREAMS_NEW_COLUMN_DEF(boost::int16_t)
+		ROWSTREAMS_NEW_COLUMN_DEF(boost::uint16_t)
+		ROWSTREAMS_NEW_COLUMN_DEF(boost::int32_t)
+		ROWSTREAMS_NEW_COLUMN_DEF(boost::uint32_t)
+		ROWSTREAMS_NEW_COLUMN_DEF(boost::int64_t)
+		ROWSTREAMS_NEW_COLUMN_DEF(boost::uint64_t)
+		ROWSTREAMS_NEW_COLUMN_DEF(float)
+		ROWSTREAMS_NEW_COLUMN_DEF(double)
+		ROWSTREAMS_NEW_COLUMN_DEF(Date)
+		ROWSTREAMS_NEW_COLUMN_DEF(Timestamp)
+		ROWSTREAMS_NEW_COLUMN_DEF(StringRef)
+
+#undef ROWSTREAMS_NEW_COLUMN_DEF
+		return 0;
+	}
+
 
 
 
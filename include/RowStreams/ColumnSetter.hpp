@@ -3,12 +3,24 @@
 
 #include "RowStreams/RowDef.hpp"
 #include "RowStreams/Functions.hpp"
+#include "RowStreams/RowBatch.hpp"
+#include "RowStreams/ColumnBatch.hpp"
+#include "RowStreams/PipelinePlan.hpp"
+#include "RowStreams/StageTraits.hpp"
+#include <vector>
 #include <string>
+#include <algorithm>
+#include <boost/scoped_array.hpp>
 
 namespace RowStreams
 {
 	/// Populates an existing column with values generated by a function
-	/// that is evaluated on each row. See Functions.hpp.
+	/// that is evaluated on each row. See Functions.hpp. The column is null
+	/// where the function is.
+	///
+	/// Batches are copied into a ColumnBatch holding the columns the
+	/// function reads, and the function is evaluated over all of its rows at
+	/// once, a column array at a time.
 	template<class Source, class ColumnType, class Oper>
 	class ColumnSetter
 	{
@@ -19,6 +31,11 @@ namespace RowStreams
 		RowDef rowDef_;
 		size_t index_;
 		size_t offset_;
+		ColumnBatch columns_;
+		boost::scoped_array<ColumnType> results_;
+		ColumnBatch::Word valid_[ColumnBatch::WORDS];
+
+		ColumnSetter & operator=(const ColumnSetter &);
 
 	public:
 		ColumnSetter(const std::string & name, const Function<ColumnType, Oper> & function)
@@ -26,15 +43,49 @@ namespace RowStreams
 		{
 		}
 
+		ColumnSetter(const ColumnSetter & other)
+			: source_(0), name_(other.name_), function_(other.function_), index_(size_t(-1)), offset_(size_t(-1))
+		{
+		}
+
 		Row * next() const
 		{
 			Row * row = source_->next();
 			if(row)
+			{
 				row->set(index_, offset_, function_(*row));
+				row->setNull(index_, function_.null(*row));
+			}
 
 			return row;
 		}
 
+		void release(Row * row)
+		{
+			source_->release(row);
+		}
+
+		bool nextBatch(RowBatch & batch)
+		{
+			if(!source_->nextBatch(batch))
+				return false;
+
+			columns_.gather(batch);
+			const ColumnType * results = function_.evaluate(columns_, results_.get(), valid_);
+			for(size_t index = 0; index != batch.selected(); ++index)
+			{
+				Row * row = batch.selectedRow(index);
+				row->set(index_, offset_, results[index]);
+				row->setNull(index_, !(valid_[index / ColumnBatch::WORD_BITS] >> (index % ColumnBatch::WORD_BITS) & 1));
+			}
+			return true;
+		}
+
+		void releaseBatch(RowBatch & batch)
+		{
+			source_->releaseBatch(batch);
+		}
+
 		void init()
 		{
 			source_->init();
@@ -42,6 +93,35 @@ namespace RowStreams
 			index_ = rowDef_.index(name_);
 			offset_ = rowDef_.offset(name_);
 			function_.init(rowDef_);
+
+			std::vector<std::string> columns;
+			function_.columns(columns);
+			std::vector<size_t> indices;
+			for(std::vector<std::string>::const_iterator column = columns.begin(); column != columns.end(); ++column)
+			{
+				const size_t index = rowDef_.index(*column);
+				if(std::find(indices.begin(), indices.end(), index) == indices.end())
+					indices.push_back(index);
+			}
+			columns_.layout(rowDef_, indices);
+			results_.reset(new ColumnType[ColumnBatch::CAPACITY]);
+		}
+
+		bool plan(PipelinePlan & plan)
+		{
+			if(!plan.layout)
+				plan.layout = &rowDef_;
+			plan.withhold(name_);
+			plan.written(name_);
+			std::vector<std::string> columns;
+			function_.columns(columns);
+			plan.use(columns);
+			return source_->plan(plan);
+		}
+
+		void stop()
+		{
+			source_->stop();
 		}
 
 		const RowDef & rowDef()
@@ -55,6 +135,12 @@ namespace RowStreams
 		}
 	};
 
+	template<class Source, class ColumnType, class Oper>
+	struct StageTraits<ColumnSetter<Source, ColumnType, Oper> >
+	{
+		enum { replicable = true };
+	};
+
 	/// Bridge class used to allow the pipeline construction syntax. 
 	/// @see Pipeline.hpp
 	template<class ColumnType, class Oper>
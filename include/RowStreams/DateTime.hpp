@@ -0,0 +1,307 @@
+#ifndef ROWSTREAMS_DATE_TIME_HPP
+#define ROWSTREAMS_DATE_TIME_HPP
+
+#include <boost/cstdint.hpp>
+
+namespace RowStreams
+{
+	/// Units that dates and timestamps are truncated to.
+	enum TimeUnit
+	{
+		TIME_SECOND,
+		TIME_MINUTE,
+		TIME_HOUR,
+		TIME_DAY,
+		/// Weeks start on Monday.
+		TIME_WEEK,
+		TIME_MONTH,
+		TIME_YEAR
+	};
+
+	namespace DateTimes
+	{
+		enum
+		{
+			SECOND = 1000000,
+			MINUTE = 60 * SECOND
+		};
+
+		const boost::int64_t HOUR = boost::int64_t(60) * MINUTE;
+		const boost::int64_t DAY = 24 * HOUR;
+
+		/// Quotient rounded down, for times before the epoch.
+		template<class T>
+		T floorDiv(T value, T divisor)
+		{
+			const T quotient = value / divisor;
+			return quotient - T((value % divisor) < 0);
+		}
+
+		/// Days from 1970-01-01 to a date of the proleptic Gregorian
+		/// calendar. Counts in eras of 400 years, which all have the same
+		/// number of days, and in years starting in March, which puts leap
+		/// days last, so there are no branches on the month. Years far
+		/// enough from now give more days than a Date holds, so they are
+		/// counted in 64 bits.
+		inline boost::int64_t daysFromCivil(int year, unsigned month, unsigned day)
+		{
+			year -= month <= 2;
+			const boost::int64_t era = (year >= 0 ? year : year - 399) / 400;
+			const unsigned yearOfEra = unsigned(year - era * 400);
+			const unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+			const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+			return era * 146097 + boost::int64_t(dayOfEra) - 719468;
+		}
+
+		/// The inverse of daysFromCivil(), for the days a Date holds.
+		inline void civilFromDays(boost::int32_t days, int & year, unsigned & month, unsigned & day)
+		{
+			const boost::int64_t shifted = boost::int64_t(days) + 719468;
+			const boost::int64_t era = (shifted >= 0 ? shifted : shifted - 146096) / 146097;
+			const unsigned dayOfEra = unsigned(shifted - era * 146097);
+			const unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+			const unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+			const unsigned monthFromMarch = (5 * dayOfYear + 2) / 153;
+			day = dayOfYear - (153 * monthFromMarch + 2) / 5 + 1;
+			month = monthFromMarch < 10 ? monthFromMarch + 3 : monthFromMarch - 9;
+			year = int(yearOfEra + era * 400) + (month <= 2);
+		}
+
+		inline bool isLeapYear(int year)
+		{
+			return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+		}
+
+		inline unsigned daysInMonth(int year, unsigned month)
+		{
+			static const unsigned char days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+			return days[month - 1] + (month == 2 && isLeapYear(year));
+		}
+	}
+
+	/// A date, as the number of days since 1970-01-01. Read and written as
+	/// YYYY-MM-DD.
+	class Date
+	{
+		boost::int32_t days_;
+
+	public:
+		Date()
+			: days_(0)
+		{
+		}
+
+		explicit Date(boost::int32_t days)
+			: days_(days)
+		{
+		}
+
+		/// The date of a day of a month, which must exist.
+		static Date fromCivil(int year, unsigned month, unsigned day)
+		{
+			return Date(boost::int32_t(DateTimes::daysFromCivil(year, month, day)));
+		}
+
+		boost::int32_t days() const
+		{
+			return days_;
+		}
+
+		void civil(int & year, unsigned & month, unsigned & day) const
+		{
+			DateTimes::civilFromDays(days_, year, month, day);
+		}
+
+		Date addDays(boost::int32_t days) const
+		{
+			return Date(days_ + days);
+		}
+
+		/// Moves by whole months, keeping the day of the month unless the
+		/// new month is shorter, as in 01-31 plus a month giving 02-28.
+		Date addMonths(int months) const
+		{
+			int year;
+			unsigned month, day;
+			civil(year, month, day);
+			const int total = year * 12 + int(month) - 1 + months;
+			year = DateTimes::floorDiv(total, 12);
+			month = unsigned(total - year * 12) + 1;
+			const unsigned last = DateTimes::daysInMonth(year, month);
+			return fromCivil(year, month, day < last ? day : last);
+		}
+
+		/// The first day of the week, month or year of the date. Dates are
+		/// whole days already, so smaller units leave them as they are.
+		Date truncate(TimeUnit unit) const
+		{
+			switch(unit)
+			{
+			case TIME_WEEK:
+				// 1970-01-01 was a Thursday.
+				return Date(days_ - (days_ - DateTimes::floorDiv(days_ + 3, 7) * 7 + 3));
+			case TIME_MONTH:
+			case TIME_YEAR:
+				{
+					int year;
+					unsigned month, day;
+					civil(year, month, day);
+					return fromCivil(year, unit == TIME_YEAR ? 1 : month, 1);
+				}
+			default:
+				return *this;
+			}
+		}
+
+		bool operator==(const Date & other) const
+		{
+			return days_ == other.days_;
+		}
+
+		bool operator!=(const Date & other) const
+		{
+			return days_ != other.days_;
+		}
+
+		bool operator<(const Date & other) const
+		{
+			return days_ < other.days_;
+		}
+
+		bool operator<=(const Date & other) const
+		{
+			return days_ <= other.days_;
+		}
+
+		bool operator>(const Date & other) const
+		{
+			return days_ > other.days_;
+		}
+
+		bool operator>=(const Date & other) const
+		{
+			return days_ >= other.days_;
+		}
+	};
+
+	/// A point in time, as the number of microseconds since 1970-01-01
+	/// 00:00:00 UTC, leap seconds aside. Read as ISO 8601, with an optional
+	/// fraction and offset, and written as YYYY-MM-DDTHH:MM:SS in UTC, with
+	/// the microseconds when there are any.
+	class Timestamp
+	{
+		boost::int64_t micros_;
+
+	public:
+		Timestamp()
+			: micros_(0)
+		{
+		}
+
+		explicit Timestamp(boost::int64_t micros)
+			: micros_(micros)
+		{
+		}
+
+		/// Midnight at the start of a date.
+		static Timestamp fromDate(const Date & date)
+		{
+			return Timestamp(date.days() * DateTimes::DAY);
+		}
+
+		boost::int64_t micros() const
+		{
+			return micros_;
+		}
+
+		/// The date the timestamp falls on.
+		Date date() const
+		{
+			return Date(boost::int32_t(DateTimes::floorDiv(micros_, DateTimes::DAY)));
+		}
+
+		/// Microseconds since the start of the day.
+		boost::int64_t timeOfDay() const
+		{
+			const boost::int64_t rest = micros_ % DateTimes::DAY;
+			return rest < 0 ? rest + DateTimes::DAY : rest;
+		}
+
+		Timestamp addMicros(boost::int64_t micros) const
+		{
+			return Timestamp(micros_ + micros);
+		}
+
+		Timestamp addDays(boost::int32_t days) const
+		{
+			return Timestamp(micros_ + days * DateTimes::DAY);
+		}
+
+		/// Moves by whole months, keeping the time of day, see
+		/// Date::addMonths().
+		Timestamp addMonths(int months) const
+		{
+			return Timestamp(fromDate(date().addMonths(months)).micros_ + timeOfDay());
+		}
+
+		/// The start of the second, minute, hour, day, week, month or year of
+		/// the timestamp.
+		Timestamp truncate(TimeUnit unit) const
+		{
+			switch(unit)
+			{
+			case TIME_SECOND:
+				return Timestamp(DateTimes::floorDiv(micros_, boost::int64_t(DateTimes::SECOND)) * DateTimes::SECOND);
+			case TIME_MINUTE:
+				return Timestamp(DateTimes::floorDiv(micros_, boost::int64_t(DateTimes::MINUTE)) * DateTimes::MINUTE);
+			case TIME_HOUR:
+				return Timestamp(DateTimes::floorDiv(micros_, DateTimes::HOUR) * DateTimes::HOUR);
+			default:
+				return fromDate(date().truncate(unit));
+			}
+		}
+
+		bool operator==(const Timestamp & other) const
+		{
+			return micros_ == other.micros_;
+		}
+
+		bool operator!=(const Timestamp & other) const
+		{
+			return micros_ != other.micros_;
+		}
+
+		bool operator<(const Timestamp & other) const
+		{
+			return micros_ < other.micros_;
+		}
+
+		bool operator<=(const Timestamp & other) const
+		{
+			return micros_ <= other.micros_;
+		}
+
+		bool operator>(const Timestamp & other) const
+		{
+			return micros_ > other.micros_;
+		}
+
+		bool operator>=(const Timestamp & other) const
+		{
+			return micros_ >= other.micros_;
+		}
+	};
+
+	/// For boost::hash.
+	inline size_t hash_value(const Date & value)
+	{
+		return size_t(value.days());
+	}
+
+	inline size_t hash_value(const Timestamp & value)
+	{
+		return size_t(value.micros() ^ (value.micros() >> 32));
+	}
+}
+
+#endif
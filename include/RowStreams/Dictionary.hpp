@@ -0,0 +1,244 @@
+#ifndef ROWSTREAMS_DICTIONARY_HPP
+#define ROWSTREAMS_DICTIONARY_HPP
+
+#include "RowStreams/StringRef.hpp"
+#include "RowStreams/StringArena.hpp"
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace RowStreams
+{
+	/// Numbers strings, so that columns with few distinct values can hold a
+	/// 32 bit code instead of the string. Every string is stored once and
+	/// keeps its code for as long as the dictionary, which never forgets a
+	/// string, so it is only meant for low cardinality columns.
+	///
+	/// Strings are spread over shards by hash, each with a lock of its own,
+	/// so that parsing threads seldom wait for each other. The low bits of a
+	/// code tell its shard. Looking up the string of a code takes no lock,
+	/// since codes only get to other threads along with the rows holding
+	/// them. The empty string is always code 0.
+	class Dictionary
+	{
+		enum
+		{
+			SHARD_BITS = 4,
+			SHARDS = 1 << SHARD_BITS,
+			PAGE_BITS = 12,
+			PAGE_SIZE = 1 << PAGE_BITS,
+			/// Pages of a shard, which caps a dictionary at 2^24 strings.
+			PAGES = 1 << (24 - SHARD_BITS - PAGE_BITS)
+		};
+
+		struct Shard
+		{
+			boost::mutex mutex;
+			/// Codes of the strings, whose bytes are in arena.
+			boost::unordered_map<StringRef, boost::uint32_t> codes;
+			StringArena arena;
+			/// Strings by code, in pages that never move.
+			StringRef * pages[PAGES];
+			boost::uint32_t size;
+		};
+
+		Shard shards_[SHARDS];
+
+		Dictionary(const Dictionary &);
+		Dictionary & operator=(const Dictionary &);
+
+	public:
+		Dictionary()
+		{
+			for(size_t shard = 0; shard != SHARDS; ++shard)
+			{
+				std::fill(shards_[shard].pages, shards_[shard].pages + PAGES, (StringRef*)0);
+				shards_[shard].size = 0;
+			}
+			// Code 0 is taken by the empty string, which is never looked up.
+			shards_[0].pages[0] = new StringRef[PAGE_SIZE];
+			shards_[0].size = 1;
+		}
+
+		~Dictionary()
+		{
+			for(size_t shard = 0; shard != SHARDS; ++shard)
+			{
+				for(size_t page = 0; page != PAGES; ++page)
+					delete [] shards_[shard].pages[page];
+			}
+		}
+
+		/// Returns the code of a string, which is added if new.
+		boost::uint32_t code(const StringRef & value)
+		{
+			if(value.empty())
+				return 0;
+
+			// The high bits of the hash pick the shard, and the low ones the
+			// bucket in it.
+			const size_t hash = value.hash();
+			const boost::uint32_t index = boost::uint32_t(hash >> (sizeof(size_t) * 8 - SHARD_BITS));
+			Shard & shard = shards_[index];
+			boost::mutex::scoped_lock lock(shard.mutex);
+
+			boost::unordered_map<StringRef, boost::uint32_t>::const_iterator found = shard.codes.find(value);
+			if(found != shard.codes.end())
+				return found->second;
+
+			if(shard.size == boost::uint32_t(PAGES) * PAGE_SIZE)
+				throw std::runtime_error("Too many distinct values for a dictionary column");
+			StringRef *& page = shard.pages[shard.size >> PAGE_BITS];
+			if(!page)
+				page = new StringRef[PAGE_SIZE];
+
+			StringRef stored = value;
+			stored.own(shard.arena);
+			page[shard.size & (PAGE_SIZE - 1)] = stored;
+			const boost::uint32_t code = (shard.size++ << SHARD_BITS) | index;
+			shard.codes.insert(std::make_pair(stored, code));
+			return code;
+		}
+
+		/// Returns the string of a code given by code().
+		StringRef value(boost::uint32_t code) const
+		{
+			const Shard & shard = shards_[code & (SHARDS - 1)];
+			const boost::uint32_t local = code >> SHARD_BITS;
+			return shard.pages[local >> PAGE_BITS][local & (PAGE_SIZE - 1)];
+		}
+	};
+
+	namespace DictionaryDetail
+	{
+		/// The dictionary of all dictionary columns. A static member of a
+		/// template, so that every translation unit including this header
+		/// shares it, and it is built before main() starts any thread.
+		template<class Tag>
+		struct Shared
+		{
+			static Dictionary dictionary;
+		};
+
+		template<class Tag>
+		Dictionary Shared<Tag>::dictionary;
+	}
+
+	/// A string of a dictionary column: only its 32 bit code is stored in
+	/// rows. The dictionary is shared by every stream of the process, so
+	/// that equal strings have equal codes across the sides of a join, and
+	/// equality, hashing and grouping only look at codes. Ordering looks up
+	/// the strings, and codes mean nothing outside the process, so these
+	/// columns are neither sort keys nor stored in binary files.
+	class DictString
+	{
+		boost::uint32_t code_;
+
+		static Dictionary & dictionary()
+		{
+			return DictionaryDetail::Shared<void>::dictionary;
+		}
+
+	public:
+		DictString()
+			: code_(0)
+		{
+		}
+
+		DictString(const char * data, size_t size)
+			: code_(dictionary().code(StringRef(data, size)))
+		{
+		}
+
+		DictString(const std::string & str)
+			: code_(dictionary().code(StringRef(str)))
+		{
+		}
+
+		/// The string with a code given by code().
+		static DictString fromCode(boost::uint32_t code)
+		{
+			DictString value;
+			value.code_ = code;
+			return value;
+		}
+
+		boost::uint32_t code() const
+		{
+			return code_;
+		}
+
+		/// The string, which stays valid for as long as the process.
+		StringRef ref() const
+		{
+			return dictionary().value(code_);
+		}
+
+		std::string str() const
+		{
+			return ref().str();
+		}
+
+		bool operator==(const DictString & other) const
+		{
+			return code_ == other.code_;
+		}
+
+		bool operator!=(const DictString & other) const
+		{
+			return code_ != other.code_;
+		}
+
+		bool operator<(const DictString & other) const
+		{
+			return code_ != other.code_ && ref() < other.ref();
+		}
+
+		bool operator<=(const DictString & other) const
+		{
+			return !(other < *this);
+		}
+
+		bool operator>(const DictString & other) const
+		{
+			return other < *this;
+		}
+
+		bool operator>=(const DictString & other) const
+		{
+			return !(*this < other);
+		}
+	};
+
+	/// For boost::hash.
+	inline size_t hash_value(const DictString & value)
+	{
+		return value.code();
+	}
+
+	template<>
+	struct ValueStorage<DictString>
+	{
+		enum { external = false, encoded = true };
+
+		static void own(DictString &, StringArena &)
+		{
+		}
+
+		static void stash(const DictString &, std::vector<char> &)
+		{
+		}
+
+		static size_t attach(DictString &, const char *)
+		{
+			return 0;
+		}
+	};
+}
+
+#endif
\ No newline at end of file
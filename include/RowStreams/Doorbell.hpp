@@ -0,0 +1,67 @@
+#ifndef ROWSTREAMS_DOORBELL_HPP
+#define ROWSTREAMS_DOORBELL_HPP
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+
+namespace RowStreams
+{
+	/// Lets a thread wait for something another thread does without taking
+	/// a lock, like pushing into a lock free queue. Waiters spin for a while
+	/// and then sleep until ring() is called; ringing only costs a fence and
+	/// a load while nobody sleeps.
+	class Doorbell
+	{
+		enum { SPINS = 64 };
+
+		boost::mutex mutex_;
+		boost::condition_variable wake_;
+		boost::atomic<int> sleepers_;
+
+		Doorbell(const Doorbell &);
+		Doorbell & operator=(const Doorbell &);
+
+	public:
+		Doorbell()
+			: sleepers_(0)
+		{
+		}
+
+		/// Returns once ready() is true. ready() has to turn true only
+		/// through something followed by a call to ring().
+		template<class Ready>
+		void wait(Ready ready)
+		{
+			for(int spin = 0; spin != SPINS; ++spin)
+			{
+				if(ready())
+					return;
+				boost::this_thread::yield();
+			}
+
+			boost::mutex::scoped_lock lock(mutex_);
+			sleepers_.fetch_add(1);
+			// Pairs with the fence in ring(): either the ringer sees us
+			// sleeping, or we see what it did before ringing.
+			boost::atomic_thread_fence(boost::memory_order_seq_cst);
+			while(!ready())
+				wake_.wait(lock);
+			sleepers_.fetch_sub(1);
+		}
+
+		/// Wakes up the waiters, if any, to check their condition again.
+		void ring()
+		{
+			boost::atomic_thread_fence(boost::memory_order_seq_cst);
+			if(sleepers_.load(boost::memory_order_relaxed))
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				wake_.notify_all();
+			}
+		}
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,155 @@
+#ifndef ROWSTREAMS_FILTER_HPP
+#define ROWSTREAMS_FILTER_HPP
+
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/Functions.hpp"
+#include "RowStreams/RowBatch.hpp"
+#include "RowStreams/RowPredicate.hpp"
+#include "RowStreams/PipelinePlan.hpp"
+#include "RowStreams/StageTraits.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+
+namespace RowStreams
+{
+	/// Drops the rows for which a boolean function is false or null. See
+	/// Functions.hpp.
+	/// The predicate is offered to the source through the plan; if the source
+	/// takes it, rows are checked as they are parsed and the filter has
+	/// nothing left to do.
+	template<class Source, class Oper>
+	class Filter
+	{
+		/// Row source. We don't own it, so no deletes.
+		Source * source_;
+		FunctionPredicate<Oper> predicate_;
+		RowDef rowDef_;
+
+	public:
+		Filter(const Function<bool, Oper> & function)
+			: source_(0), predicate_(function)
+		{
+		}
+
+		void init()
+		{
+			source_->init();
+			rowDef_ = source_->rowDef();
+			predicate_.init(rowDef_);
+		}
+
+		bool plan(PipelinePlan & plan)
+		{
+			if(!plan.layout)
+				plan.layout = &rowDef_;
+			std::vector<std::string> columns;
+			predicate_.columns(columns);
+			plan.use(columns);
+			plan.predicates.push_back(&predicate_);
+			const bool planned = source_->plan(plan);
+			plan.predicates.erase(std::remove(plan.predicates.begin(), plan.predicates.end(), &predicate_),
+				plan.predicates.end());
+			return planned;
+		}
+
+		Row * next()
+		{
+			for(;;)
+			{
+				Row * row = source_->next();
+				if(!row || predicate_.pushed() || predicate_.matches(*row))
+					return row;
+				source_->release(row);
+			}
+		}
+
+		void release(Row * row)
+		{
+			source_->release(row);
+		}
+
+		/// Narrows down the selection of the batch. The batch may end up with
+		/// no row selected, but it is still handed on, so that replicas of the
+		/// filter take a single batch from the source per call.
+		bool nextBatch(RowBatch & batch)
+		{
+			if(!source_->nextBatch(batch))
+				return false;
+			if(predicate_.pushed())
+				return true;
+
+			RowBatch::Index * selection = batch.selection();
+			size_t selected = 0;
+			for(size_t index = 0; index != batch.selected(); ++index)
+			{
+				selection[selected] = selection[index];
+				selected += predicate_.matches(*batch.row(selection[index]));
+			}
+			batch.selected(selected);
+			return true;
+		}
+
+		void releaseBatch(RowBatch & batch)
+		{
+			source_->releaseBatch(batch);
+		}
+
+		void stop()
+		{
+			source_->stop();
+		}
+
+		const RowDef & rowDef()
+		{
+			return rowDef_;
+		}
+
+		void source(Source * source)
+		{
+			source_ = source;
+		}
+	};
+
+	template<class Source, class Oper>
+	struct StageTraits<Filter<Source, Oper> >
+	{
+		enum { replicable = true };
+	};
+
+	/// Bridge class used to allow the pipeline construction syntax.
+	/// @see Pipeline.hpp
+	template<class Oper>
+	class FilterPrototype
+	{
+		Function<bool, Oper> function_;
+	public:
+
+		template<class Source>
+		struct ForSource
+		{
+			typedef Filter<Source, Oper> Type;
+		};
+
+		FilterPrototype(const Function<bool, Oper> & function)
+			: function_(function)
+		{
+		}
+
+		template<class Source>
+		Filter<Source, Oper> create() const
+		{
+			return Filter<Source, Oper>(function_);
+		}
+	};
+
+	/// Keeps the rows for which a boolean function is true:
+	/// read_text_file(...) >> filter(column<double>("b") > value(2.0)) >> write_text_file(...)
+	template<class Oper>
+	FilterPrototype<Oper> filter(const Function<bool, Oper> & func)
+	{
+		return FilterPrototype<Oper>(func);
+	}
+}
+
+#endif
\ No newline at end of file
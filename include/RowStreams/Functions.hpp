@@ -3,7 +3,16 @@
 
 
 #include "RowStreams/Row.hpp"
+#include "RowStreams/ColumnBatch.hpp"
+#include "RowStreams/ZoneMap.hpp"
+#include "RowStreams/StringRef.hpp"
+#include "RowStreams/DateTime.hpp"
+#include "RowStreams/ValueParser.hpp"
 #include <functional>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
 
 namespace RowStreams
 {
@@ -28,11 +37,298 @@ namespace RowStreams
 			return BinOp()(val1, val2);
 		}
 
+		/// Null when either operand is, without branching on either.
+		bool null(const Row & row) const
+		{
+			return oper1_.null(row) | oper2_.null(row);
+		}
+
+		/// The first operand goes into out, and the second into an array of
+		/// its own, then both are combined in a loop the compiler vectorizes.
+		const DataType * evaluate(const ColumnBatch & batch, DataType * out, ColumnBatch::Word * valid) const
+		{
+			DataType right[ColumnBatch::CAPACITY];
+			ColumnBatch::Word rightValid[ColumnBatch::WORDS];
+			const DataType * values1 = oper1_.evaluate(batch, out, valid);
+			const DataType * values2 = oper2_.evaluate(batch, right, rightValid);
+			const BinOp op = BinOp();
+			for(size_t row = 0, size = batch.size(); row != size; ++row)
+				out[row] = op(values1[row], values2[row]);
+			for(size_t word = 0; word != ColumnBatch::WORDS; ++word)
+				valid[word] &= rightValid[word];
+			return out;
+		}
+
+		ValueRange<DataType> range(const ZoneMap & zones) const
+		{
+			const ValueRange<DataType> range1 = RangeAdapter<Oper1, DataType>::range(oper1_, zones);
+			const ValueRange<DataType> range2 = RangeAdapter<Oper2, DataType>::range(oper2_, zones);
+			if(!range1.known || !range2.known)
+				return ValueRange<DataType>();
+			return OperatorRange<BinOp>::range(range1, range2);
+		}
+
+		void init(const RowDef & rowDef)
+		{
+			oper1_.init(rowDef);
+			oper2_.init(rowDef);
+		}
+
+		void columns(std::vector<std::string> & names) const
+		{
+			oper1_.columns(names);
+			oper2_.columns(names);
+		}
+	};
+
+	/// The comparison of two operations, where Compare can be a functor
+	/// compatible with the comparisons in <functional>.
+	template<class DataType, class Oper1, class Oper2, class Compare>
+	struct ComparisonOperator
+	{
+	public:
+		Oper1 oper1_;
+		Oper2 oper2_;
+
+		ComparisonOperator(const Oper1 & oper1, const Oper2 & oper2)
+			: oper1_(oper1), oper2_(oper2)
+		{
+		}
+
+		bool operator()(const Row & row) const
+		{
+			DataType val1 = oper1_(row);
+			DataType val2 = oper2_(row);
+			return Compare()(val1, val2);
+		}
+
+		bool null(const Row & row) const
+		{
+			return oper1_.null(row) | oper2_.null(row);
+		}
+
+		const bool * evaluate(const ColumnBatch & batch, bool * out, ColumnBatch::Word * valid) const
+		{
+			DataType left[ColumnBatch::CAPACITY];
+			DataType right[ColumnBatch::CAPACITY];
+			ColumnBatch::Word rightValid[ColumnBatch::WORDS];
+			const DataType * values1 = oper1_.evaluate(batch, left, valid);
+			const DataType * values2 = oper2_.evaluate(batch, right, rightValid);
+			const Compare compare = Compare();
+			for(size_t row = 0, size = batch.size(); row != size; ++row)
+				out[row] = compare(values1[row], values2[row]);
+			for(size_t word = 0; word != ColumnBatch::WORDS; ++word)
+				valid[word] &= rightValid[word];
+			return out;
+		}
+
+		ValueRange<bool> range(const ZoneMap & zones) const
+		{
+			const ValueRange<DataType> range1 = RangeAdapter<Oper1, DataType>::range(oper1_, zones);
+			const ValueRange<DataType> range2 = RangeAdapter<Oper2, DataType>::range(oper2_, zones);
+			if(!range1.known || !range2.known)
+				return ValueRange<bool>(false, true);
+			return CompareRange<Compare>::range(range1, range2);
+		}
+
+		void init(const RowDef & rowDef)
+		{
+			oper1_.init(rowDef);
+			oper2_.init(rowDef);
+		}
+
+		void columns(std::vector<std::string> & names) const
+		{
+			oper1_.columns(names);
+			oper2_.columns(names);
+		}
+	};
+
+	/// Applies Apply, a functor taking a value of type ArgType, to the value
+	/// of an operation. Apply tells the range of its result from the range
+	/// of its argument, which is only known when it is.
+	template<class DataType, class ArgType, class Oper, class Apply>
+	struct UnaryOperator
+	{
+	public:
+		Oper oper_;
+		Apply apply_;
+
+		UnaryOperator(const Oper & oper, const Apply & apply)
+			: oper_(oper), apply_(apply)
+		{
+		}
+
+		DataType operator()(const Row & row) const
+		{
+			return apply_(oper_(row));
+		}
+
+		bool null(const Row & row) const
+		{
+			return oper_.null(row);
+		}
+
+		const DataType * evaluate(const ColumnBatch & batch, DataType * out, ColumnBatch::Word * valid) const
+		{
+			ArgType args[ColumnBatch::CAPACITY];
+			const ArgType * values = oper_.evaluate(batch, args, valid);
+			for(size_t row = 0, size = batch.size(); row != size; ++row)
+				out[row] = apply_(values[row]);
+			return out;
+		}
+
+		ValueRange<DataType> range(const ZoneMap & zones) const
+		{
+			const ValueRange<ArgType> range = RangeAdapter<Oper, ArgType>::range(oper_, zones);
+			return range.known ? apply_.range(range) : ValueRange<DataType>();
+		}
+
+		void init(const RowDef & rowDef)
+		{
+			oper_.init(rowDef);
+		}
+
+		void columns(std::vector<std::string> & names) const
+		{
+			oper_.columns(names);
+		}
+	};
+
+	/// Applies Apply, a functor taking values of types Arg1 and Arg2, to the
+	/// values of two operations. Nothing is known of its range.
+	template<class DataType, class Arg1, class Oper1, class Arg2, class Oper2, class Apply>
+	struct ApplyOperator
+	{
+	public:
+		Oper1 oper1_;
+		Oper2 oper2_;
+
+		ApplyOperator(const Oper1 & oper1, const Oper2 & oper2)
+			: oper1_(oper1), oper2_(oper2)
+		{
+		}
+
+		DataType operator()(const Row & row) const
+		{
+			return Apply()(oper1_(row), oper2_(row));
+		}
+
+		bool null(const Row & row) const
+		{
+			return oper1_.null(row) | oper2_.null(row);
+		}
+
+		const DataType * evaluate(const ColumnBatch & batch, DataType * out, ColumnBatch::Word * valid) const
+		{
+			Arg1 left[ColumnBatch::CAPACITY];
+			Arg2 right[ColumnBatch::CAPACITY];
+			ColumnBatch::Word rightValid[ColumnBatch::WORDS];
+			const Arg1 * values1 = oper1_.evaluate(batch, left, valid);
+			const Arg2 * values2 = oper2_.evaluate(batch, right, rightValid);
+			const Apply apply = Apply();
+			for(size_t row = 0, size = batch.size(); row != size; ++row)
+				out[row] = apply(values1[row], values2[row]);
+			for(size_t word = 0; word != ColumnBatch::WORDS; ++word)
+				valid[word] &= rightValid[word];
+			return out;
+		}
+
+		void init(const RowDef & rowDef)
+		{
+			oper1_.init(rowDef);
+			oper2_.init(rowDef);
+		}
+
+		void columns(std::vector<std::string> & names) const
+		{
+			oper1_.columns(names);
+			oper2_.columns(names);
+		}
+	};
+
+	/// The conjunction (IsAnd) or disjunction of two boolean operations. The
+	/// second one is only evaluated when the first does not decide the result.
+	/// Nulls follow SQL: an operand that is false in a conjunction, or true in
+	/// a disjunction, decides the result even when the other one is null.
+	template<class Oper1, class Oper2, bool IsAnd>
+	struct LogicalOperator
+	{
+	public:
+		Oper1 oper1_;
+		Oper2 oper2_;
+
+		LogicalOperator(const Oper1 & oper1, const Oper2 & oper2)
+			: oper1_(oper1), oper2_(oper2)
+		{
+		}
+
+		bool operator()(const Row & row) const
+		{
+			return IsAnd ? oper1_(row) && oper2_(row) : oper1_(row) || oper2_(row);
+		}
+
+		bool null(const Row & row) const
+		{
+			const bool null1 = oper1_.null(row), null2 = oper2_.null(row);
+			const bool decides1 = !null1 && oper1_(row) != IsAnd;
+			const bool decides2 = !null2 && oper2_(row) != IsAnd;
+			return (null1 || null2) && !decides1 && !decides2;
+		}
+
+		/// Both operands are evaluated over the whole batch, since skipping
+		/// rows would cost more than it saves.
+		const bool * evaluate(const ColumnBatch & batch, bool * out, ColumnBatch::Word * valid) const
+		{
+			typedef ColumnBatch::Word Word;
+			bool right[ColumnBatch::CAPACITY];
+			Word rightValid[ColumnBatch::WORDS];
+			const bool * values1 = oper1_.evaluate(batch, out, valid);
+			const bool * values2 = oper2_.evaluate(batch, right, rightValid);
+			const size_t size = batch.size();
+
+			// The rows where each operand alone decides the result, taken
+			// before out, which values1 may point to, is overwritten.
+			Word decides1[ColumnBatch::WORDS] = {}, decides2[ColumnBatch::WORDS] = {};
+			for(size_t row = 0; row != size; ++row)
+			{
+				decides1[row / ColumnBatch::WORD_BITS] |= Word(values1[row] != IsAnd) << (row % ColumnBatch::WORD_BITS);
+				decides2[row / ColumnBatch::WORD_BITS] |= Word(values2[row] != IsAnd) << (row % ColumnBatch::WORD_BITS);
+			}
+
+			for(size_t row = 0; row != size; ++row)
+				out[row] = IsAnd ? values1[row] & values2[row] : values1[row] | values2[row];
+			for(size_t word = 0; word != ColumnBatch::WORDS; ++word)
+			{
+				const Word valid1 = valid[word], valid2 = rightValid[word];
+				valid[word] = (valid1 & valid2) | (valid1 & decides1[word]) | (valid2 & decides2[word]);
+			}
+			return out;
+		}
+
+		ValueRange<bool> range(const ZoneMap & zones) const
+		{
+			ValueRange<bool> range1 = RangeAdapter<Oper1, bool>::range(oper1_, zones);
+			ValueRange<bool> range2 = RangeAdapter<Oper2, bool>::range(oper2_, zones);
+			if(!range1.known)
+				range1 = ValueRange<bool>(false, true);
+			if(!range2.known)
+				range2 = ValueRange<bool>(false, true);
+			return IsAnd ? ValueRange<bool>(range1.min && range2.min, range1.max && range2.max)
+				: ValueRange<bool>(range1.min || range2.min, range1.max || range2.max);
+		}
+
 		void init(const RowDef & rowDef)
 		{
 			oper1_.init(rowDef);
 			oper2_.init(rowDef);
 		}
+
+		void columns(std::vector<std::string> & names) const
+		{
+			oper1_.columns(names);
+			oper2_.columns(names);
+		}
 	};
 
 	/// A function that produces a value given an input row.
@@ -56,11 +352,42 @@ namespace RowStreams
 			return operator_(row);
 		}
 
+		/// Tells whether the value of the function is null, which it is when
+		/// any column it reads is. Values are computed for null columns all
+		/// the same, from whatever their bytes hold.
+		bool null(const Row & row) const
+		{
+			return operator_.null(row);
+		}
+
+		/// Evaluates the function over the size() rows of a column batch,
+		/// which has every column the function reads laid out. Returns the
+		/// values, in out or in an array of the batch, and sets the first
+		/// ColumnBatch::WORDS words of valid to a bit per row that is zero
+		/// where the value is null. Every operator works on whole arrays, so
+		/// the loops compile to vector code.
+		const DataType * evaluate(const ColumnBatch & batch, DataType * out, ColumnBatch::Word * valid) const
+		{
+			return operator_.evaluate(batch, out, valid);
+		}
+
+		/// Tells what values the function may take over a block of rows.
+		ValueRange<DataType> range(const ZoneMap & zones) const
+		{
+			return RangeAdapter<Operator, DataType>::range(operator_, zones);
+		}
+
 		void init(const RowDef & rowDef)
 		{
 			operator_.init(rowDef);
 		}
 
+		/// Appends the names of the columns the function reads to names.
+		void columns(std::vector<std::string> & names) const
+		{
+			operator_.columns(names);
+		}
+
 #define FUNCTION_DEF_BIN_OP(op, std_op)\
 		template<class Oper2> \
 		Function<DataType, BinaryOperator<DataType, Operator, Oper2, std:: std_op <DataType> > > \
@@ -74,6 +401,35 @@ namespace RowStreams
 		FUNCTION_DEF_BIN_OP(-, minus)
 		FUNCTION_DEF_BIN_OP(*, multiplies)
 
+#define FUNCTION_DEF_CMP_OP(op, std_op)\
+		template<class Oper2> \
+		Function<bool, ComparisonOperator<DataType, Operator, Oper2, std:: std_op <DataType> > > \
+			operator op (const Function<DataType, Oper2> & other) \
+		{ \
+			typedef ComparisonOperator<DataType, Operator, Oper2, std:: std_op <DataType> > CmpOpType;\
+			return Function<bool, CmpOpType >( CmpOpType(operator_, other.operator_ ) );\
+		}
+
+		FUNCTION_DEF_CMP_OP(<, less)
+		FUNCTION_DEF_CMP_OP(<=, less_equal)
+		FUNCTION_DEF_CMP_OP(>, greater)
+		FUNCTION_DEF_CMP_OP(>=, greater_equal)
+		FUNCTION_DEF_CMP_OP(==, equal_to)
+		FUNCTION_DEF_CMP_OP(!=, not_equal_to)
+
+#define FUNCTION_DEF_LOGIC_OP(op, is_and)\
+		template<class Oper2> \
+		Function<bool, LogicalOperator<Operator, Oper2, is_and> > \
+			operator op (const Function<bool, Oper2> & other) \
+		{ \
+			typedef LogicalOperator<Operator, Oper2, is_and> LogicOpType;\
+			return Function<bool, LogicOpType >( LogicOpType(operator_, other.operator_ ) );\
+		}
+
+		// Only for boolean functions, like the comparisons above.
+		FUNCTION_DEF_LOGIC_OP(&&, true)
+		FUNCTION_DEF_LOGIC_OP(||, false)
+
 	};
 
 	namespace Functions
@@ -97,11 +453,34 @@ namespace RowStreams
 				return row.get<ColumnType>(index_, offset_);
 			}
 
+			bool null(const Row & row) const
+			{
+				return row.isNull(index_);
+			}
+
+			/// The values are those of the batch, which are not copied.
+			const ColumnType * evaluate(const ColumnBatch & batch, ColumnType *, ColumnBatch::Word * valid) const
+			{
+				std::copy(batch.valid(index_), batch.valid(index_) + ColumnBatch::WORDS, valid);
+				return batch.values<ColumnType>(index_);
+			}
+
+			ValueRange<ColumnType> range(const ZoneMap & zones) const
+			{
+				const ColumnZone * zone = zones.column(index_);
+				return zone ? ValueZone<ColumnType>::range(*zone) : ValueRange<ColumnType>();
+			}
+
 			void init(const RowDef & rowDef)
 			{
 				index_ = rowDef.index(name_);
 				offset_ = rowDef.offset(name_);
 			}
+
+			void columns(std::vector<std::string> & names) const
+			{
+				names.push_back(name_);
+			}
 		};
 
 		template<class ColumnType>
@@ -129,9 +508,30 @@ namespace RowStreams
 				return value_;
 			}
 
+			bool null(const Row &) const
+			{
+				return false;
+			}
+
+			const T * evaluate(const ColumnBatch & batch, T * out, ColumnBatch::Word * valid) const
+			{
+				std::fill(out, out + batch.size(), value_);
+				std::fill(valid, valid + ColumnBatch::WORDS, ~ColumnBatch::Word(0));
+				return out;
+			}
+
+			ValueRange<T> range(const ZoneMap &) const
+			{
+				return ValueRange<T>(value_, value_);
+			}
+
 			void init(const RowDef & rowDef)
 			{
 			}
+
+			void columns(std::vector<std::string> &) const
+			{
+			}
 		};
 
 		template<class ValueType>
@@ -140,6 +540,232 @@ namespace RowStreams
 			return Function<ValueType, Value<ValueType> >(Value<ValueType>(value));
 		}
 
+		/// A literal string keeps its own copy of the bytes, which the value
+		/// it returns points to.
+		template<>
+		class Value<StringRef>
+		{
+			std::string text_;
+			StringRef value_;
+		public:
+			Value(const std::string & text)
+				: text_(text), value_(text_)
+			{
+			}
+
+			Value(const Value & other)
+				: text_(other.text_), value_(text_)
+			{
+			}
+
+			Value & operator=(const Value & other)
+			{
+				text_ = other.text_;
+				value_ = StringRef(text_);
+				return *this;
+			}
+
+			StringRef operator()(const Row &) const
+			{
+				return value_;
+			}
+
+			bool null(const Row &) const
+			{
+				return false;
+			}
+
+			const StringRef * evaluate(const ColumnBatch & batch, StringRef * out, ColumnBatch::Word * valid) const
+			{
+				std::fill(out, out + batch.size(), value_);
+				std::fill(valid, valid + ColumnBatch::WORDS, ~ColumnBatch::Word(0));
+				return out;
+			}
+
+			ValueRange<StringRef> range(const ZoneMap &) const
+			{
+				return ValueRange<StringRef>(value_, value_);
+			}
+
+			void init(const RowDef &)
+			{
+			}
+
+			void columns(std::vector<std::string> &) const
+			{
+			}
+		};
+
+		/// String literals are compared with string columns:
+		/// column<StringRef>("name") == value("Smith")
+		Function<StringRef, Value<StringRef> > value(const char * text)
+		{
+			return Function<StringRef, Value<StringRef> >(Value<StringRef>(text));
+		}
+
+		Function<StringRef, Value<StringRef> > value(const std::string & text)
+		{
+			return Function<StringRef, Value<StringRef> >(Value<StringRef>(text));
+		}
+
+		namespace DateTimeDetail
+		{
+			/// Start of the unit a date or timestamp is in. Never decreases,
+			/// so the range of its result is that of its argument truncated.
+			template<class T>
+			class Truncate
+			{
+				TimeUnit unit_;
+			public:
+				Truncate(TimeUnit unit)
+					: unit_(unit)
+				{
+				}
+
+				T operator()(const T & value) const
+				{
+					return value.truncate(unit_);
+				}
+
+				ValueRange<T> range(const ValueRange<T> & range) const
+				{
+					return ValueRange<T>((*this)(range.min), (*this)(range.max));
+				}
+			};
+
+			struct ToDate
+			{
+				Date operator()(const Timestamp & value) const
+				{
+					return value.date();
+				}
+
+				ValueRange<Date> range(const ValueRange<Timestamp> & range) const
+				{
+					return ValueRange<Date>(range.min.date(), range.max.date());
+				}
+			};
+
+			struct ToTimestamp
+			{
+				Timestamp operator()(const Date & value) const
+				{
+					return Timestamp::fromDate(value);
+				}
+
+				ValueRange<Timestamp> range(const ValueRange<Date> & range) const
+				{
+					return ValueRange<Timestamp>(Timestamp::fromDate(range.min), Timestamp::fromDate(range.max));
+				}
+			};
+
+			template<class T>
+			struct AddDays
+			{
+				T operator()(const T & value, int days) const
+				{
+					return value.addDays(days);
+				}
+			};
+
+			template<class T>
+			struct AddMonths
+			{
+				T operator()(const T & value, int months) const
+				{
+					return value.addMonths(months);
+				}
+			};
+
+			struct DaysBetween
+			{
+				int operator()(const Date & from, const Date & to) const
+				{
+					return int(to.days() - from.days());
+				}
+			};
+
+			template<class T>
+			T parse(const char * text)
+			{
+				T value;
+				if(ValueParser<T>().parse(text, ::strlen(text), value) != PARSE_OK)
+					throw std::runtime_error(std::string("Invalid date or time ")+text);
+				return value;
+			}
+		}
+
+		/// A literal date, as YYYY-MM-DD:
+		/// column<Date>("shipped") >= date("2024-01-01")
+		Function<Date, Value<Date> > date(const char * text)
+		{
+			return Function<Date, Value<Date> >(Value<Date>(DateTimeDetail::parse<Date>(text)));
+		}
+
+		/// A literal timestamp, in ISO 8601.
+		Function<Timestamp, Value<Timestamp> > timestamp(const char * text)
+		{
+			return Function<Timestamp, Value<Timestamp> >(Value<Timestamp>(DateTimeDetail::parse<Timestamp>(text)));
+		}
+
+		/// The start of the second, minute, hour, day, week, month or year a
+		/// date or timestamp is in:
+		/// set_column("hour", truncate(column<Timestamp>("t"), TIME_HOUR))
+		template<class T, class Oper>
+		Function<T, UnaryOperator<T, T, Oper, DateTimeDetail::Truncate<T> > >
+			truncate(const Function<T, Oper> & func, TimeUnit unit)
+		{
+			typedef UnaryOperator<T, T, Oper, DateTimeDetail::Truncate<T> > OperType;
+			return Function<T, OperType>(OperType(func.operator_, DateTimeDetail::Truncate<T>(unit)));
+		}
+
+		/// The date a timestamp falls on, in UTC.
+		template<class Oper>
+		Function<Date, UnaryOperator<Date, Timestamp, Oper, DateTimeDetail::ToDate> >
+			to_date(const Function<Timestamp, Oper> & func)
+		{
+			typedef UnaryOperator<Date, Timestamp, Oper, DateTimeDetail::ToDate> OperType;
+			return Function<Date, OperType>(OperType(func.operator_, DateTimeDetail::ToDate()));
+		}
+
+		/// Midnight UTC at the start of a date.
+		template<class Oper>
+		Function<Timestamp, UnaryOperator<Timestamp, Date, Oper, DateTimeDetail::ToTimestamp> >
+			to_timestamp(const Function<Date, Oper> & func)
+		{
+			typedef UnaryOperator<Timestamp, Date, Oper, DateTimeDetail::ToTimestamp> OperType;
+			return Function<Timestamp, OperType>(OperType(func.operator_, DateTimeDetail::ToTimestamp()));
+		}
+
+		/// A date or timestamp moved by a number of days:
+		/// add_days(column<Date>("ordered"), value(30))
+		template<class T, class Oper1, class Oper2>
+		Function<T, ApplyOperator<T, T, Oper1, int, Oper2, DateTimeDetail::AddDays<T> > >
+			add_days(const Function<T, Oper1> & func, const Function<int, Oper2> & days)
+		{
+			typedef ApplyOperator<T, T, Oper1, int, Oper2, DateTimeDetail::AddDays<T> > OperType;
+			return Function<T, OperType>(OperType(func.operator_, days.operator_));
+		}
+
+		/// A date or timestamp moved by a number of months, see
+		/// Date::addMonths().
+		template<class T, class Oper1, class Oper2>
+		Function<T, ApplyOperator<T, T, Oper1, int, Oper2, DateTimeDetail::AddMonths<T> > >
+			add_months(const Function<T, Oper1> & func, const Function<int, Oper2> & months)
+		{
+			typedef ApplyOperator<T, T, Oper1, int, Oper2, DateTimeDetail::AddMonths<T> > OperType;
+			return Function<T, OperType>(OperType(func.operator_, months.operator_));
+		}
+
+		/// Number of days from one date to another, negative if the first one
+		/// is later.
+		template<class Oper1, class Oper2>
+		Function<int, ApplyOperator<int, Date, Oper1, Date, Oper2, DateTimeDetail::DaysBetween> >
+			days_between(const Function<Date, Oper1> & from, const Function<Date, Oper2> & to)
+		{
+			typedef ApplyOperator<int, Date, Oper1, Date, Oper2, DateTimeDetail::DaysBetween> OperType;
+			return Function<int, OperType>(OperType(from.operator_, to.operator_));
+		}
 	}
 }
 
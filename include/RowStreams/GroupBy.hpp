@@ -0,0 +1,541 @@
+#ifndef ROWSTREAMS_GROUP_BY_HPP
+#define ROWSTREAMS_GROUP_BY_HPP
+
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/RowPool.hpp"
+#include "RowStreams/RowBatch.hpp"
+#include "RowStreams/PipelinePlan.hpp"
+#include "RowStreams/Aggregates.hpp"
+#include "RowStreams/KeyLayout.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <boost/cstdint.hpp>
+
+namespace RowStreams
+{
+	/// Emits one row per group of rows with equal key columns, made of the
+	/// key columns followed by the results of the aggregates. The whole input
+	/// is read before the first group comes out, in no particular order.
+	///
+	/// Groups are kept in an open addressing hash table with linear probing.
+	/// Every slot holds the hash, the packed key (see KeyLayout) and the state
+	/// of every aggregate inline, and a separate array of 32 bit tags is all
+	/// that is looked at while probing past other groups. When the table
+	/// would outgrow the memory limit, all of its groups are written to one
+	/// of 16 temporary files picked by the top bits of their hash, and the
+	/// table starts over empty. Each file is then read back on its own and
+	/// merged, and written out again with the next bits of the hash if it
+	/// still does not fit.
+	template<class Source>
+	class GroupBy
+	{
+		enum
+		{
+			PARTITION_BITS = 4,
+			PARTITIONS = 1 << PARTITION_BITS,
+			/// Past this many rounds of spilling, the table grows beyond the
+			/// memory limit instead, as the hash bits would run out.
+			MAX_LEVEL = 6,
+			MIN_SLOTS = 1024,
+			HEADER = sizeof(boost::uint64_t)
+		};
+
+		/// Groups written to a temporary file, to be merged later.
+		struct Partition
+		{
+			std::FILE * file;
+			size_t level;
+		};
+
+		typedef std::vector<Aggregate*> AggregateList;
+
+		/// Row source. We don't own it, so no deletes.
+		Source * source_;
+		std::vector<std::string> keys_;
+		AggregateList aggregates_;
+		size_t memoryLimit_;
+
+		RowDef inputDef_;
+		RowDef rowDef_;
+		KeyLayout keyLayout_;
+		/// Place of the state of every aggregate in a slot.
+		std::vector<size_t> stateOffsets_;
+		size_t slotSize_;
+		RowPool pool_;
+
+		std::vector<boost::uint32_t> tags_;
+		std::vector<char> slots_;
+		size_t mask_;
+		size_t size_;
+		/// Packed keys and hashes of the rows of a batch.
+		std::vector<char> packed_;
+		std::vector<boost::uint64_t> hashes_;
+
+		/// Round of spilling the groups in the table belong to.
+		size_t level_;
+		/// Files being spilled to in this round, if any.
+		std::vector<std::FILE*> spills_;
+		std::vector<Partition> partitions_;
+
+		bool built_;
+		/// Next slot to hand out a group from.
+		size_t nextSlot_;
+
+		GroupBy & operator=(const GroupBy &);
+
+		static boost::uint32_t tag(boost::uint64_t hash)
+		{
+			return boost::uint32_t(hash >> 32) | 1;
+		}
+
+		char * slot(size_t index)
+		{
+			return &slots_[index * slotSize_];
+		}
+
+		size_t bytes(size_t slots) const
+		{
+			return slots * (slotSize_ + sizeof(boost::uint32_t));
+		}
+
+		void resize(size_t slots)
+		{
+			tags_.assign(slots, 0);
+			slots_.resize(slots * slotSize_);
+			mask_ = slots - 1;
+			size_ = 0;
+		}
+
+		/// Probes for a key. Returns the slot holding it, or the empty slot
+		/// it would go to.
+		size_t probe(boost::uint64_t hash, const char * key)
+		{
+			const boost::uint32_t wanted = tag(hash);
+			size_t index = size_t(hash) & mask_;
+			while(tags_[index])
+			{
+				if(tags_[index] == wanted && ::memcmp(slot(index) + HEADER, key, keyLayout_.size()) == 0)
+					break;
+				index = (index + 1) & mask_;
+			}
+			return index;
+		}
+
+		/// Doubles the table, or spills it if that would take too much memory.
+		void makeRoom()
+		{
+			if(bytes(2 * tags_.size()) > memoryLimit_ && level_ < MAX_LEVEL)
+			{
+				spill();
+				return;
+			}
+
+			std::vector<boost::uint32_t> tags(2 * tags_.size(), 0);
+			std::vector<char> slots(tags.size() * slotSize_);
+			tags.swap(tags_);
+			slots.swap(slots_);
+			mask_ = tags_.size() - 1;
+
+			for(size_t old = 0; old != tags.size(); ++old)
+			{
+				if(!tags[old])
+					continue;
+				const char * from = &slots[old * slotSize_];
+				boost::uint64_t hash;
+				::memcpy(&hash, from, HEADER);
+				size_t index = size_t(hash) & mask_;
+				while(tags_[index])
+					index = (index + 1) & mask_;
+				tags_[index] = tags[old];
+				::memcpy(slot(index), from, slotSize_);
+			}
+		}
+
+		/// Finds the slot of a key, making one if it is new, whose aggregate
+		/// states are left to the caller.
+		/// Returns the slot and whether it is new.
+		char * insert(boost::uint64_t hash, const char * key, bool & created)
+		{
+			if(size_ * 4 >= tags_.size() * 3)
+				makeRoom();
+
+			const size_t index = probe(hash, key);
+			char * found = slot(index);
+			created = !tags_[index];
+			if(created)
+			{
+				tags_[index] = tag(hash);
+				::memcpy(found, &hash, HEADER);
+				::memcpy(found + HEADER, key, keyLayout_.size());
+				++size_;
+			}
+			return found;
+		}
+
+		/// Adds the selected rows of a batch to their groups. All keys are
+		/// hashed first, and the slots they start probing at are prefetched,
+		/// so that the cache misses of a batch overlap instead of stalling
+		/// one row at a time.
+		void add(const RowBatch & batch)
+		{
+			const size_t keySize = keyLayout_.size();
+			for(size_t index = 0; index != batch.selected(); ++index)
+			{
+				char * key = &packed_[index * keySize];
+				keyLayout_.pack(*batch.selectedRow(index), key);
+				hashes_[index] = KeyLayout::hash(key, keySize);
+				const size_t start = size_t(hashes_[index]) & mask_;
+				ROWSTREAMS_PREFETCH(&tags_[start]);
+				ROWSTREAMS_PREFETCH(slot(start));
+			}
+
+			for(size_t index = 0; index != batch.selected(); ++index)
+			{
+				bool created;
+				char * found = insert(hashes_[index], &packed_[index * keySize], created);
+				const Row & row = *batch.selectedRow(index);
+				for(size_t agg = 0; agg != aggregates_.size(); ++agg)
+				{
+					if(created)
+						aggregates_[agg]->init(found + stateOffsets_[agg]);
+					aggregates_[agg]->update(found + stateOffsets_[agg], row);
+				}
+			}
+		}
+
+		/// Merges a slot written to disk into the table.
+		void merge(const char * from)
+		{
+			boost::uint64_t hash;
+			::memcpy(&hash, from, HEADER);
+
+			bool created;
+			char * found = insert(hash, from + HEADER, created);
+			if(created)
+			{
+				::memcpy(found, from, slotSize_);
+				return;
+			}
+			for(size_t agg = 0; agg != aggregates_.size(); ++agg)
+				aggregates_[agg]->merge(found + stateOffsets_[agg], from + stateOffsets_[agg]);
+		}
+
+		/// Writes every group in the table to the files of the current round,
+		/// and empties the table.
+		void spill()
+		{
+			if(spills_.empty())
+			{
+				for(size_t part = 0; part != PARTITIONS; ++part)
+				{
+					std::FILE * file = std::tmpfile();
+					if(!file)
+						throw std::runtime_error("Failed to create a temporary file to spill groups to");
+					spills_.push_back(file);
+				}
+			}
+
+			const size_t shift = 64 - PARTITION_BITS * (level_ + 1);
+			for(size_t index = 0; index != tags_.size(); ++index)
+			{
+				if(!tags_[index])
+					continue;
+				const char * from = slot(index);
+				boost::uint64_t hash;
+				::memcpy(&hash, from, HEADER);
+				if(std::fwrite(from, slotSize_, 1, spills_[size_t(hash >> shift) & (PARTITIONS - 1)]) != 1)
+					throw std::runtime_error("Failed to spill groups to a temporary file");
+			}
+			std::fill(tags_.begin(), tags_.end(), 0);
+			size_ = 0;
+		}
+
+		/// Ends a round: if anything was spilled, so is the rest of the table,
+		/// and the files are queued to be merged. Returns whether the table
+		/// holds every group of the round.
+		bool endRound()
+		{
+			if(spills_.empty())
+				return true;
+
+			spill();
+			for(size_t part = 0; part != PARTITIONS; ++part)
+			{
+				std::FILE * file = spills_[part];
+				if(std::ftell(file) == 0)
+				{
+					std::fclose(file);
+					continue;
+				}
+				std::rewind(file);
+				Partition partition = { file, level_ + 1 };
+				partitions_.push_back(partition);
+			}
+			spills_.clear();
+			return false;
+		}
+
+		/// Reads back and merges a spilled file, in a round of its own.
+		bool load(const Partition & partition)
+		{
+			level_ = partition.level;
+			size_ = 0;
+			std::fill(tags_.begin(), tags_.end(), 0);
+
+			std::vector<char> buffer(slotSize_ * MIN_SLOTS);
+			size_t count;
+			while((count = std::fread(&buffer[0], slotSize_, MIN_SLOTS, partition.file)) != 0)
+			{
+				for(size_t index = 0; index != count; ++index)
+					merge(&buffer[index * slotSize_]);
+			}
+			const bool failed = std::ferror(partition.file) != 0;
+			std::fclose(partition.file);
+			if(failed)
+				throw std::runtime_error("Failed to read back spilled groups");
+			return endRound();
+		}
+
+		/// Reads the whole input.
+		void build()
+		{
+			built_ = true;
+			RowBatch batch;
+			while(source_->nextBatch(batch))
+			{
+				add(batch);
+				source_->releaseBatch(batch);
+			}
+			// If groups were spilled, the table is empty now and the files
+			// are merged one by one as the groups are handed out.
+			endRound();
+			nextSlot_ = 0;
+		}
+
+		/// Makes a row out of the next group, or returns 0 after the last.
+		Row * nextGroup()
+		{
+			if(!built_)
+				build();
+
+			for(;;)
+			{
+				while(nextSlot_ != tags_.size() && !tags_[nextSlot_])
+					++nextSlot_;
+				if(nextSlot_ != tags_.size())
+					break;
+
+				// Done with the table, on to the next spilled file whose
+				// groups all fit.
+				for(;;)
+				{
+					if(partitions_.empty())
+						return 0;
+					const Partition partition = partitions_.back();
+					partitions_.pop_back();
+					if(load(partition))
+						break;
+				}
+				nextSlot_ = 0;
+			}
+
+			const char * group = slot(nextSlot_++);
+			Row * row = pool_.acquire();
+			keyLayout_.unpack(group + HEADER, rowDef_, 0, *row);
+			for(size_t agg = 0; agg != aggregates_.size(); ++agg)
+				aggregates_[agg]->result(group + stateOffsets_[agg], *row);
+			return row;
+		}
+
+		void closeFiles()
+		{
+			for(std::vector<std::FILE*>::iterator file = spills_.begin(); file != spills_.end(); ++file)
+				std::fclose(*file);
+			spills_.clear();
+			for(typename std::vector<Partition>::iterator partition = partitions_.begin(); partition != partitions_.end(); ++partition)
+				std::fclose(partition->file);
+			partitions_.clear();
+		}
+
+	public:
+		GroupBy(const std::vector<std::string> & keys, const AggregateList & aggregates, size_t memoryLimit)
+			: source_(0), keys_(keys), memoryLimit_(memoryLimit), slotSize_(0), mask_(0), size_(0), level_(0),
+			built_(false), nextSlot_(0)
+		{
+			for(typename AggregateList::const_iterator agg = aggregates.begin(); agg != aggregates.end(); ++agg)
+				aggregates_.push_back((*agg)->clone());
+		}
+
+		GroupBy(const GroupBy & other)
+			: source_(0), keys_(other.keys_), memoryLimit_(other.memoryLimit_), slotSize_(0), mask_(0), size_(0),
+			level_(0), built_(false), nextSlot_(0)
+		{
+			for(typename AggregateList::const_iterator agg = other.aggregates_.begin(); agg != other.aggregates_.end(); ++agg)
+				aggregates_.push_back((*agg)->clone());
+		}
+
+		~GroupBy()
+		{
+			closeFiles();
+			for(typename AggregateList::iterator agg = aggregates_.begin(); agg != aggregates_.end(); ++agg)
+				delete *agg;
+		}
+
+		void source(Source * source)
+		{
+			source_ = source;
+		}
+
+		void init()
+		{
+			source_->init();
+			inputDef_ = source_->rowDef();
+
+			keyLayout_.init(inputDef_, keys_);
+			packed_.assign(RowBatch::CAPACITY * keyLayout_.size(), 0);
+			hashes_.resize(RowBatch::CAPACITY);
+
+			rowDef_ = RowDef();
+			for(std::vector<std::string>::const_iterator key = keys_.begin(); key != keys_.end(); ++key)
+				rowDef_.add(*inputDef_.columnDef(*key));
+			for(typename AggregateList::iterator agg = aggregates_.begin(); agg != aggregates_.end(); ++agg)
+				(*agg)->addColumn(rowDef_);
+
+			slotSize_ = HEADER + keyLayout_.size();
+			stateOffsets_.clear();
+			for(typename AggregateList::iterator agg = aggregates_.begin(); agg != aggregates_.end(); ++agg)
+			{
+				(*agg)->bind(inputDef_, rowDef_);
+				stateOffsets_.push_back(slotSize_);
+				slotSize_ += ((*agg)->stateSize() + 7) / 8 * 8;
+			}
+
+			resize(MIN_SLOTS);
+			pool_.rowDef(&rowDef_);
+		}
+
+		/// Rows are created with the planned layout. The source gets a plan
+		/// of its own, where only the key and aggregated columns are used.
+		bool plan(PipelinePlan & plan)
+		{
+			if(plan.layout)
+				pool_.rowDef(plan.layout);
+
+			PipelinePlan input;
+			input.layout = &inputDef_;
+			input.allColumns = false;
+			input.use(keys_);
+			for(typename AggregateList::iterator agg = aggregates_.begin(); agg != aggregates_.end(); ++agg)
+			{
+				std::vector<std::string> columns;
+				(*agg)->columns(columns);
+				input.use(columns);
+			}
+			source_->plan(input);
+			return true;
+		}
+
+		void stop()
+		{
+			source_->stop();
+		}
+
+		const RowDef & rowDef()
+		{
+			return rowDef_;
+		}
+
+		Row * next()
+		{
+			return nextGroup();
+		}
+
+		void release(Row * row)
+		{
+			pool_.release(row);
+		}
+
+		bool nextBatch(RowBatch & batch)
+		{
+			batch.clear();
+			while(!batch.full())
+			{
+				Row * row = nextGroup();
+				if(!row)
+					break;
+				batch.add(row);
+			}
+			return !batch.empty();
+		}
+
+		void releaseBatch(RowBatch & batch)
+		{
+			for(size_t index = 0; index != batch.size(); ++index)
+				pool_.release(batch.row(index));
+			batch.clear();
+		}
+	};
+
+	/// Bridge class used in the pipeline construction syntax.
+	class GroupByPrototype
+	{
+		std::vector<std::string> keys_;
+		std::vector<Aggregate*> aggregates_;
+		size_t memoryLimit_;
+
+		GroupByPrototype & operator=(const GroupByPrototype &);
+
+	public:
+		template<class Source>
+		struct ForSource
+		{
+			typedef GroupBy<Source> Type;
+		};
+
+		GroupByPrototype(const std::vector<std::string> & keys, size_t memoryLimit)
+			: keys_(keys), memoryLimit_(memoryLimit)
+		{
+		}
+
+		GroupByPrototype(const GroupByPrototype & other)
+			: keys_(other.keys_), memoryLimit_(other.memoryLimit_)
+		{
+			for(std::vector<Aggregate*>::const_iterator agg = other.aggregates_.begin(); agg != other.aggregates_.end(); ++agg)
+				aggregates_.push_back((*agg)->clone());
+		}
+
+		~GroupByPrototype()
+		{
+			for(std::vector<Aggregate*>::iterator agg = aggregates_.begin(); agg != aggregates_.end(); ++agg)
+				delete *agg;
+		}
+
+		/// Adds an aggregate, see Aggregates.hpp. Can be chained:
+		/// group_by(...).aggregate(Aggregates::count()).aggregate(Aggregates::sum<double>("b"))
+		GroupByPrototype & aggregate(const Aggregate & agg)
+		{
+			aggregates_.push_back(agg.clone());
+			return *this;
+		}
+
+		template<class Source>
+		GroupBy<Source> create() const
+		{
+			return GroupBy<Source>(keys_, aggregates_, memoryLimit_);
+		}
+	};
+
+	/// Groups the rows by the values of the key columns, keeping at most about
+	/// memoryLimit bytes of groups in memory before spilling to disk:
+	/// read_text_file(...) >> group_by(ColumnNames() << "a").aggregate(Aggregates::sum<double>("b")) >> write_text_file(...)
+	GroupByPrototype group_by(const ColumnNames & keys, size_t memoryLimit = 256 << 20)
+	{
+		return GroupByPrototype(keys, memoryLimit);
+	}
+}
+
+#endif
\ No newline at end of file
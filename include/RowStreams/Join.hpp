@@ -0,0 +1,514 @@
+#ifndef ROWSTREAMS_JOIN_HPP
+#define ROWSTREAMS_JOIN_HPP
+
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/RowPool.hpp"
+#include "RowStreams/RowBatch.hpp"
+#include "RowStreams/PipelinePlan.hpp"
+#include "RowStreams/KeyLayout.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <typeinfo>
+#include <cstring>
+#include <boost/cstdint.hpp>
+
+namespace RowStreams
+{
+	/// Which rows of the stream a Join hands on.
+	enum JoinType
+	{
+		/// Only the rows that match a row of the build side.
+		JOIN_INNER,
+		/// Every row, with the build columns left null if none matches.
+		JOIN_LEFT_OUTER
+	};
+
+	/// Appends to the rows of the stream the columns of the rows of another
+	/// pipeline, the build side, that have the same values in the key
+	/// columns. A row of the stream comes out once per matching row, and rows
+	/// with a null key never match. The build side is read in full before
+	/// the first row comes out.
+	///
+	/// The build rows are packed one after the other in a single arena: the
+	/// hash, the packed key (see KeyLayout) and the other columns packed the
+	/// same way, then, if some of these are strings, the offset and size of
+	/// the bytes they point to in a heap next to the arena, which are
+	/// copied into the output rows. Rows with equal hash buckets are
+	/// chained through an array of 32 bit indexes, so the table itself is
+	/// only an index per bucket.
+	/// A blocked bloom filter, a single 64 bit word per key, rules out most
+	/// of the rows of the stream that have no match before the table is
+	/// looked at; the keys of a whole batch are hashed and checked against
+	/// it before any bucket is, and the buckets of those that pass are
+	/// prefetched.
+	///
+	/// Rows come out of a pool of the join, with the columns of the row of
+	/// the stream copied, strings and all, so the stream starts a new plan
+	/// above the join.
+	template<class Source, class Build>
+	class Join
+	{
+		enum
+		{
+			MIN_BUCKETS = 16,
+			/// Bits of bloom filter per build row.
+			BLOOM_BITS = 16,
+			HEADER = sizeof(boost::uint64_t)
+		};
+
+		/// Row source. We don't own it, so no deletes.
+		Source * source_;
+		Build build_;
+		std::vector<std::string> keys_;
+		JoinType type_;
+
+		RowDef probeDef_;
+		RowDef buildDef_;
+		RowDef rowDef_;
+		/// Columns of the stream whose values point outside its rows, which
+		/// are copied into the arena of the output rows, since the batch of
+		/// the stream goes back before they do.
+		std::vector<const ColumnDef*> external_;
+		/// Build columns that are not keys, appended to the rows, and those
+		/// of them that point outside the rows, in the build rows and in the
+		/// output rows.
+		std::vector<std::string> payload_;
+		std::vector<const ColumnDef*> buildExternal_;
+		std::vector<const ColumnDef*> payloadExternal_;
+		KeyLayout probeKeys_;
+		KeyLayout buildKeys_;
+		KeyLayout payloadLayout_;
+		size_t entrySize_;
+		RowPool pool_;
+
+		std::vector<char> arena_;
+		std::vector<char> strings_;
+		/// First row of every bucket, and next row of every row in the same
+		/// bucket, plus one, or zero at the end.
+		std::vector<boost::uint32_t> heads_;
+		std::vector<boost::uint32_t> next_;
+		size_t mask_;
+		std::vector<boost::uint64_t> bloom_;
+		size_t bloomMask_;
+
+		/// Batch of the stream being joined, with the packed keys and hashes
+		/// of its rows, and whether they may have a match.
+		RowBatch input_;
+		bool holding_;
+		std::vector<char> packed_;
+		std::vector<boost::uint64_t> hashes_;
+		std::vector<char> candidates_;
+		/// Next row of input_ to join.
+		size_t inputRow_;
+		/// Row of input_ being joined, if any, and its next match.
+		Row * probe_;
+		size_t current_;
+		size_t match_;
+		bool matched_;
+
+		bool built_;
+		bool done_;
+
+		Join & operator=(const Join &);
+
+		const char * entry(size_t index) const
+		{
+			return &arena_[index * entrySize_];
+		}
+
+		static boost::uint64_t hashOf(const char * entry)
+		{
+			boost::uint64_t hash;
+			::memcpy(&hash, entry, HEADER);
+			return hash;
+		}
+
+		/// The bloom filter word of a hash comes from its top bits, and the
+		/// three bits set in it from bits the buckets only use in tables of
+		/// millions of rows.
+		size_t bloomWord(boost::uint64_t hash) const
+		{
+			return size_t(hash >> 40) & bloomMask_;
+		}
+
+		static boost::uint64_t bloomBits(boost::uint64_t hash)
+		{
+			return (boost::uint64_t(1) << ((hash >> 22) & 63)) | (boost::uint64_t(1) << ((hash >> 28) & 63)) |
+				(boost::uint64_t(1) << ((hash >> 34) & 63));
+		}
+
+		bool mayMatch(boost::uint64_t hash) const
+		{
+			const boost::uint64_t bits = bloomBits(hash);
+			return (bloom_[bloomWord(hash)] & bits) == bits;
+		}
+
+		/// Follows a chain from a row, plus one, to the first with the given
+		/// key. Returns that row plus one, or zero if there is none.
+		size_t find(size_t from, boost::uint64_t hash, const char * key) const
+		{
+			for(; from; from = next_[from - 1])
+			{
+				const char * at = entry(from - 1);
+				if(hashOf(at) == hash && ::memcmp(at + HEADER, key, probeKeys_.size()) == 0)
+					break;
+			}
+			return from;
+		}
+
+		/// Reads the whole build side into the arena, leaving out the rows
+		/// with a null key, and indexes it.
+		void build()
+		{
+			built_ = true;
+			const size_t keySize = buildKeys_.size();
+			RowBatch batch;
+			while(build_.nextBatch(batch))
+			{
+				for(size_t index = 0; index != batch.selected(); ++index)
+				{
+					const Row & row = *batch.selectedRow(index);
+					const size_t at = arena_.size();
+					arena_.resize(at + entrySize_);
+					char * packed = &arena_[at];
+					buildKeys_.pack(row, packed + HEADER);
+					if(!buildKeys_.complete(packed + HEADER))
+					{
+						arena_.resize(at);
+						continue;
+					}
+					const boost::uint64_t hash = KeyLayout::hash(packed + HEADER, keySize);
+					::memcpy(packed, &hash, HEADER);
+					payloadLayout_.pack(row, packed + HEADER + keySize);
+					if(!buildExternal_.empty())
+					{
+						const boost::uint64_t offset = strings_.size();
+						for(std::vector<const ColumnDef*>::const_iterator column = buildExternal_.begin();
+							column != buildExternal_.end(); ++column)
+							(*column)->stash(row, strings_);
+						const boost::uint64_t size = strings_.size() - offset;
+						char * at = packed + HEADER + keySize + payloadLayout_.size();
+						::memcpy(at, &offset, sizeof(offset));
+						::memcpy(at + sizeof(offset), &size, sizeof(size));
+					}
+				}
+				build_.releaseBatch(batch);
+			}
+
+			const size_t count = arena_.size() / entrySize_;
+			if(count >= size_t(boost::uint32_t(-1)))
+				throw std::runtime_error("Too many rows on the build side of a join");
+
+			size_t buckets = MIN_BUCKETS;
+			while(buckets < count)
+				buckets *= 2;
+			heads_.assign(buckets, 0);
+			mask_ = buckets - 1;
+			next_.assign(count, 0);
+
+			size_t words = 1;
+			while(words * 64 < count * BLOOM_BITS)
+				words *= 2;
+			bloom_.assign(words, 0);
+			bloomMask_ = words - 1;
+
+			// Linked backwards, so that matches come out in the order of the
+			// build side.
+			for(size_t index = count; index-- != 0; )
+			{
+				const boost::uint64_t hash = hashOf(entry(index));
+				const size_t bucket = size_t(hash) & mask_;
+				next_[index] = heads_[bucket];
+				heads_[bucket] = boost::uint32_t(index + 1);
+				bloom_[bloomWord(hash)] |= bloomBits(hash);
+			}
+
+			// An inner join with nothing to match has nothing to read.
+			if(!count && type_ == JOIN_INNER)
+				done_ = true;
+		}
+
+		/// Packs and hashes the keys of the batch just read, and prefetches
+		/// the buckets of those that may have a match.
+		void prepare()
+		{
+			const size_t keySize = probeKeys_.size();
+			for(size_t index = 0; index != input_.selected(); ++index)
+			{
+				char * key = &packed_[index * keySize];
+				probeKeys_.pack(*input_.selectedRow(index), key);
+				hashes_[index] = KeyLayout::hash(key, keySize);
+				candidates_[index] = probeKeys_.complete(key) && mayMatch(hashes_[index]);
+				if(candidates_[index])
+					ROWSTREAMS_PREFETCH(&heads_[size_t(hashes_[index]) & mask_]);
+			}
+			inputRow_ = 0;
+		}
+
+		/// Makes an output row out of a row of the stream and a build row
+		/// plus one, or zero to leave the build columns null.
+		Row * joined(const Row & probe, size_t match)
+		{
+			Row * row = pool_.acquire();
+			::memcpy(row->buffer(), probe.buffer(), probeDef_.size());
+			row->copyValid(probe, probeDef_.numColumns());
+			for(std::vector<const ColumnDef*>::const_iterator column = external_.begin(); column != external_.end(); ++column)
+				(*column)->own(*row);
+			if(match)
+			{
+				const char * payload = entry(match - 1) + HEADER + buildKeys_.size();
+				payloadLayout_.unpack(payload, rowDef_, probeDef_.numColumns(), *row);
+				if(!payloadExternal_.empty())
+				{
+					boost::uint64_t offset;
+					::memcpy(&offset, payload + payloadLayout_.size(), sizeof(offset));
+					const char * strings = strings_.empty() ? 0 : &strings_[0] + offset;
+					for(std::vector<const ColumnDef*>::const_iterator column = payloadExternal_.begin();
+						column != payloadExternal_.end(); ++column)
+					{
+						strings += (*column)->attach(*row, strings);
+						(*column)->own(*row);
+					}
+				}
+			}
+			return row;
+		}
+
+		/// Returns the next output row, or 0 after the last.
+		Row * nextJoined()
+		{
+			if(!built_)
+				build();
+
+			for(;;)
+			{
+				if(probe_)
+				{
+					if(match_)
+					{
+						Row * row = joined(*probe_, match_);
+						matched_ = true;
+						match_ = find(next_[match_ - 1], hashes_[current_], &packed_[current_ * probeKeys_.size()]);
+						return row;
+					}
+					const Row * probe = probe_;
+					probe_ = 0;
+					if(!matched_ && type_ == JOIN_LEFT_OUTER)
+						return joined(*probe, 0);
+				}
+
+				if(done_)
+					return 0;
+				if(inputRow_ == input_.selected())
+				{
+					if(holding_)
+						source_->releaseBatch(input_);
+					holding_ = source_->nextBatch(input_);
+					if(!holding_)
+					{
+						done_ = true;
+						return 0;
+					}
+					prepare();
+					continue;
+				}
+
+				current_ = inputRow_++;
+				probe_ = input_.selectedRow(current_);
+				matched_ = false;
+				match_ = candidates_[current_] ? find(heads_[size_t(hashes_[current_]) & mask_], hashes_[current_],
+					&packed_[current_ * probeKeys_.size()]) : 0;
+			}
+		}
+
+	public:
+		Join(const Build & build, const std::vector<std::string> & keys, JoinType type)
+			: source_(0), build_(build), keys_(keys), type_(type), entrySize_(0), mask_(0), bloomMask_(0),
+			holding_(false), inputRow_(0), probe_(0), current_(0), match_(0), matched_(false),
+			built_(false), done_(false)
+		{
+		}
+
+		Join(const Join & other)
+			: source_(0), build_(other.build_), keys_(other.keys_), type_(other.type_), entrySize_(0), mask_(0),
+			bloomMask_(0), holding_(false), inputRow_(0), probe_(0), current_(0), match_(0), matched_(false),
+			built_(false), done_(false)
+		{
+		}
+
+		void source(Source * source)
+		{
+			source_ = source;
+		}
+
+		void init()
+		{
+			source_->init();
+			build_.init();
+			probeDef_ = source_->rowDef();
+			buildDef_ = build_.rowDef();
+
+			for(std::vector<std::string>::const_iterator key = keys_.begin(); key != keys_.end(); ++key)
+			{
+				const ColumnDef * probeColumn = probeDef_.columnDef(*key);
+				const ColumnDef * buildColumn = buildDef_.columnDef(*key);
+				if(!probeColumn || !buildColumn)
+					throw std::runtime_error("No key column "+*key+" on both sides of the join");
+				if(typeid(*probeColumn) != typeid(*buildColumn))
+					throw std::runtime_error("Key column "+*key+" has a different type on each side of the join");
+			}
+			probeKeys_.init(probeDef_, keys_);
+			buildKeys_.init(buildDef_, keys_);
+
+			rowDef_ = probeDef_;
+			external_.clear();
+			for(RowDef::ConstAttrIter column = probeDef_.begin(); column != probeDef_.end(); ++column)
+			{
+				if((*column)->external())
+					external_.push_back(*column);
+			}
+			payload_.clear();
+			for(RowDef::ConstAttrIter column = buildDef_.begin(); column != buildDef_.end(); ++column)
+			{
+				const std::string name = (*column)->name();
+				if(std::find(keys_.begin(), keys_.end(), name) != keys_.end())
+					continue;
+				if(probeDef_.columnDef(name))
+					throw std::runtime_error("Column "+name+" is on both sides of the join");
+				rowDef_.add(**column);
+				payload_.push_back(name);
+			}
+			payloadLayout_.init(buildDef_, payload_, false);
+			buildExternal_.clear();
+			payloadExternal_.clear();
+			for(std::vector<std::string>::const_iterator name = payload_.begin(); name != payload_.end(); ++name)
+			{
+				if(buildDef_.columnDef(*name)->external())
+				{
+					buildExternal_.push_back(buildDef_.columnDef(*name));
+					payloadExternal_.push_back(rowDef_.columnDef(*name));
+				}
+			}
+			entrySize_ = HEADER + buildKeys_.size() + payloadLayout_.size()
+				+ (buildExternal_.empty() ? 0 : 2 * sizeof(boost::uint64_t));
+
+			packed_.assign(RowBatch::CAPACITY * probeKeys_.size(), 0);
+			hashes_.resize(RowBatch::CAPACITY);
+			candidates_.resize(RowBatch::CAPACITY);
+			pool_.rowDef(&rowDef_);
+		}
+
+		/// Rows are created with the planned layout. The stream above the
+		/// join gets a plan of its own, with the predicates and the used
+		/// columns that are not build columns, and the build side one where
+		/// only the keys and the used build columns are.
+		bool plan(PipelinePlan & plan)
+		{
+			if(plan.layout)
+				pool_.rowDef(plan.layout);
+
+			PipelinePlan probe;
+			probe.layout = &probeDef_;
+			probe.predicates = plan.predicates;
+			probe.allColumns = plan.allColumns;
+			probe.usedColumns = plan.usedColumns;
+			PipelinePlan build;
+			build.layout = &buildDef_;
+			build.allColumns = false;
+			build.use(keys_);
+			for(std::vector<std::string>::const_iterator column = payload_.begin(); column != payload_.end(); ++column)
+			{
+				if(plan.used(*column))
+					build.usedColumns.push_back(*column);
+				probe.withhold(*column);
+				probe.written(*column);
+			}
+			probe.use(keys_);
+
+			source_->plan(probe);
+			build_.plan(build);
+			return true;
+		}
+
+		void stop()
+		{
+			source_->stop();
+			build_.stop();
+		}
+
+		const RowDef & rowDef()
+		{
+			return rowDef_;
+		}
+
+		Row * next()
+		{
+			return nextJoined();
+		}
+
+		void release(Row * row)
+		{
+			pool_.release(row);
+		}
+
+		bool nextBatch(RowBatch & batch)
+		{
+			batch.clear();
+			while(!batch.full())
+			{
+				Row * row = nextJoined();
+				if(!row)
+					break;
+				batch.add(row);
+			}
+			return !batch.empty();
+		}
+
+		void releaseBatch(RowBatch & batch)
+		{
+			for(size_t index = 0; index != batch.size(); ++index)
+				pool_.release(batch.row(index));
+			batch.clear();
+		}
+	};
+
+	/// Bridge class used in the pipeline construction syntax.
+	template<class Build>
+	class JoinPrototype
+	{
+		Build build_;
+		std::vector<std::string> keys_;
+		JoinType type_;
+
+	public:
+		template<class Source>
+		struct ForSource
+		{
+			typedef Join<Source, Build> Type;
+		};
+
+		JoinPrototype(const Build & build, const std::vector<std::string> & keys, JoinType type)
+			: build_(build), keys_(keys), type_(type)
+		{
+		}
+
+		template<class Source>
+		Join<Source, Build> create() const
+		{
+			return Join<Source, Build>(build_, keys_, type_);
+		}
+	};
+
+	/// Appends the columns of the matching rows of another pipeline, which
+	/// is read whole into memory, to the rows of the stream:
+	/// read_text_file(...) >> join(read_text_file(lookup, "lookup.txt"), ColumnNames() << "a") >> write_text_file(...)
+	template<class Build>
+	JoinPrototype<Build> join(const Build & build, const ColumnNames & keys, JoinType type = JOIN_INNER)
+	{
+		return JoinPrototype<Build>(build, keys, type);
+	}
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,127 @@
+#ifndef ROWSTREAMS_KEY_LAYOUT_HPP
+#define ROWSTREAMS_KEY_LAYOUT_HPP
+
+#include "RowStreams/Row.hpp"
+#include "RowStreams/RowDef.hpp"
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstring>
+#include <boost/cstdint.hpp>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#	include <xmmintrin.h>
+#	define ROWSTREAMS_PREFETCH(address) _mm_prefetch((const char *)(address), _MM_HINT_T0)
+#else
+#	define ROWSTREAMS_PREFETCH(address)
+#endif
+
+namespace RowStreams
+{
+	/// Where the key columns of a row go in the packed keys of the hash
+	/// tables of GroupBy and Join: a byte per column that tells whether the value is set, then the bytes
+	/// of every value, zero when null, then zeros up to a multiple of 8 bytes.
+	/// Equal keys have equal bytes, so they are compared with memcmp and
+	/// hashed a word at a time.
+	class KeyLayout
+	{
+		struct KeyColumn
+		{
+			size_t index;
+			size_t offset;
+			size_t size;
+			/// Place of the value in the packed key.
+			size_t packed;
+		};
+
+		std::vector<KeyColumn> columns_;
+		size_t size_;
+
+	public:
+		KeyLayout()
+			: size_(0)
+		{
+		}
+
+		/// Lays out the keys for the given columns of rowDef. Columns packed
+		/// as values rather than keys, like the build columns of a Join, may
+		/// be external, in which case the caller keeps the bytes they point
+		/// to.
+		void init(const RowDef & rowDef, const std::vector<std::string> & names, bool keys = true)
+		{
+			columns_.clear();
+			size_ = names.size();
+			for(std::vector<std::string>::const_iterator name = names.begin(); name != names.end(); ++name)
+			{
+				const ColumnDef * columnDef = rowDef.columnDef(*name);
+				if(!columnDef)
+					throw std::runtime_error("No key column "+*name);
+				// Packed keys outlive the rows, and the bytes these point to.
+				if(keys && columnDef->external())
+					throw std::runtime_error("Column "+*name+" points outside the row and cannot be a key");
+
+				KeyColumn column = { columnDef->index(), columnDef->offset(), columnDef->size(), size_ };
+				columns_.push_back(column);
+				size_ += column.size;
+			}
+			size_ = (size_ + 7) / 8 * 8;
+		}
+
+		/// Size of a packed key, a multiple of 8.
+		size_t size() const
+		{
+			return size_;
+		}
+
+		/// Tells whether no column of a packed key is null.
+		bool complete(const char * key) const
+		{
+			return ::memchr(key, 0, columns_.size()) == 0;
+		}
+
+		/// Packs the key of a row into size() bytes.
+		void pack(const Row & row, char * key) const
+		{
+			::memset(key, 0, size_);
+			for(size_t col = 0; col != columns_.size(); ++col)
+			{
+				if(row.isNull(columns_[col].index))
+					continue;
+				key[col] = 1;
+				::memcpy(key + columns_[col].packed, row.buffer() + columns_[col].offset, columns_[col].size);
+			}
+		}
+
+		/// Unpacks a key into the same columns of another layout, which
+		/// start at index first.
+		void unpack(const char * key, const RowDef & rowDef, size_t first, Row & out) const
+		{
+			for(size_t col = 0; col != columns_.size(); ++col)
+			{
+				if(!key[col])
+					continue;
+				const size_t index = first + col;
+				::memcpy(out.buffer() + rowDef.offset(index), key + columns_[col].packed, columns_[col].size);
+				out.setNull(index, false);
+			}
+		}
+
+		static boost::uint64_t hash(const char * key, size_t size)
+		{
+			boost::uint64_t hash = 0x9E3779B97F4A7C15ULL;
+			for(size_t pos = 0; pos != size; pos += 8)
+			{
+				boost::uint64_t word;
+				::memcpy(&word, key + pos, 8);
+				hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+				hash ^= hash >> 32;
+			}
+			hash ^= hash >> 33;
+			hash *= 0xC4CEB9FE1A85EC53ULL;
+			hash ^= hash >> 33;
+			return hash;
+		}
+	};
+}
+
+#endif
\ No newline at end of file
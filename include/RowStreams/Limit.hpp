@@ -0,0 +1,430 @@
+#ifndef ROWSTREAMS_LIMIT_HPP
+#define ROWSTREAMS_LIMIT_HPP
+
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/RowPool.hpp"
+#include "RowStreams/RowBatch.hpp"
+#include "RowStreams/PipelinePlan.hpp"
+#include "RowStreams/RecordLayout.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <boost/cstdint.hpp>
+
+namespace RowStreams
+{
+	/// Hands on the first rows of the stream, up to a count, then stops the
+	/// stream up from it, so that readers stop reading and parsing and
+	/// threads stop working ahead.
+	template<class Source>
+	class Limit
+	{
+		/// Row source. We don't own it, so no deletes.
+		Source * source_;
+		size_t limit_;
+		size_t count_;
+		bool stopped_;
+		RowDef rowDef_;
+
+		void stopSource()
+		{
+			if(!stopped_)
+			{
+				stopped_ = true;
+				source_->stop();
+			}
+		}
+
+	public:
+		Limit(size_t limit)
+			: source_(0), limit_(limit), count_(0), stopped_(false)
+		{
+		}
+
+		void init()
+		{
+			source_->init();
+			rowDef_ = source_->rowDef();
+		}
+
+		/// Filters down the stream can not go past the limit, as they would
+		/// change which rows make it, so they are kept from the source.
+		bool plan(PipelinePlan & plan)
+		{
+			if(!plan.layout)
+				plan.layout = &rowDef_;
+			std::vector<RowPredicate*> predicates;
+			predicates.swap(plan.predicates);
+			const bool planned = source_->plan(plan);
+			plan.predicates.swap(predicates);
+			return planned;
+		}
+
+		Row * next()
+		{
+			if(count_ == limit_)
+			{
+				stopSource();
+				return 0;
+			}
+
+			Row * row = source_->next();
+			if(row && ++count_ == limit_)
+				stopSource();
+			return row;
+		}
+
+		void release(Row * row)
+		{
+			source_->release(row);
+		}
+
+		/// Drops the rows past the limit from the selection of the batch.
+		bool nextBatch(RowBatch & batch)
+		{
+			if(count_ == limit_)
+			{
+				stopSource();
+				batch.clear();
+				return false;
+			}
+
+			if(!source_->nextBatch(batch))
+				return false;
+			batch.selected(std::min(batch.selected(), limit_ - count_));
+			count_ += batch.selected();
+			if(count_ == limit_)
+				stopSource();
+			return true;
+		}
+
+		void releaseBatch(RowBatch & batch)
+		{
+			source_->releaseBatch(batch);
+		}
+
+		void stop()
+		{
+			stopSource();
+		}
+
+		const RowDef & rowDef()
+		{
+			return rowDef_;
+		}
+
+		void source(Source * source)
+		{
+			source_ = source;
+		}
+	};
+
+	/// Hands on the first rows of the stream in the order of the sort
+	/// columns, up to a count, in that order. Rows with equal sort columns
+	/// keep their order. The whole input is read before the first row comes
+	/// out, but only count rows are kept.
+	///
+	/// The rows are copied into records laid out by a RecordLayout, and
+	/// kept in a heap with the last of them on top. The key of every row
+	/// read is compared with that of the top record, and the row is only
+	/// copied if it comes first, so that most rows of a long stream never
+	/// are. Long strings go to a heap next to the records, which is
+	/// compacted once records that were replaced take most of it.
+	template<class Source>
+	class TopK
+	{
+		/// Size of the heap of strings under which it is never compacted.
+		enum { MIN_COMPACT = 1 << 16 };
+
+		/// Orders records by key, then by arrival.
+		class RecordLess
+		{
+			const TopK * topK_;
+
+		public:
+			RecordLess(const TopK * topK)
+				: topK_(topK)
+			{
+			}
+
+			bool operator()(boost::uint32_t left, boost::uint32_t right) const
+			{
+				const int compared = ::memcmp(topK_->record(left), topK_->record(right), topK_->layout_.keySize());
+				return compared ? compared < 0 : topK_->arrivals_[left] < topK_->arrivals_[right];
+			}
+		};
+
+		friend class RecordLess;
+
+		/// Row source. We don't own it, so no deletes.
+		Source * source_;
+		size_t count_;
+		std::vector<std::string> columns_;
+		SortOrder order_;
+
+		RowDef rowDef_;
+		RecordLayout layout_;
+		RowPool pool_;
+
+		std::vector<char> records_;
+		/// Heap of the records (see RecordLayout), and how much of it the
+		/// records kept still use.
+		std::vector<char> strings_;
+		size_t usedStrings_;
+		/// Number of the row each record was made from.
+		std::vector<boost::uint64_t> arrivals_;
+		/// Records as a heap, then in order once the input is read.
+		std::vector<boost::uint32_t> heap_;
+		std::vector<char> key_;
+		boost::uint64_t arrived_;
+
+		bool built_;
+		size_t nextRecord_;
+
+		TopK & operator=(const TopK &);
+
+		const char * record(size_t index) const
+		{
+			return &records_[index * layout_.size()];
+		}
+
+		char * record(size_t index)
+		{
+			return &records_[index * layout_.size()];
+		}
+
+		void add(const Row & row)
+		{
+			const boost::uint64_t arrival = arrived_++;
+			if(heap_.size() < count_)
+			{
+				const boost::uint32_t index = boost::uint32_t(heap_.size());
+				records_.resize(records_.size() + layout_.size());
+				layout_.pack(row, record(index), strings_);
+				usedStrings_ += layout_.stringsSize(record(index));
+				arrivals_.push_back(arrival);
+				heap_.push_back(index);
+				std::push_heap(heap_.begin(), heap_.end(), RecordLess(this));
+				return;
+			}
+
+			// Rows that come after the last one kept, or with the same key,
+			// since it came first, are never copied.
+			layout_.packKey(row, &key_[0]);
+			if(::memcmp(&key_[0], record(heap_.front()), layout_.keySize()) >= 0)
+				return;
+
+			std::pop_heap(heap_.begin(), heap_.end(), RecordLess(this));
+			const boost::uint32_t index = heap_.back();
+			usedStrings_ -= layout_.stringsSize(record(index));
+			layout_.pack(row, record(index), strings_);
+			usedStrings_ += layout_.stringsSize(record(index));
+			arrivals_[index] = arrival;
+			std::push_heap(heap_.begin(), heap_.end(), RecordLess(this));
+			if(strings_.size() > std::max(2 * usedStrings_, size_t(MIN_COMPACT)))
+				compactStrings();
+		}
+
+		/// Drops the strings of the records that were replaced from the heap.
+		void compactStrings()
+		{
+			std::vector<char> strings;
+			strings.reserve(usedStrings_);
+			for(size_t index = 0; index != heap_.size(); ++index)
+			{
+				const size_t size = layout_.stringsSize(record(index));
+				if(!size)
+					continue;
+				const char * from = &strings_[layout_.stringsOffset(record(index))];
+				layout_.moveStrings(record(index), strings.size());
+				strings.insert(strings.end(), from, from + size);
+			}
+			strings_.swap(strings);
+		}
+
+		/// Reads the whole input.
+		void build()
+		{
+			built_ = true;
+			nextRecord_ = 0;
+			if(count_ == 0)
+			{
+				source_->stop();
+				return;
+			}
+
+			RowBatch batch;
+			while(source_->nextBatch(batch))
+			{
+				for(size_t index = 0; index != batch.selected(); ++index)
+					add(*batch.selectedRow(index));
+				source_->releaseBatch(batch);
+			}
+			std::sort_heap(heap_.begin(), heap_.end(), RecordLess(this));
+		}
+
+		Row * nextRow()
+		{
+			if(!built_)
+				build();
+			if(nextRecord_ == heap_.size())
+				return 0;
+
+			Row * row = pool_.acquire();
+			const char * from = record(heap_[nextRecord_++]);
+			layout_.unpack(from, layout_.stringsSize(from) ? &strings_[layout_.stringsOffset(from)] : 0, *row);
+			return row;
+		}
+
+	public:
+		TopK(size_t count, const std::vector<std::string> & columns, SortOrder order)
+			: source_(0), count_(count), columns_(columns), order_(order), usedStrings_(0), arrived_(0), built_(false),
+			nextRecord_(0)
+		{
+		}
+
+		TopK(const TopK & other)
+			: source_(0), count_(other.count_), columns_(other.columns_), order_(other.order_), usedStrings_(0),
+			arrived_(0), built_(false), nextRecord_(0)
+		{
+		}
+
+		void source(Source * source)
+		{
+			source_ = source;
+		}
+
+		void init()
+		{
+			source_->init();
+			rowDef_ = source_->rowDef();
+			layout_.init(rowDef_, columns_, order_);
+			key_.resize(std::max(layout_.keySize(), size_t(1)));
+			pool_.rowDef(&rowDef_);
+		}
+
+		/// Rows are created with the planned layout. The source gets a plan
+		/// of its own, with the used columns plus the sort columns. Filters
+		/// down the stream can not go past the stage, as they would change
+		/// which rows make it.
+		bool plan(PipelinePlan & plan)
+		{
+			if(plan.layout)
+				pool_.rowDef(plan.layout);
+
+			PipelinePlan input;
+			input.layout = &rowDef_;
+			input.allColumns = plan.allColumns;
+			input.usedColumns = plan.usedColumns;
+			input.use(columns_);
+			source_->plan(input);
+			return true;
+		}
+
+		void stop()
+		{
+			source_->stop();
+		}
+
+		const RowDef & rowDef()
+		{
+			return rowDef_;
+		}
+
+		Row * next()
+		{
+			return nextRow();
+		}
+
+		void release(Row * row)
+		{
+			pool_.release(row);
+		}
+
+		bool nextBatch(RowBatch & batch)
+		{
+			batch.clear();
+			while(!batch.full())
+			{
+				Row * row = nextRow();
+				if(!row)
+					break;
+				batch.add(row);
+			}
+			return !batch.empty();
+		}
+
+		void releaseBatch(RowBatch & batch)
+		{
+			for(size_t index = 0; index != batch.size(); ++index)
+				pool_.release(batch.row(index));
+			batch.clear();
+		}
+	};
+
+	/// Bridge class used in the pipeline construction syntax.
+	class LimitPrototype
+	{
+		size_t limit_;
+	public:
+		template<class Source>
+		struct ForSource
+		{
+			typedef Limit<Source> Type;
+		};
+
+		LimitPrototype(size_t limit)
+			: limit_(limit)
+		{
+		}
+
+		template<class Source>
+		Limit<Source> create() const
+		{
+			return Limit<Source>(limit_);
+		}
+	};
+
+	/// Bridge class used in the pipeline construction syntax.
+	class TopKPrototype
+	{
+		size_t count_;
+		std::vector<std::string> columns_;
+		SortOrder order_;
+	public:
+		template<class Source>
+		struct ForSource
+		{
+			typedef TopK<Source> Type;
+		};
+
+		TopKPrototype(size_t count, const std::vector<std::string> & columns, SortOrder order)
+			: count_(count), columns_(columns), order_(order)
+		{
+		}
+
+		template<class Source>
+		TopK<Source> create() const
+		{
+			return TopK<Source>(count_, columns_, order_);
+		}
+	};
+
+	/// Keeps the first rows of the stream and stops reading after them:
+	/// read_text_file(...) >> limit(100) >> write_text_file(...)
+	LimitPrototype limit(size_t count)
+	{
+		return LimitPrototype(count);
+	}
+
+	/// Keeps the first rows in the order of the given columns, which is the
+	/// same as sort_by() followed by limit(), in memory for count rows only:
+	/// read_text_file(...) >> top_k(10, ColumnNames() << "b", SORT_DESCENDING) >> write_text_file(...)
+	TopKPrototype top_k(size_t count, const ColumnNames & columns, SortOrder order = SORT_ASCENDING)
+	{
+		return TopKPrototype(count, columns, order);
+	}
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,737 @@
+#ifndef ROWSTREAMS_MORSELS_HPP
+#define ROWSTREAMS_MORSELS_HPP
+
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/RowBatch.hpp"
+#include "RowStreams/Pipeline.hpp"
+#include "RowStreams/PipelinePlan.hpp"
+#include "RowStreams/StageTraits.hpp"
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/bind.hpp>
+
+namespace RowStreams
+{
+	/// Order in which merge_morsels() hands out batches.
+	enum MergeOrder
+	{
+		/// Batches come out in the same order as they went in.
+		MERGE_ORDERED,
+		/// Batches come out as soon as they are done.
+		MERGE_UNORDERED
+	};
+
+	/// Hands out the batches (morsels) of a source to several workers.
+	/// Every worker has a queue of its own that it fills a few morsels at a
+	/// time, and takes from the front of; workers that run out steal from the
+	/// back of the others' queues before pulling from the source again, so a
+	/// worker slowed down by expensive rows does not hold the rest back.
+	/// The source is only ever called with the lock held.
+	template<class Source>
+	class MorselScheduler
+	{
+		enum { MORSELS_PER_PULL = 2 };
+
+		struct Morsel
+		{
+			RowBatch * batch;
+			size_t sequence;
+		};
+
+		struct Queue
+		{
+			boost::mutex mutex;
+			std::deque<Morsel> morsels;
+			/// Sequence numbers of the morsels the worker took since it last
+			/// asked. Only used by the worker.
+			std::vector<size_t> taken;
+		};
+
+		Source * source_;
+		RowDef rowDef_;
+		bool planned_;
+		std::vector<Queue*> queues_;
+
+		/// Guards the source and everything below.
+		boost::mutex mutex_;
+		boost::condition_variable room_;
+		size_t nextSequence_;
+		/// Morsels pulled from the source but not merged yet.
+		size_t inFlight_;
+		size_t limit_;
+		bool exhausted_;
+		bool stopping_;
+		std::vector<RowBatch*> free_;
+		std::vector<RowBatch*> carriers_;
+
+		MorselScheduler(const MorselScheduler &);
+		MorselScheduler & operator=(const MorselScheduler &);
+
+		bool take(size_t worker, Morsel & morsel)
+		{
+			{
+				Queue & own = *queues_[worker];
+				boost::mutex::scoped_lock lock(own.mutex);
+				if(!own.morsels.empty())
+				{
+					morsel = own.morsels.front();
+					own.morsels.pop_front();
+					return true;
+				}
+			}
+
+			for(size_t offset = 1; offset != queues_.size(); ++offset)
+			{
+				Queue & victim = *queues_[(worker + offset) % queues_.size()];
+				boost::mutex::scoped_lock lock(victim.mutex);
+				if(!victim.morsels.empty())
+				{
+					morsel = victim.morsels.back();
+					victim.morsels.pop_back();
+					return true;
+				}
+			}
+			return false;
+		}
+
+		/// Pulls a few morsels into the queue of a worker. Returns false once
+		/// the source is exhausted. Morsels pulled before that are all in some
+		/// queue, whose worker takes them before finishing.
+		bool pull(size_t worker)
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			while(inFlight_ >= limit_ && !exhausted_ && !stopping_)
+				room_.wait(lock);
+			if(exhausted_ || stopping_)
+				return false;
+
+			for(size_t count = 0; count != MORSELS_PER_PULL && inFlight_ < limit_; ++count)
+			{
+				RowBatch * batch;
+				if(free_.empty())
+				{
+					carriers_.push_back(new RowBatch);
+					batch = carriers_.back();
+				}
+				else
+				{
+					batch = free_.back();
+					free_.pop_back();
+				}
+
+				if(!source_->nextBatch(*batch))
+				{
+					exhausted_ = true;
+					free_.push_back(batch);
+					room_.notify_all();
+					return count != 0;
+				}
+
+				Morsel morsel = { batch, nextSequence_++ };
+				++inFlight_;
+				Queue & own = *queues_[worker];
+				boost::mutex::scoped_lock queue_lock(own.mutex);
+				own.morsels.push_back(morsel);
+			}
+			return true;
+		}
+
+	public:
+		MorselScheduler()
+			: source_(0), planned_(false), nextSequence_(0), inFlight_(0), limit_(1),
+			exhausted_(false), stopping_(false)
+		{
+		}
+
+		~MorselScheduler()
+		{
+			for(typename std::vector<Queue*>::iterator queue = queues_.begin(); queue != queues_.end(); ++queue)
+				delete *queue;
+			for(std::vector<RowBatch*>::iterator batch = carriers_.begin(); batch != carriers_.end(); ++batch)
+				delete *batch;
+		}
+
+		bool attached() const
+		{
+			return source_ != 0;
+		}
+
+		/// Makes an initialized source the one morsels come from.
+		void attach(Source * source)
+		{
+			source_ = source;
+			rowDef_ = source->rowDef();
+		}
+
+		const RowDef & rowDef() const
+		{
+			return rowDef_;
+		}
+
+		bool plan(PipelinePlan & plan)
+		{
+			planned_ = source_->plan(plan);
+			return planned_;
+		}
+
+		bool planned() const
+		{
+			return planned_;
+		}
+
+		/// Adds a worker, returning its number. Not to be called once morsels
+		/// are handed out.
+		size_t addWorker()
+		{
+			queues_.push_back(new Queue);
+			return queues_.size() - 1;
+		}
+
+		/// Sets how many morsels can be on their way at once.
+		void limit(size_t morsels)
+		{
+			limit_ = std::max(morsels, size_t(1));
+		}
+
+		/// Copies the next morsel for a worker into batch. Returns false once
+		/// there are none left.
+		bool next(size_t worker, RowBatch & batch)
+		{
+			Morsel morsel;
+			while(!take(worker, morsel))
+			{
+				if(!pull(worker))
+				{
+					batch.clear();
+					return false;
+				}
+			}
+
+			batch.assign(*morsel.batch);
+			queues_[worker]->taken.push_back(morsel.sequence);
+
+			boost::mutex::scoped_lock lock(mutex_);
+			morsel.batch->clear();
+			free_.push_back(morsel.batch);
+			return true;
+		}
+
+		/// Moves the sequence numbers of the morsels a worker took since the
+		/// last call into taken.
+		void takeSequences(size_t worker, std::vector<size_t> & taken)
+		{
+			taken.clear();
+			taken.swap(queues_[worker]->taken);
+		}
+
+		/// Tells that a number of morsels have left the merge.
+		void consumed(size_t morsels)
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			inFlight_ -= morsels;
+			room_.notify_all();
+		}
+
+		void releaseBatch(RowBatch & batch)
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			source_->releaseBatch(batch);
+		}
+
+		void release(Row * row)
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			source_->release(row);
+		}
+
+		/// Makes workers waiting for room give up.
+		void stop()
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			stopping_ = true;
+			room_.notify_all();
+		}
+
+		/// Makes workers give up, and stops the source.
+		void stopSource()
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			stopping_ = true;
+			room_.notify_all();
+			source_->stop();
+		}
+	};
+
+	/// Start of a part of a pipeline run by several threads at once, see
+	/// merge_morsels(). All copies of a splitter share a scheduler: the one
+	/// initialized first pulls from its source, the others are replicas
+	/// that get morsels from the scheduler.
+	template<class Source>
+	class MorselSplitter
+	{
+	public:
+		typedef MorselScheduler<Source> Scheduler;
+
+	private:
+		/// Row source. We don't own it, so no deletes.
+		Source * source_;
+		boost::shared_ptr<Scheduler> scheduler_;
+		/// Worker the replica belongs to, or -1 for the original.
+		size_t worker_;
+		RowDef rowDef_;
+
+	public:
+		MorselSplitter()
+			: source_(0), scheduler_(new Scheduler), worker_(size_t(-1))
+		{
+		}
+
+		/// Copies made once the original is initialized are replicas, others
+		/// belong to a pipeline of their own.
+		MorselSplitter(const MorselSplitter & other)
+			: source_(0), scheduler_(other.scheduler_->attached() ? other.scheduler_ : boost::shared_ptr<Scheduler>(new Scheduler)),
+			worker_(size_t(-1))
+		{
+		}
+
+		void source(Source * source)
+		{
+			source_ = source;
+		}
+
+		void init()
+		{
+			if(scheduler_->attached())
+			{
+				worker_ = scheduler_->addWorker();
+			}
+			else
+			{
+				source_->init();
+				scheduler_->attach(source_);
+			}
+			rowDef_ = scheduler_->rowDef();
+		}
+
+		bool plan(PipelinePlan & plan)
+		{
+			return worker_ == size_t(-1) ? scheduler_->plan(plan) : scheduler_->planned();
+		}
+
+		const RowDef & rowDef()
+		{
+			return rowDef_;
+		}
+
+		bool nextBatch(RowBatch & batch)
+		{
+			if(worker_ == size_t(-1))
+				throw std::runtime_error("Rows after split_morsels() can only be pulled by merge_morsels()");
+			return scheduler_->next(worker_, batch);
+		}
+
+		void releaseBatch(RowBatch & batch)
+		{
+			scheduler_->releaseBatch(batch);
+		}
+
+		void release(Row * row)
+		{
+			scheduler_->release(row);
+		}
+
+		/// Only the original stops the source, once merge_morsels() is done
+		/// with the replicas.
+		void stop()
+		{
+			if(worker_ == size_t(-1) && scheduler_->attached())
+				scheduler_->stopSource();
+		}
+
+		Scheduler & scheduler()
+		{
+			return *scheduler_;
+		}
+	};
+
+	/// Finds the MorselSplitter a replicated part of a pipeline starts at,
+	/// checking that every stage on the way can be replicated.
+	template<class Chain>
+	struct MorselSegment;
+
+	template<class Module, class Prev>
+	struct MorselSegment<PartialPipeline<Module, Prev> >
+	{
+		// Stages between split_morsels() and merge_morsels() must be
+		// replicable, see StageTraits.
+		BOOST_STATIC_ASSERT(StageTraits<Module>::replicable);
+
+		typedef typename MorselSegment<Prev>::Splitter Splitter;
+
+		static Splitter & splitter(PartialPipeline<Module, Prev> & chain)
+		{
+			return MorselSegment<Prev>::splitter(chain.prev());
+		}
+	};
+
+	template<class Source, class Prev>
+	struct MorselSegment<PartialPipeline<MorselSplitter<Source>, Prev> >
+	{
+		typedef MorselSplitter<Source> Splitter;
+
+		static Splitter & splitter(PartialPipeline<MorselSplitter<Source>, Prev> & chain)
+		{
+			return chain.module();
+		}
+	};
+
+	/// End of a part of a pipeline run by several threads at once. The part
+	/// between split_morsels() and here is copied once per thread, and every
+	/// copy works on morsels of the stream handed out by a MorselScheduler.
+	/// The batches are merged back into a single stream, in their original
+	/// order if asked to.
+	template<class Source>
+	class MorselMerger
+	{
+		enum { MORSELS_PER_THREAD = 4 };
+
+		typedef typename MorselSegment<Source>::Splitter Splitter;
+		typedef typename Splitter::Scheduler Scheduler;
+		typedef std::map<size_t, RowBatch*> Results;
+
+		/// Row source. We don't own it, so no deletes.
+		Source * source_;
+		size_t threads_;
+		MergeOrder order_;
+		RowDef rowDef_;
+		Scheduler * scheduler_;
+		std::vector<Source*> replicas_;
+		boost::thread_group workers_;
+
+		/// Guards everything below.
+		boost::mutex mutex_;
+		boost::condition_variable ready_;
+		/// Finished batches by sequence number. Null for morsels that
+		/// produced no batch.
+		Results results_;
+		size_t nextSequence_;
+		size_t running_;
+		bool stopping_;
+		std::string error_;
+		std::vector<RowBatch*> free_;
+		std::vector<RowBatch*> carriers_;
+
+		// Only used down the stream.
+		bool started_;
+		RowBatch current_;
+		size_t currentRow_;
+
+		MorselMerger & operator=(const MorselMerger &);
+
+		RowBatch * acquire()
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			if(free_.empty())
+			{
+				carriers_.push_back(new RowBatch);
+				return carriers_.back();
+			}
+			RowBatch * batch = free_.back();
+			free_.pop_back();
+			return batch;
+		}
+
+		void work(size_t worker)
+		{
+			Source & replica = *replicas_[worker];
+			std::vector<size_t> taken;
+			bool failed = true;
+			try
+			{
+				for(;;)
+				{
+					RowBatch * result = acquire();
+					const bool more = replica.nextBatch(*result);
+					scheduler_->takeSequences(worker, taken);
+
+					boost::mutex::scoped_lock lock(mutex_);
+					for(size_t index = 0; index + 1 < taken.size(); ++index)
+						results_[taken[index]] = 0;
+					if(!taken.empty())
+						results_[taken.back()] = more ? result : 0;
+					if(!more || taken.empty())
+						free_.push_back(result);
+					ready_.notify_all();
+					if(!more || stopping_)
+						break;
+				}
+				failed = false;
+			}
+			catch(std::exception & e)
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				error_ = e.what();
+			}
+			catch(...)
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				error_ = "Unknown exception caught";
+			}
+
+			if(failed)
+				scheduler_->stop();
+			boost::mutex::scoped_lock lock(mutex_);
+			--running_;
+			ready_.notify_all();
+		}
+
+		void start()
+		{
+			started_ = true;
+			running_ = replicas_.size();
+			for(size_t worker = 0; worker != replicas_.size(); ++worker)
+				workers_.create_thread(boost::bind(&MorselMerger::work, this, worker));
+		}
+
+		void halt()
+		{
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				stopping_ = true;
+			}
+			if(scheduler_)
+				scheduler_->stop();
+			workers_.join_all();
+		}
+
+		/// Gives back the rows of the current batch that were dropped from
+		/// its selection, which next() never hands out.
+		void releaseDropped()
+		{
+			if(current_.selected() == current_.size())
+				return;
+
+			bool selected[RowBatch::CAPACITY] = {};
+			for(size_t index = 0; index != current_.selected(); ++index)
+				selected[current_.selection()[index]] = true;
+			for(size_t index = 0; index != current_.size(); ++index)
+			{
+				if(!selected[index])
+					scheduler_->release(current_.row(index));
+			}
+		}
+
+	public:
+		/// Uses as many threads as there are cores if threads is zero.
+		MorselMerger(size_t threads, MergeOrder order)
+			: source_(0), threads_(threads), order_(order), scheduler_(0), nextSequence_(0), running_(0),
+			stopping_(false), started_(false), currentRow_(0)
+		{
+		}
+
+		MorselMerger(const MorselMerger & other)
+			: source_(0), threads_(other.threads_), order_(other.order_), scheduler_(0), nextSequence_(0),
+			running_(0), stopping_(false), started_(false), currentRow_(0)
+		{
+		}
+
+		~MorselMerger()
+		{
+			halt();
+			for(typename std::vector<Source*>::iterator replica = replicas_.begin(); replica != replicas_.end(); ++replica)
+				delete *replica;
+			for(std::vector<RowBatch*>::iterator batch = carriers_.begin(); batch != carriers_.end(); ++batch)
+				delete *batch;
+		}
+
+		void source(Source * source)
+		{
+			source_ = source;
+		}
+
+		void init()
+		{
+			source_->init();
+			rowDef_ = source_->rowDef();
+			scheduler_ = &MorselSegment<Source>::splitter(*source_).scheduler();
+
+			if(threads_ == 0)
+				threads_ = std::max(1u, boost::thread::hardware_concurrency());
+			scheduler_->limit(threads_ * MORSELS_PER_THREAD);
+
+			// The copies share the scheduler of the original, which is
+			// attached already, so they don't initialize the source again.
+			for(size_t worker = 0; worker != threads_; ++worker)
+			{
+				replicas_.push_back(new Source(*source_));
+				replicas_.back()->init();
+			}
+		}
+
+		bool plan(PipelinePlan & plan)
+		{
+			if(!plan.layout)
+				plan.layout = &rowDef_;
+			const bool planned = source_->plan(plan);
+			for(typename std::vector<Source*>::iterator replica = replicas_.begin(); replica != replicas_.end(); ++replica)
+				(*replica)->plan(plan);
+			return planned;
+		}
+
+		const RowDef & rowDef()
+		{
+			return rowDef_;
+		}
+
+		bool nextBatch(RowBatch & batch)
+		{
+			batch.clear();
+			if(stopping_)
+				return false;
+			if(!started_)
+				start();
+
+			RowBatch * result = 0;
+			size_t consumed = 0;
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				while(!result)
+				{
+					if(!error_.empty())
+						throw std::runtime_error(error_);
+
+					Results::iterator next = order_ == MERGE_ORDERED ? results_.find(nextSequence_) : results_.begin();
+					// Once every worker is done, whatever is left goes.
+					if(next == results_.end() && running_ == 0)
+						next = results_.begin();
+
+					if(next != results_.end())
+					{
+						nextSequence_ = next->first + 1;
+						result = next->second;
+						results_.erase(next);
+						++consumed;
+					}
+					else if(running_ == 0)
+					{
+						break;
+					}
+					else
+					{
+						ready_.wait(lock);
+					}
+				}
+			}
+
+			if(consumed)
+				scheduler_->consumed(consumed);
+			if(!result)
+				return false;
+
+			batch.assign(*result);
+			result->clear();
+			boost::mutex::scoped_lock lock(mutex_);
+			free_.push_back(result);
+			return true;
+		}
+
+		/// Stops the workers, and then the stream up from the replicated part.
+		/// No more rows come out.
+		void stop()
+		{
+			halt();
+			source_->stop();
+		}
+
+		/// Rows go straight back to the source of the replicated part, which
+		/// replicable stages allow.
+		void releaseBatch(RowBatch & batch)
+		{
+			scheduler_->releaseBatch(batch);
+		}
+
+		Row * next()
+		{
+			while(currentRow_ == current_.selected())
+			{
+				releaseDropped();
+				currentRow_ = 0;
+				if(!nextBatch(current_))
+					return 0;
+			}
+			return current_.selectedRow(currentRow_++);
+		}
+
+		void release(Row * row)
+		{
+			scheduler_->release(row);
+		}
+	};
+
+	/// Bridge class used in the pipeline construction syntax.
+	class MorselSplitterPrototype
+	{
+	public:
+		template<class Source>
+		struct ForSource
+		{
+			typedef MorselSplitter<Source> Type;
+		};
+
+		template<class Source>
+		MorselSplitter<Source> create() const
+		{
+			return MorselSplitter<Source>();
+		}
+	};
+
+	/// Bridge class used in the pipeline construction syntax.
+	class MorselMergerPrototype
+	{
+		size_t threads_;
+		MergeOrder order_;
+	public:
+		template<class Source>
+		struct ForSource
+		{
+			typedef MorselMerger<Source> Type;
+		};
+
+		MorselMergerPrototype(size_t threads, MergeOrder order)
+			: threads_(threads), order_(order)
+		{
+		}
+
+		template<class Source>
+		MorselMerger<Source> create() const
+		{
+			return MorselMerger<Source>(threads_, order_);
+		}
+	};
+
+	/// Starts a part of a pipeline to be run by several threads, each with
+	/// its own copy of the stages, on batches of the stream:
+	/// read_text_file(...) >> split_morsels() >> set_column(...) >> merge_morsels() >> write_text_file(...)
+	MorselSplitterPrototype split_morsels()
+	{
+		return MorselSplitterPrototype();
+	}
+
+	/// Ends a part of a pipeline started by split_morsels(), running it on
+	/// as many threads as there are cores if threads is zero.
+	MorselMergerPrototype merge_morsels(size_t threads = 0, MergeOrder order = MERGE_ORDERED)
+	{
+		return MorselMergerPrototype(threads, order);
+	}
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef ROWSTREAMS_OUTPUT_BUFFER_HPP
+#define ROWSTREAMS_OUTPUT_BUFFER_HPP
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+namespace RowStreams
+{
+	/// Growable character buffer that values are formatted into. Meant to
+	/// be reused: clear() keeps the memory, so once it has grown to its
+	/// working size no more allocations happen.
+	class OutputBuffer
+	{
+		std::vector<char> data_;
+		size_t size_;
+
+		OutputBuffer(const OutputBuffer &);
+		OutputBuffer & operator=(const OutputBuffer &);
+
+	public:
+		explicit OutputBuffer(size_t capacity = 0)
+			: data_(std::max(capacity, size_t(1))), size_(0)
+		{
+		}
+
+		/// Makes room for at least length more characters and returns where
+		/// they go. Call commit() with the number actually written.
+		char * reserve(size_t length)
+		{
+			if(size_ + length > data_.size())
+				data_.resize(std::max(data_.size() * 2, size_ + length));
+			return &data_[0] + size_;
+		}
+
+		void commit(size_t length)
+		{
+			size_ += length;
+		}
+
+		void append(char c)
+		{
+			*reserve(1) = c;
+			++size_;
+		}
+
+		void append(const char * str, size_t length)
+		{
+			if(length)
+				::memcpy(reserve(length), str, length);
+			size_ += length;
+		}
+
+		const char * data() const
+		{
+			return &data_[0];
+		}
+
+		size_t size() const
+		{
+			return size_;
+		}
+
+		bool empty() const
+		{
+			return size_ == 0;
+		}
+
+		void clear()
+		{
+			size_ = 0;
+		}
+	};
+}
+
+#endif
\ No newline at end of file
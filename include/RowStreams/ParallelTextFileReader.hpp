@@ -0,0 +1,501 @@
+#ifndef ROWSTREAMS_PARALLEL_TEXT_FILE_READER_HPP
+#define ROWSTREAMS_PARALLEL_TEXT_FILE_READER_HPP
+
+#include "RowStreams/Row.hpp"
+#include "RowStreams/Pipeline.hpp"
+#include "RowStreams/TextRowParser.hpp"
+#include "RowStreams/SchemaRowParser.hpp"
+#include "RowStreams/RowPredicate.hpp"
+#include "RowStreams/RowPool.hpp"
+#include "RowStreams/RowBatch.hpp"
+#include <vector>
+#include <deque>
+#include <string>
+#include <stdexcept>
+#include <cstring>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+namespace RowStreams
+{
+	/// Order in which ParallelTextFileReader hands out rows.
+	enum ParallelReadOrder
+	{
+		/// Rows come out in the same order as in the file.
+		READ_ORDERED,
+		/// Rows come out as soon as any worker has parsed them, which keeps
+		/// every worker busy all the time.
+		READ_UNORDERED
+	};
+
+	/// Reads the same kind of files as TextFlatFileReader, but splits the memory
+	/// mapped file into byte ranges cut at row boundaries and tokenizes and parses
+	/// them on several worker threads. The header is parsed only once.
+	/// Rows are recycled through a pool shared by all workers.
+	/// Fields are parsed by a TextRowParser, or a SchemaRowParser.
+	template<class RowParser = TextRowParser>
+	class BasicParallelTextFileReader
+	{
+		enum
+		{
+			BLOCK_ROWS = 1024,
+			MIN_RANGE_SIZE = 1 << 20,
+			RANGES_PER_THREAD = 8,
+			/// Parsed chunks that may wait to be handed out, per worker.
+			CHUNKS_PER_THREAD = 4
+		};
+
+		typedef std::vector<Row*> Chunk;
+
+		/// A part of the file made of whole rows, parsed by a single worker.
+		struct Range
+		{
+			const char * begin;
+			const char * end;
+			/// Parsed chunks not yet handed out, when reading in order.
+			std::deque<Chunk*> chunks;
+			bool done;
+		};
+
+		RowDef            rowDef_;
+		std::string       fileName_;
+		size_t            threads_;
+		ParallelReadOrder order_;
+		Tokenizer         tokenizer_;
+		RowParser         parser_;
+		/// Predicates of the filters down the stream, checked by the workers
+		/// while parsing.
+		PushedPredicates  predicates_;
+		boost::iostreams::mapped_file_source mapped_;
+
+		std::vector<Range> ranges_;
+		boost::thread_group workers_;
+
+		/// Guards everything below, plus the chunks of every range.
+		boost::mutex      mutex_;
+		RowPool           pool_;
+		/// Emptied chunks, kept for reuse.
+		std::vector<Chunk*> freeChunks_;
+		boost::condition_variable produced_;
+		boost::condition_variable consumed_;
+		/// Next range to be picked up by a worker.
+		size_t            nextRange_;
+		/// Range rows are handed out from, when reading in order.
+		size_t            headRange_;
+		size_t            rangesDone_;
+		/// Parsed chunks, when reading in any order.
+		std::deque<Chunk*> ready_;
+		/// Number of parsed chunks not yet handed out.
+		size_t            pending_;
+		size_t            parseErrors_;
+		bool              started_;
+		bool              stopping_;
+		std::string       error_;
+
+		/// Chunk rows are currently handed out from. Only used by the consumer.
+		Chunk *           current_;
+		size_t            currentRow_;
+		/// Rows released by the consumer, returned to the pool in bulk
+		/// whenever it fetches a chunk. Only used by the consumer.
+		std::vector<Row*> released_;
+
+		/// Gets an empty chunk holding fresh rows from the pool.
+		Chunk * acquireChunk(size_t rows)
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			Chunk * chunk;
+			if(freeChunks_.empty())
+			{
+				chunk = new Chunk;
+			}
+			else
+			{
+				chunk = freeChunks_.back();
+				freeChunks_.pop_back();
+			}
+
+			for(size_t row = 0; row != rows; ++row)
+				chunk->push_back(pool_.acquire());
+			return chunk;
+		}
+
+		/// Keeps a chunk for reuse, returning its rows to the pool first if
+		/// they were never handed out. Must be called with the mutex held.
+		void recycleChunk(Chunk * chunk, bool with_rows)
+		{
+			if(with_rows)
+				std::for_each(chunk->begin(), chunk->end(), boost::bind(&RowPool::release, &pool_, _1));
+			chunk->clear();
+			freeChunks_.push_back(chunk);
+		}
+
+		/// Gives the rows of a chunk past the first kept back to the pool.
+		void releaseRows(Chunk & chunk, size_t kept)
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			std::for_each(chunk.begin() + kept, chunk.end(), boost::bind(&RowPool::release, &pool_, _1));
+			chunk.resize(kept);
+		}
+
+		static void deleteChunk(Chunk * chunk)
+		{
+			delete chunk;
+		}
+
+		/// Cuts the body of the file into ranges that end right after a row separator.
+		void splitRanges(const char * begin, const char * end)
+		{
+			const size_t wanted = threads_ * RANGES_PER_THREAD;
+			const size_t range_size = std::max(size_t(MIN_RANGE_SIZE), size_t(end - begin) / wanted);
+
+			ranges_.clear();
+			while(begin != end)
+			{
+				const char * cut = end;
+				if(size_t(end - begin) > range_size)
+				{
+					const char * eol = static_cast<const char*>(
+						::memchr(begin + range_size, tokenizer_.rowSep(), end - begin - range_size));
+					if(eol)
+						cut = eol + 1;
+				}
+
+				Range range;
+				range.begin = begin;
+				range.end = cut;
+				range.done = false;
+				ranges_.push_back(range);
+				begin = cut;
+			}
+		}
+
+		/// Queues a parsed chunk, waiting while too many are pending. The worker
+		/// of the range being handed out in order never waits, or it could stall
+		/// the consumer. Returns false when the reader is stopping.
+		bool deliver(size_t range, Chunk * chunk, size_t errors)
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			while(!stopping_ && pending_ >= threads_ * CHUNKS_PER_THREAD
+				&& !(order_ == READ_ORDERED && range == headRange_))
+			{
+				consumed_.wait(lock);
+			}
+
+			if(stopping_)
+			{
+				recycleChunk(chunk, true);
+				return false;
+			}
+
+			if(order_ == READ_ORDERED)
+				ranges_[range].chunks.push_back(chunk);
+			else
+				ready_.push_back(chunk);
+			++pending_;
+			parseErrors_ += errors;
+			produced_.notify_one();
+			return true;
+		}
+
+		void parseRange(size_t range, TokenBlock & block)
+		{
+			const char * pos = ranges_[range].begin;
+			const char * const end = ranges_[range].end;
+			while(pos != end)
+			{
+				const size_t consumed = tokenizer_.scan(pos, end, BLOCK_ROWS, block, true);
+
+				Chunk * chunk = acquireChunk(block.numRows());
+				size_t errors = 0;
+				size_t kept = 0;
+				for(size_t row = 0; row != block.numRows(); ++row)
+				{
+					// Rows that fail the predicates are used again for the next one.
+					if(predicates_.parse(parser_, block, pos, row, *(*chunk)[kept], errors))
+						++kept;
+				}
+				pos += consumed;
+				if(kept != chunk->size())
+					releaseRows(*chunk, kept);
+
+				if(!deliver(range, chunk, errors))
+					return;
+			}
+
+			boost::mutex::scoped_lock lock(mutex_);
+			ranges_[range].done = true;
+			++rangesDone_;
+			produced_.notify_one();
+		}
+
+		void work()
+		{
+			TokenBlock block;
+			try
+			{
+				for(;;)
+				{
+					size_t range;
+					{
+						boost::mutex::scoped_lock lock(mutex_);
+						if(stopping_ || nextRange_ == ranges_.size())
+							return;
+						range = nextRange_++;
+					}
+					parseRange(range, block);
+				}
+			}
+			catch(std::exception & e)
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				error_ = e.what();
+				stopping_ = true;
+				produced_.notify_one();
+				consumed_.notify_all();
+			}
+		}
+
+		/// Recycles the chunk the consumer is done with and waits for the next
+		/// one. Returns 0 when all have been handed out.
+		Chunk * nextChunk(Chunk * done)
+		{
+			if(!started_ && !stopping_)
+				start();
+
+			boost::mutex::scoped_lock lock(mutex_);
+			if(done)
+				recycleChunk(done, false);
+			std::for_each(released_.begin(), released_.end(), boost::bind(&RowPool::release, &pool_, _1));
+			released_.clear();
+
+			for(;;)
+			{
+				if(!error_.empty())
+					throw std::runtime_error("Failed to read "+fileName_+": "+error_);
+				if(stopping_)
+					return 0;
+
+				std::deque<Chunk*> * queue = &ready_;
+				if(order_ == READ_ORDERED)
+				{
+					while(headRange_ != ranges_.size()
+						&& ranges_[headRange_].done && ranges_[headRange_].chunks.empty())
+					{
+						++headRange_;
+						// The worker of the new head range may be waiting.
+						consumed_.notify_all();
+					}
+					if(headRange_ == ranges_.size())
+						return 0;
+					queue = &ranges_[headRange_].chunks;
+				}
+				else if(ready_.empty() && rangesDone_ == ranges_.size())
+				{
+					return 0;
+				}
+
+				if(!queue->empty())
+				{
+					Chunk * chunk = queue->front();
+					queue->pop_front();
+					--pending_;
+					consumed_.notify_all();
+					return chunk;
+				}
+				produced_.wait(lock);
+			}
+		}
+
+		/// Workers are started when the first rows are wanted rather than at
+		/// init(), so that the stream can be planned before any row is made.
+		void start()
+		{
+			started_ = true;
+			for(size_t thread = 0; thread != threads_; ++thread)
+				workers_.create_thread(boost::bind(&BasicParallelTextFileReader::work, this));
+		}
+
+		void halt()
+		{
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				stopping_ = true;
+				consumed_.notify_all();
+			}
+			workers_.join_all();
+
+			for(typename std::vector<Range>::iterator range = ranges_.begin(); range != ranges_.end(); ++range)
+			{
+				std::for_each(range->chunks.begin(), range->chunks.end(), &deleteChunk);
+				range->chunks.clear();
+			}
+			std::for_each(ready_.begin(), ready_.end(), &deleteChunk);
+			ready_.clear();
+			std::for_each(freeChunks_.begin(), freeChunks_.end(), &deleteChunk);
+			freeChunks_.clear();
+			delete current_;
+			current_ = 0;
+		}
+
+	public:
+		/// Uses as many worker threads as there are cores if threads is zero.
+		BasicParallelTextFileReader(const RowDef & rowDef, const std::string & file_name, size_t threads = 0,
+			ParallelReadOrder order = READ_ORDERED, const char sep = '\t')
+			: rowDef_(rowDef), fileName_(file_name), threads_(threads), order_(order), tokenizer_(sep),
+			nextRange_(0), headRange_(0), rangesDone_(0), pending_(0), parseErrors_(0), started_(false), stopping_(false),
+			current_(0), currentRow_(0)
+		{
+		}
+
+		BasicParallelTextFileReader(const BasicParallelTextFileReader & other)
+			: rowDef_(other.rowDef_), fileName_(other.fileName_), threads_(other.threads_), order_(other.order_),
+			tokenizer_(other.tokenizer_), nextRange_(0), headRange_(0), rangesDone_(0), pending_(0),
+			parseErrors_(0), started_(false), stopping_(false), current_(0), currentRow_(0)
+		{
+		}
+
+		~BasicParallelTextFileReader()
+		{
+			halt();
+		}
+
+		void init()
+		{
+			try
+			{
+				mapped_.open(fileName_);
+			}
+			catch(std::exception &)
+			{
+				throw std::runtime_error("Failed to map "+fileName_);
+			}
+			const char * begin = mapped_.data();
+			const char * const end = begin + mapped_.size();
+
+			// The header is parsed once, and its mapping shared by all workers.
+			TokenBlock header;
+			begin += tokenizer_.scan(begin, end, 1, header, true);
+			if(header.numRows())
+				parser_.mapHeader(rowDef_, header, mapped_.data(), 0);
+
+			pool_.rowDef(&rowDef_);
+			if(threads_ == 0)
+				threads_ = std::max(1u, boost::thread::hardware_concurrency());
+			splitRanges(begin, end);
+		}
+
+		/// Rows are created with the planned layout, so that they have room
+		/// for the columns added down the stream. Only the fields of columns
+		/// read down the stream are parsed, and the predicates that only read
+		/// columns of the file are checked by the workers as soon as
+		/// their fields are parsed.
+		bool plan(PipelinePlan & plan)
+		{
+			if(plan.layout)
+				pool_.rowDef(plan.layout);
+			if(!plan.allColumns)
+				parser_.project(plan.usedColumns);
+			predicates_.take(plan.predicates, rowDef_);
+			parser_.prioritize(predicates_.columns());
+			return true;
+		}
+
+		Row * next()
+		{
+			while(!current_ || currentRow_ == current_->size())
+			{
+				current_ = nextChunk(current_);
+				currentRow_ = 0;
+				if(!current_)
+					return 0;
+			}
+			return (*current_)[currentRow_++];
+		}
+
+		/// Stops the workers, and no more rows come out.
+		void stop()
+		{
+			halt();
+		}
+
+		/// Takes back a row handed out by next() for reuse.
+		void release(Row * row)
+		{
+			released_.push_back(row);
+		}
+
+		bool nextBatch(RowBatch & batch)
+		{
+			batch.clear();
+			while(!batch.full())
+			{
+				if(!current_ || currentRow_ == current_->size())
+				{
+					current_ = nextChunk(current_);
+					currentRow_ = 0;
+					if(!current_)
+						break;
+				}
+
+				const size_t count = std::min(current_->size() - currentRow_, RowBatch::CAPACITY - batch.size());
+				for(size_t index = 0; index != count; ++index)
+					batch.add((*current_)[currentRow_++]);
+			}
+			return !batch.empty();
+		}
+
+		void releaseBatch(RowBatch & batch)
+		{
+			for(size_t index = 0; index != batch.size(); ++index)
+				released_.push_back(batch.row(index));
+			batch.clear();
+		}
+
+		template<class T>
+		void source(T* src)
+		{
+		}
+
+		const RowDef & rowDef()
+		{
+			return rowDef_;
+		}
+
+		/// Number of fields in the chunks handed out so far that could not be
+		/// parsed and were left null.
+		size_t parseErrors()
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			return parseErrors_;
+		}
+	};
+
+	typedef BasicParallelTextFileReader<> ParallelTextFileReader;
+
+	/// Bridge used in the pipeline construction syntax.
+	/// Reads a text file with several threads, as many as there are cores if threads is zero.
+	PartialPipeline<ParallelTextFileReader>
+		read_text_file_parallel(const RowDef & row_def, const std::string & file_name, size_t threads = 0,
+			ParallelReadOrder order = READ_ORDERED, const char sep = '\t')
+	{
+		return PartialPipeline<ParallelTextFileReader>(NoModule(),
+			ParallelTextFileReader(row_def, file_name, threads, order, sep));
+	}
+
+	/// Reads rows laid out by a Schema with several threads.
+	/// Call as read_text_file_parallel<MySchema>(file_name).
+	template<class SchemaType>
+	PartialPipeline<BasicParallelTextFileReader<SchemaRowParser<SchemaType> > >
+		read_text_file_parallel(const std::string & file_name, size_t threads = 0,
+			ParallelReadOrder order = READ_ORDERED, const char sep = '\t')
+	{
+		typedef BasicParallelTextFileReader<SchemaRowParser<SchemaType> > Reader;
+		return PartialPipeline<Reader>(NoModule(), Reader(SchemaType::rowDef(), file_name, threads, order, sep));
+	}
+
+}
+
+#endif
\ No newline at end of file
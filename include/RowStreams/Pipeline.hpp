@@ -1,6 +1,10 @@
 #ifndef ROWSTREAMS_PIPELINE_HPP
 #define ROWSTREAMS_PIPELINE_HPP
 
+#include "RowStreams/RowBatch.hpp"
+#include "RowStreams/PipelinePlan.hpp"
+#include "RowStreams/StageTraits.hpp"
+
 namespace RowStreams
 {
 	class NoModule {};
@@ -33,16 +37,57 @@ namespace RowStreams
 			module_.init();
 		}
 
+		/// Passes a plan up the stream. @see PipelinePlan.hpp
+		bool plan(PipelinePlan & plan)
+		{
+			return PlanAdapter<Module>::plan(module_, plan);
+		}
+
 		Row * next()
 		{
 			return module_.next();
 		}
 
+		void release(Row * row)
+		{
+			module_.release(row);
+		}
+
+		/// Batch entry points, which also work for modules that only
+		/// move one row at a time. @see RowBatch.hpp
+		bool nextBatch(RowBatch & batch)
+		{
+			return BatchAdapter<Module>::nextBatch(module_, batch);
+		}
+
+		void releaseBatch(RowBatch & batch)
+		{
+			BatchAdapter<Module>::releaseBatch(module_, batch);
+		}
+
+		/// Tells the stage no more rows will be pulled. @see StageTraits.hpp
+		void stop()
+		{
+			StopAdapter<Module>::stop(module_);
+		}
+
 		const RowDef & rowDef()
 		{
 			return module_.rowDef();
 		}
 
+		/// The stage itself and the part of the pipeline before it, for
+		/// stages that need to reach into the pipeline they pull from.
+		Module & module()
+		{
+			return module_;
+		}
+
+		PrevModule & prev()
+		{
+			return prev_;
+		}
+
 		void run()
 		{
 			module_.run();
@@ -88,6 +133,8 @@ namespace RowStreams
 			void run()
 			{
 				wrapped_.init();
+				PipelinePlan plan;
+				wrapped_.plan(plan);
 				wrapped_.run();
 			}
 		};
@@ -0,0 +1,121 @@
+#ifndef ROWSTREAMS_PIPELINE_PLAN_HPP
+#define ROWSTREAMS_PIPELINE_PLAN_HPP
+
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/RowPredicate.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+
+namespace RowStreams
+{
+	/// Decisions about a whole stream that can only be taken once every stage
+	/// has been initialized. A plan is handed from the sink up to the source
+	/// through the plan() method of every stage, after init() and before the
+	/// first row is pulled.
+	///
+	/// Stages that only add columns to the rows they get (ColumnAdder) or
+	/// leave the layout alone pass the plan on untouched, so the source gets
+	/// the layout at the end of the stream and allocates its rows with room
+	/// for every column added on the way. Stages that build rows of their own
+	/// start a new plan for their source.
+	///
+	/// Filter stages also offer their predicates to the source, which checks
+	/// them as it creates rows when it can, so that rejected rows are never
+	/// made in full. Stages that change the values of a column withhold the
+	/// predicates that read it.
+	///
+	/// Sinks that only read some columns list them, and every stage on the
+	/// way adds the columns it reads, so that the source can leave the rest
+	/// null instead of parsing them.
+	struct PipelinePlan
+	{
+		/// Layout the rows need to fit, or null while no stage has set it.
+		/// Its columns start with those of every stage up the stream.
+		const RowDef * layout;
+		/// Predicates of the filters down the stream. A source that takes
+		/// one marks it pushed.
+		std::vector<RowPredicate*> predicates;
+		/// Whether every column may be read down the stream. If not, only
+		/// those in usedColumns are.
+		bool allColumns;
+		std::vector<std::string> usedColumns;
+
+		PipelinePlan()
+			: layout(0), allColumns(true)
+		{
+		}
+
+		/// Tells whether a column is read down the stream.
+		bool used(const std::string & column) const
+		{
+			return allColumns || std::find(usedColumns.begin(), usedColumns.end(), column) != usedColumns.end();
+		}
+
+		/// Adds columns read by a stage.
+		void use(const std::vector<std::string> & columns)
+		{
+			for(std::vector<std::string>::const_iterator column = columns.begin(); column != columns.end(); ++column)
+			{
+				if(!used(*column))
+					usedColumns.push_back(*column);
+			}
+		}
+
+		/// Tells that a stage sets the values of a column, so the values up
+		/// the stream are not read unless the stage uses them itself.
+		void written(const std::string & column)
+		{
+			usedColumns.erase(std::remove(usedColumns.begin(), usedColumns.end(), column), usedColumns.end());
+		}
+
+		/// Takes back the predicates that read a column, for stages that
+		/// change its values.
+		void withhold(const std::string & column)
+		{
+			for(size_t index = predicates.size(); index-- != 0; )
+			{
+				if(predicates[index]->uses(column))
+					predicates.erase(predicates.begin() + index);
+			}
+		}
+	};
+
+	/// Tells whether a stage takes part in planning. plan() returns true if
+	/// the rows coming out of the stage follow the plan, that is, they are
+	/// created with the planned layout.
+	template<class Stage>
+	struct HasPlan
+	{
+		typedef char Yes;
+		typedef char (&No)[2];
+
+		template<class T, bool (T::*)(PipelinePlan &)> struct Check;
+		template<class T> static Yes test(Check<T, &T::plan> *);
+		template<class T> static No test(...);
+
+		enum { value = sizeof(test<Stage>(0)) == sizeof(Yes) };
+	};
+
+	/// Lets stages without a plan() method be part of a pipeline. Planning
+	/// stops at them, and rows going through them are not planned.
+	template<class Stage, bool planned = HasPlan<Stage>::value>
+	struct PlanAdapter
+	{
+		static bool plan(Stage &, PipelinePlan &)
+		{
+			return false;
+		}
+	};
+
+	template<class Stage>
+	struct PlanAdapter<Stage, true>
+	{
+		static bool plan(Stage & stage, PipelinePlan & plan)
+		{
+			return stage.plan(plan);
+		}
+	};
+}
+
+#endif
\ No newline at end of file
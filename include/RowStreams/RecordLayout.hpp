@@ -0,0 +1,185 @@
+#ifndef ROWSTREAMS_RECORD_LAYOUT_HPP
+#define ROWSTREAMS_RECORD_LAYOUT_HPP
+
+#include "RowStreams/Row.hpp"
+#include "RowStreams/RowDef.hpp"
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstring>
+#include <boost/cstdint.hpp>
+
+namespace RowStreams
+{
+	/// Order of the rows out of Sort and TopK.
+	enum SortOrder
+	{
+		/// Least values first, and nulls before everything.
+		SORT_ASCENDING,
+		/// Greatest values first, and nulls after everything.
+		SORT_DESCENDING
+	};
+
+	/// How Sort and TopK copy rows into records of a fixed size: the
+	/// normalized key, then the null bitmap of the row in whole words, then
+	/// the bytes of the row as laid out by the RowDef, each part padded to a
+	/// multiple of 8 bytes. Every column of the key takes a byte that is zero
+	/// when the value is null, followed by the value as written by
+	/// ColumnDef::normalize(), or zeros, so keys compare with memcmp in the
+	/// sort order. For a descending order every bit of the key is flipped.
+	///
+	/// The bytes that external columns, like long strings, point to are
+	/// appended to a heap kept by the stage, and records of rows with such
+	/// columns hold the offset and size of theirs between the key and the
+	/// null bitmap. Sort keys cannot be external.
+	class RecordLayout
+	{
+		std::vector<const ColumnDef*> keyColumns_;
+		std::vector<const ColumnDef*> externalColumns_;
+		SortOrder order_;
+		size_t numColumns_;
+		size_t rowSize_;
+		size_t keySize_;
+		size_t stringsSize_;
+		size_t nullsSize_;
+		size_t size_;
+
+	public:
+		RecordLayout()
+			: order_(SORT_ASCENDING), numColumns_(0), rowSize_(0), keySize_(0), stringsSize_(0), nullsSize_(0),
+			size_(0)
+		{
+		}
+
+		/// Lays out records for the rows of rowDef, sorted by the given
+		/// columns. Keeps pointers to the columns of rowDef.
+		void init(const RowDef & rowDef, const std::vector<std::string> & columns, SortOrder order)
+		{
+			keyColumns_.clear();
+			order_ = order;
+			keySize_ = 0;
+			for(std::vector<std::string>::const_iterator name = columns.begin(); name != columns.end(); ++name)
+			{
+				const ColumnDef * columnDef = rowDef.columnDef(*name);
+				if(!columnDef)
+					throw std::runtime_error("No sort column "+*name);
+				if(columnDef->encoded())
+					throw std::runtime_error("Column "+*name+" is dictionary encoded and cannot be a sort key");
+				if(columnDef->external())
+					throw std::runtime_error("Column "+*name+" points outside the row and cannot be a sort key");
+				keyColumns_.push_back(columnDef);
+				keySize_ += 1 + columnDef->size();
+			}
+			keySize_ = (keySize_ + 7) / 8 * 8;
+			// Records outlive the rows, and the bytes these point to.
+			externalColumns_.clear();
+			for(RowDef::ConstAttrIter column = rowDef.begin(); column != rowDef.end(); ++column)
+			{
+				if((*column)->external())
+					externalColumns_.push_back(*column);
+			}
+			stringsSize_ = externalColumns_.empty() ? 0 : 2 * sizeof(boost::uint64_t);
+			numColumns_ = rowDef.numColumns();
+			nullsSize_ = (numColumns_ + Row::NULL_WORD_BITS - 1) / Row::NULL_WORD_BITS * sizeof(Row::NullWord);
+			rowSize_ = rowDef.size();
+			size_ = keySize_ + stringsSize_ + nullsSize_ + (rowSize_ + 7) / 8 * 8;
+		}
+
+		/// Size of the key at the start of every record, a multiple of 8.
+		size_t keySize() const
+		{
+			return keySize_;
+		}
+
+		/// Size of a record, a multiple of 8.
+		size_t size() const
+		{
+			return size_;
+		}
+
+		/// Whether records have bytes in a heap.
+		bool external() const
+		{
+			return !externalColumns_.empty();
+		}
+
+		/// Offset in the heap of the bytes of a record.
+		boost::uint64_t stringsOffset(const char * record) const
+		{
+			boost::uint64_t offset = 0;
+			if(stringsSize_)
+				::memcpy(&offset, record + keySize_, sizeof(offset));
+			return offset;
+		}
+
+		/// Number of bytes of a record in the heap.
+		size_t stringsSize(const char * record) const
+		{
+			boost::uint64_t size = 0;
+			if(stringsSize_)
+				::memcpy(&size, record + keySize_ + sizeof(boost::uint64_t), sizeof(size));
+			return size_t(size);
+		}
+
+		/// Tells a record that its bytes moved to another offset in the heap.
+		void moveStrings(char * record, boost::uint64_t offset) const
+		{
+			if(stringsSize_)
+				::memcpy(record + keySize_, &offset, sizeof(offset));
+		}
+
+		/// Writes the key of a row into keySize() bytes.
+		void packKey(const Row & row, char * key) const
+		{
+			::memset(key, 0, keySize_);
+			char * pos = key;
+			for(std::vector<const ColumnDef*>::const_iterator column = keyColumns_.begin(); column != keyColumns_.end(); ++column)
+			{
+				if(!row.isNull((*column)->index()))
+				{
+					pos[0] = 1;
+					(*column)->normalize(row, pos + 1);
+				}
+				pos += 1 + (*column)->size();
+			}
+			if(order_ == SORT_DESCENDING)
+			{
+				for(char * flip = key; flip != key + keySize_; ++flip)
+					*flip = char(~*flip);
+			}
+		}
+
+		/// Turns a row into a record of size() bytes, appending the bytes its
+		/// columns point to onto heap.
+		void pack(const Row & row, char * record, std::vector<char> & heap) const
+		{
+			packKey(row, record);
+			const boost::uint64_t offset = heap.size();
+			for(std::vector<const ColumnDef*>::const_iterator column = externalColumns_.begin();
+				column != externalColumns_.end(); ++column)
+				(*column)->stash(row, heap);
+			if(stringsSize_)
+			{
+				const boost::uint64_t size = heap.size() - offset;
+				::memcpy(record + keySize_, &offset, sizeof(offset));
+				::memcpy(record + keySize_ + sizeof(offset), &size, sizeof(size));
+			}
+			row.storeValid(reinterpret_cast<Row::NullWord*>(record + keySize_ + stringsSize_), numColumns_);
+			::memcpy(record + keySize_ + stringsSize_ + nullsSize_, row.buffer(), rowSize_);
+		}
+
+		/// Turns a record back into a row, whose other columns are left as
+		/// they are. Its columns point to the stringsSize() bytes of the
+		/// record at strings, which must outlive the row.
+		void unpack(const char * record, const char * strings, Row & row) const
+		{
+			row.assignValid(reinterpret_cast<const Row::NullWord*>(record + keySize_ + stringsSize_), numColumns_);
+			::memcpy(row.buffer(), record + keySize_ + stringsSize_ + nullsSize_, rowSize_);
+			for(std::vector<const ColumnDef*>::const_iterator column = externalColumns_.begin();
+				column != externalColumns_.end(); ++column)
+				strings += (*column)->attach(row, strings);
+		}
+	};
+}
+
+#endif
\ No newline at end of file
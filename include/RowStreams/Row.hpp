@@ -2,8 +2,10 @@
 #define ROWSTREAMS_ROW_HPP
 
 #include "RowStreams/RowDef.hpp"
+#include "RowStreams/StringArena.hpp"
 #include <vector>
 #include <cstring>
+#include <algorithm>
 
 namespace RowStreams
 {
@@ -14,18 +16,39 @@ namespace RowStreams
 	/// to simple data types and PODs.
 	class Row
 	{
+	public:
+		typedef RowDef::NullWord NullWord;
+		enum { NULL_WORD_BITS = RowDef::NULL_WORD_BITS };
+
+	private:
 		const RowDef * rowDef_;
 		char * buf_;
+		/// Room for values in buf_, which may be bigger than needed by rowDef_.
+		size_t capacity_;
 		/// A bit for each column value in the row, where zero means
-		/// that column is null.
-		std::vector<bool> valueSet_;
+		/// that column is null. Lives in buf_, past the values.
+		NullWord * valid_;
+		size_t nullWords_;
+		/// Bytes of the values that do not fit in buf_, see StringRef.
+		StringArena arena_;
+
+		// Rows own their buffer and are passed around by pointer.
+		Row(const Row &);
+		Row & operator=(const Row &);
 
 	public:
 		Row(const RowDef * rowDef)
 			: rowDef_(rowDef), 
-			buf_(rowDef_->newBuffer())
+			buf_(rowDef_->newBuffer()),
+			capacity_(rowDef_->capacity()),
+			valid_(reinterpret_cast<NullWord*>(buf_ + RowDef::nullsOffset(capacity_))),
+			nullWords_(rowDef_->nullWords())
+		{
+		}
+
+		~Row()
 		{
-			valueSet_.assign(rowDef_->numColumns(), false);
+			delete [] buf_;
 		}
 
 		template<class T>
@@ -38,19 +61,79 @@ namespace RowStreams
 		T get(size_t index) const
 		{
 			size_t ofs = rowDef_->offset(index);
-			return get(index, ofs);
+			return get<T>(index, ofs);
 		}
 
 		bool isNull(size_t index) const
 		{
-			return !valueSet_[index];
+			return !(valid_[index / NULL_WORD_BITS] >> (index % NULL_WORD_BITS) & 1);
+		}
+
+		void setNull(size_t index, bool null = true)
+		{
+			NullWord & word = valid_[index / NULL_WORD_BITS];
+			const size_t shift = index % NULL_WORD_BITS;
+			word = (word & ~(NullWord(1) << shift)) | (NullWord(!null) << shift);
+		}
+
+		/// The null bitmap, a bit per column, set when the column has a
+		/// value, for code that tests or copies nulls a word at a time.
+		const NullWord * validWords() const
+		{
+			return valid_;
+		}
+
+		size_t nullWords() const
+		{
+			return nullWords_;
+		}
+
+		/// Sets the nulls of the first columns from a bitmap laid out as
+		/// validWords(). Other columns are left as they are.
+		void assignValid(const NullWord * valid, size_t columns)
+		{
+			const size_t words = columns / NULL_WORD_BITS;
+			std::copy(valid, valid + words, valid_);
+			if(const size_t rest = columns % NULL_WORD_BITS)
+			{
+				const NullWord mask = (NullWord(1) << rest) - 1;
+				valid_[words] = (valid_[words] & ~mask) | (valid[words] & mask);
+			}
+		}
+
+		/// Writes the bitmap of the first columns into whole words, with the
+		/// bits past them cleared.
+		void storeValid(NullWord * valid, size_t columns) const
+		{
+			const size_t words = columns / NULL_WORD_BITS;
+			std::copy(valid_, valid_ + words, valid);
+			if(const size_t rest = columns % NULL_WORD_BITS)
+				valid[words] = valid_[words] & ((NullWord(1) << rest) - 1);
+		}
+
+		/// Copies the nulls of the first columns of another row.
+		void copyValid(const Row & other, size_t columns)
+		{
+			assignValid(other.valid_, columns);
+		}
+
+		/// Raw access to the buffer, for code that copies values
+		/// using the offsets and sizes in the RowDef.
+		char * buffer()
+		{
+			return buf_;
+		}
+
+		const char * buffer() const
+		{
+			return buf_;
 		}
 
 		template<class T>
 		void set(size_t index, size_t ofs, T value)
 		{
 			*((T*)(buf_+ofs)) = value;
-			valueSet_[index] = true;
+			valid_[index / NULL_WORD_BITS] |= NullWord(1) << (index % NULL_WORD_BITS);
 		}
 
 		template<class T>
@@ -65,23 +148,50 @@ namespace RowStreams
 			return rowDef_;
 		}
 
+		/// Memory for the bytes of values of the row that do not fit in the
+		/// buffer, which lasts until the row is reset.
+		StringArena & arena()
+		{
+			return arena_;
+		}
+
 		/// Changes the spec for a row, which may make it shrink or expand to
-		/// accomodate more columns.
+		/// accomodate more columns. The buffer is only reallocated if it is too
+		/// small for the values or the null bitmap, so a recycled row keeps the
+		/// room it grew to. Columns past those of the new spec become null.
 		void rowDef(const RowDef * rowDef)
 		{
-			size_t new_capacity = rowDef->capacity();
-			size_t old_capacity = rowDef_->capacity();
+			const size_t new_capacity = std::max(capacity_, rowDef->capacity());
+			const size_t new_words = std::max(nullWords_, rowDef->nullWords());
 
-			if(new_capacity = old_capacity)
+			if(new_capacity > capacity_ || new_words > nullWords_)
 			{
-				char * new_buf = new char[new_capacity];
+				char * new_buf = RowDef::newBuffer(new_capacity, new_words);
 				::memcpy(new_buf, buf_, std::min(rowDef_->size(), rowDef->size()));
-				delete buf_;
+				NullWord * new_valid = reinterpret_cast<NullWord*>(new_buf + RowDef::nullsOffset(new_capacity));
+				std::copy(valid_, valid_ + nullWords_, new_valid);
+				delete [] buf_;
 				buf_ = new_buf;
+				capacity_ = new_capacity;
+				valid_ = new_valid;
+				nullWords_ = new_words;
 			}
+
+			const size_t columns = rowDef->numColumns();
+			if(columns % NULL_WORD_BITS)
+				valid_[columns / NULL_WORD_BITS] &= (NullWord(1) << (columns % NULL_WORD_BITS)) - 1;
+			std::fill(valid_ + (columns + NULL_WORD_BITS - 1) / NULL_WORD_BITS, valid_ + nullWords_, NullWord(0));
 			rowDef_ = rowDef;
 		}
 
+		/// Prepares a recycled row to be filled again: all values become null.
+		void reset(const RowDef * rowDef)
+		{
+			this->rowDef(rowDef);
+			std::fill(valid_, valid_ + nullWords_, NullWord(0));
+			arena_.clear();
+		}
+
 	};
 
 }
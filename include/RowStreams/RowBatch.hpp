@@ -0,0 +1,158 @@
+#ifndef ROWSTREAMS_ROW_BATCH_HPP
+#define ROWSTREAMS_ROW_BATCH_HPP
+
+#include "RowStreams/Row.hpp"
+#include <cstddef>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+
+namespace RowStreams
+{
+	/// A fixed number of rows moved through a pipeline with a single call,
+	/// which saves a call per row and stage. The selection vector lists the
+	/// rows that are still part of the stream; rows dropped from it stay in
+	/// the batch so that they are released along with the rest.
+	class RowBatch
+	{
+	public:
+		enum { CAPACITY = 1024 };
+		typedef boost::uint16_t Index;
+
+	private:
+		Row * rows_[CAPACITY];
+		size_t size_;
+		Index selection_[CAPACITY];
+		size_t selected_;
+
+		RowBatch(const RowBatch &);
+		RowBatch & operator=(const RowBatch &);
+
+	public:
+		RowBatch()
+			: size_(0), selected_(0)
+		{
+		}
+
+		void clear()
+		{
+			size_ = 0;
+			selected_ = 0;
+		}
+
+		bool empty() const
+		{
+			return size_ == 0;
+		}
+
+		bool full() const
+		{
+			return size_ == CAPACITY;
+		}
+
+		/// Number of rows in the batch, selected or not.
+		size_t size() const
+		{
+			return size_;
+		}
+
+		Row * row(size_t index) const
+		{
+			return rows_[index];
+		}
+
+		/// Appends a row and selects it.
+		void add(Row * row)
+		{
+			selection_[selected_++] = Index(size_);
+			rows_[size_++] = row;
+		}
+
+		/// Number of selected rows.
+		size_t selected() const
+		{
+			return selected_;
+		}
+
+		Row * selectedRow(size_t index) const
+		{
+			return rows_[selection_[index]];
+		}
+
+		/// The selection vector, for stages that narrow it down in place.
+		Index * selection()
+		{
+			return selection_;
+		}
+
+		void selected(size_t count)
+		{
+			selected_ = count;
+		}
+
+		/// Copies the rows and the selection of another batch.
+		void assign(const RowBatch & other)
+		{
+			std::copy(other.rows_, other.rows_ + other.size_, rows_);
+			std::copy(other.selection_, other.selection_ + other.selected_, selection_);
+			size_ = other.size_;
+			selected_ = other.selected_;
+		}
+	};
+
+	/// Tells whether a stage has its own batch entry points.
+	template<class Stage>
+	struct HasNextBatch
+	{
+		typedef char Yes;
+		typedef char (&No)[2];
+
+		template<class T, bool (T::*)(RowBatch &)> struct Check;
+		template<class T> static Yes test(Check<T, &T::nextBatch> *);
+		template<class T> static No test(...);
+
+		enum { value = sizeof(test<Stage>(0)) == sizeof(Yes) };
+	};
+
+	/// Lets row at a time stages be used where a batch is wanted, by filling
+	/// the batch with successive calls to next(). Stages with their own
+	/// nextBatch() and releaseBatch() are called directly.
+	template<class Stage, bool batched = HasNextBatch<Stage>::value>
+	struct BatchAdapter
+	{
+		static bool nextBatch(Stage & stage, RowBatch & batch)
+		{
+			batch.clear();
+			while(!batch.full())
+			{
+				Row * row = stage.next();
+				if(!row)
+					break;
+				batch.add(row);
+			}
+			return !batch.empty();
+		}
+
+		static void releaseBatch(Stage & stage, RowBatch & batch)
+		{
+			for(size_t index = 0; index != batch.size(); ++index)
+				stage.release(batch.row(index));
+			batch.clear();
+		}
+	};
+
+	template<class Stage>
+	struct BatchAdapter<Stage, true>
+	{
+		static bool nextBatch(Stage & stage, RowBatch & batch)
+		{
+			return stage.nextBatch(batch);
+		}
+
+		static void releaseBatch(Stage & stage, RowBatch & batch)
+		{
+			stage.releaseBatch(batch);
+		}
+	};
+}
+
+#endif
\ No newline at end of file
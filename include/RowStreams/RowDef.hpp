@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <map>
+#include <string>
+#include <boost/cstdint.hpp>
 #include "RowStreams/ColumnDef.hpp"
 
 namespace RowStreams
@@ -11,11 +13,18 @@ namespace RowStreams
 	/// including names, indices and offsets for all columns and buffer capacity,
 	/// which may be bigger than its size to account for rows that grow as they go
 	/// down the stream.
+	///
+	/// The buffer ends with the null bitmap of the row, a bit per column in
+	/// whole words, past the room for the values. Rows are created with the
+	/// layout at the end of the stream when it is planned, so the bitmap has
+	/// a bit for every column added on the way.
 	class RowDef
 	{
 	public:
 		typedef std::vector<ColumnDef*> ColumnDefVector;
 		typedef ColumnDefVector::const_iterator ConstAttrIter;
+		typedef boost::uint64_t NullWord;
+		enum { NULL_WORD_BITS = 64 };
 
 	private:
 		/// A minimum size will tell the new operator to allocate
@@ -96,12 +105,14 @@ namespace RowStreams
 		void add(const ColumnDef & columnDef)
 		{
 			ColumnDef * columnDefCopy = columnDef.clone();
-			size_t ofs = size_ + size_ % columnDefCopy->alignment();
+			const size_t alignment = columnDefCopy->alignment();
+			size_t ofs = (size_ + alignment - 1) / alignment * alignment;
 			columnDefCopy->offset(ofs);
 			columnDefCopy->index(columnDefs_.size());
 			size_ = ofs + columnDefCopy->size();
 
 			columnDefs_.push_back(columnDefCopy);
+			attrMap_[columnDefCopy->name()] = columnDefCopy;
 		}
 
 		/// Sugar baby, yeah!
@@ -133,11 +144,31 @@ namespace RowStreams
 			capacity_ = capacity;
 		}
 
+		/// Number of words of the null bitmap of a row.
+		size_t nullWords() const
+		{
+			return (columnDefs_.size() + NULL_WORD_BITS - 1) / NULL_WORD_BITS;
+		}
+
+		/// Offset of the null bitmap in a buffer with room for capacity
+		/// bytes of values.
+		static size_t nullsOffset(size_t capacity)
+		{
+			return (capacity + sizeof(NullWord) - 1) / sizeof(NullWord) * sizeof(NullWord);
+		}
+
 		/// Returns a newly created buffer to be used by a Row object 
-		/// that follows this definition.
+		/// that follows this definition. It is zeroed, so that the value of
+		/// a column never set is harmless to read, even for a StringRef, and
+		/// every column is null.
 		char * newBuffer() const
 		{
-			return new char[capacity()];
+			return newBuffer(capacity(), nullWords());
+		}
+
+		static char * newBuffer(size_t capacity, size_t nullWords)
+		{
+			return new char[nullsOffset(capacity) + nullWords * sizeof(NullWord)]();
 		}
 
 		ConstAttrIter begin() const
@@ -190,6 +221,18 @@ namespace RowStreams
 		}
 	};
 
+	/// A list of column names, built the same way as a RowDef:
+	/// ColumnNames() << "a" << "c"
+	class ColumnNames : public std::vector<std::string>
+	{
+	public:
+		ColumnNames & operator << (const std::string & name)
+		{
+			push_back(name);
+			return *this;
+		}
+	};
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+#ifndef ROWSTREAMS_ROW_POOL_HPP
+#define ROWSTREAMS_ROW_POOL_HPP
+
+#include "RowStreams/Row.hpp"
+#include <vector>
+
+namespace RowStreams
+{
+	/// Recycles the rows created by a row source. Sinks hand rows back through
+	/// the release() method of their source once they are done with them, which
+	/// eventually lands here, so a stream only ever allocates as many rows as
+	/// are in flight at once. All rows are deleted along with the pool.
+	/// Not thread safe.
+	class RowPool
+	{
+		const RowDef * rowDef_;
+		std::vector<Row*> rows_;
+		std::vector<Row*> free_;
+
+		RowPool(const RowPool &);
+		RowPool & operator=(const RowPool &);
+
+	public:
+		RowPool()
+			: rowDef_(0)
+		{
+		}
+
+		~RowPool()
+		{
+			clear();
+		}
+
+		/// Sets the definition of the rows handed out from now on.
+		void rowDef(const RowDef * rowDef)
+		{
+			rowDef_ = rowDef;
+		}
+
+		/// Returns a row with all values null.
+		Row * acquire()
+		{
+			if(free_.empty())
+			{
+				rows_.push_back(new Row(rowDef_));
+				return rows_.back();
+			}
+
+			Row * row = free_.back();
+			free_.pop_back();
+			row->reset(rowDef_);
+			return row;
+		}
+
+		void release(Row * row)
+		{
+			free_.push_back(row);
+		}
+
+		/// Number of rows created so far.
+		size_t size() const
+		{
+			return rows_.size();
+		}
+
+		/// Deletes all rows, including those not released yet.
+		void clear()
+		{
+			for(std::vector<Row*>::iterator row = rows_.begin(); row != rows_.end(); ++row)
+				delete *row;
+			rows_.clear();
+			free_.clear();
+		}
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,206 @@
+#ifndef ROWSTREAMS_ROW_PREDICATE_HPP
+#define ROWSTREAMS_ROW_PREDICATE_HPP
+
+#include "RowStreams/Row.hpp"
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/Functions.hpp"
+#include "RowStreams/ZoneMap.hpp"
+#include "RowStreams/TextRowParser.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+
+namespace RowStreams
+{
+	/// A condition rows have to meet, behind a virtual call so that sources
+	/// can check predicates of any type. Filter stages offer theirs to the
+	/// source through the plan, see PipelinePlan.
+	class RowPredicate
+	{
+		bool pushed_;
+
+	public:
+		RowPredicate()
+			: pushed_(false)
+		{
+		}
+
+		virtual ~RowPredicate()
+		{
+		}
+
+		virtual bool operator()(const Row & row) const = 0;
+
+		/// Appends the names of the columns the predicate reads to names.
+		virtual void columns(std::vector<std::string> & names) const = 0;
+
+		/// Tells whether any row of a block may meet the predicate, given
+		/// what its ZoneMap tells of the values of its columns.
+		virtual bool mayMatch(const ZoneMap &) const
+		{
+			return true;
+		}
+
+		/// Whether a source up the stream has taken the predicate, and only
+		/// hands out rows that meet it.
+		bool pushed() const
+		{
+			return pushed_;
+		}
+
+		void pushed(bool pushed)
+		{
+			pushed_ = pushed;
+		}
+
+		/// Tells whether the predicate reads a column.
+		bool uses(const std::string & column) const
+		{
+			std::vector<std::string> names;
+			columns(names);
+			return std::find(names.begin(), names.end(), column) != names.end();
+		}
+	};
+
+	/// A boolean Function as a RowPredicate. The function itself can also be
+	/// called directly, without the virtual call.
+	template<class Oper>
+	class FunctionPredicate : public RowPredicate
+	{
+		Function<bool, Oper> function_;
+
+	public:
+		FunctionPredicate(const Function<bool, Oper> & function)
+			: function_(function)
+		{
+		}
+
+		void init(const RowDef & rowDef)
+		{
+			function_.init(rowDef);
+			pushed(false);
+		}
+
+		const Function<bool, Oper> & function() const
+		{
+			return function_;
+		}
+
+		/// A row meets the predicate when the function is true, and not null.
+		bool matches(const Row & row) const
+		{
+			return !function_.null(row) && function_(row);
+		}
+
+		bool operator()(const Row & row) const
+		{
+			return matches(row);
+		}
+
+		void columns(std::vector<std::string> & names) const
+		{
+			function_.columns(names);
+		}
+
+		bool mayMatch(const ZoneMap & zones) const
+		{
+			const ValueRange<bool> range = function_.range(zones);
+			return !range.known || range.max;
+		}
+	};
+
+	/// The predicates a source has taken from the plan, which rows have to
+	/// meet before they are handed out. Checking them is const, so they can
+	/// be shared by several threads.
+	class PushedPredicates
+	{
+		std::vector<const RowPredicate*> predicates_;
+		/// Columns read by any of the predicates.
+		std::vector<std::string> columns_;
+
+	public:
+		/// Takes the predicates that only read columns of rowDef, which the
+		/// source creates, and marks them pushed.
+		void take(const std::vector<RowPredicate*> & predicates, const RowDef & rowDef)
+		{
+			predicates_.clear();
+			columns_.clear();
+			for(std::vector<RowPredicate*>::const_iterator predicate = predicates.begin(); predicate != predicates.end(); ++predicate)
+			{
+				std::vector<std::string> names;
+				(*predicate)->columns(names);
+
+				bool known = true;
+				for(std::vector<std::string>::const_iterator name = names.begin(); name != names.end() && known; ++name)
+					known = rowDef.columnDef(*name) != 0;
+				if(!known)
+					continue;
+
+				(*predicate)->pushed(true);
+				predicates_.push_back(*predicate);
+				for(std::vector<std::string>::const_iterator name = names.begin(); name != names.end(); ++name)
+				{
+					if(std::find(columns_.begin(), columns_.end(), *name) == columns_.end())
+						columns_.push_back(*name);
+				}
+			}
+		}
+
+		bool empty() const
+		{
+			return predicates_.empty();
+		}
+
+		const std::vector<std::string> & columns() const
+		{
+			return columns_;
+		}
+
+		bool operator()(const Row & row) const
+		{
+			for(std::vector<const RowPredicate*>::const_iterator predicate = predicates_.begin(); predicate != predicates_.end(); ++predicate)
+			{
+				if(!(**predicate)(row))
+					return false;
+			}
+			return true;
+		}
+
+		/// Tells whether any row of a block may meet all the predicates.
+		bool mayMatch(const ZoneMap & zones) const
+		{
+			for(std::vector<const RowPredicate*>::const_iterator predicate = predicates_.begin(); predicate != predicates_.end(); ++predicate)
+			{
+				if(!(*predicate)->mayMatch(zones))
+					return false;
+			}
+			return true;
+		}
+
+		/// Parses a text row with a TextRowParser, or a parser with the same
+		/// methods, whose early fields are the columns(). The other fields are
+		/// only parsed if the row meets the predicates. Returns false, with out
+		/// all null again, if it does not. Parse errors are added to errors.
+		template<class RowParser>
+		bool parse(const RowParser & parser, const TokenBlock & block, const char * base, size_t row,
+			Row & out, size_t & errors) const
+		{
+			if(predicates_.empty())
+			{
+				errors += parser.parseRow(block, base, row, out);
+				return true;
+			}
+
+			errors += parser.parseRow(block, base, row, out, FIELDS_EARLY);
+			if(!(*this)(out))
+			{
+				out.reset(out.rowDef());
+				return false;
+			}
+			errors += parser.parseRow(block, base, row, out, FIELDS_LATE);
+			return true;
+		}
+	};
+}
+
+#endif
\ No newline at end of file
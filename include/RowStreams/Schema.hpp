@@ -0,0 +1,268 @@
+#ifndef ROWSTREAMS_SCHEMA_HPP
+#define ROWSTREAMS_SCHEMA_HPP
+
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/Row.hpp"
+#include "RowStreams/ColumnDefHelpers.hpp"
+#include "RowStreams/Functions.hpp"
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <boost/type_traits/is_same.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <boost/preprocessor/repetition/enum.hpp>
+#include <boost/preprocessor/repetition/enum_params.hpp>
+#include <boost/preprocessor/repetition/enum_shifted_params.hpp>
+#include <boost/preprocessor/repetition/enum_params_with_a_default.hpp>
+
+/// Most fields a Schema can have.
+#ifndef ROWSTREAMS_SCHEMA_MAX_FIELDS
+#define ROWSTREAMS_SCHEMA_MAX_FIELDS 20
+#endif
+
+/// Declares a field tag to be used in a Schema, which also names the column:
+/// ROWSTREAMS_FIELD(price, double)
+#define ROWSTREAMS_FIELD(tag, type) \
+	struct tag \
+	{ \
+		typedef type Type; \
+		static const char * name() { return #tag; } \
+	};
+
+namespace RowStreams
+{
+	namespace SchemaDetail
+	{
+		/// Marks the end of the field list, and the unused Schema parameters.
+		struct Nil
+		{
+			typedef Nil Field;
+			typedef Nil Next;
+		};
+
+		template<size_t Offset, size_t Alignment>
+		struct AlignUp
+		{
+			enum { value = (Offset + Alignment - 1) / Alignment * Alignment };
+		};
+
+		/// A field in the list, with its place in the row worked out exactly
+		/// the way RowDef::add() does it.
+		template<class Field_, class Next_, size_t Index, size_t Start>
+		struct Node
+		{
+			typedef Field_ Field;
+			typedef typename Field::Type Type;
+			typedef Next_ Next;
+
+			enum
+			{
+				INDEX = Index,
+				OFFSET = AlignUp<Start, boost::alignment_of<Type>::value>::value,
+				END = OFFSET + sizeof(Type)
+			};
+		};
+
+#define ROWSTREAMS_SCHEMA_NIL(z, n, data) Nil
+
+		/// Turns a list of field tags into a list of Nodes.
+		template<size_t Index, size_t Start, BOOST_PP_ENUM_PARAMS(ROWSTREAMS_SCHEMA_MAX_FIELDS, class F)>
+		struct Build
+		{
+			enum { OFFSET = AlignUp<Start, boost::alignment_of<typename F0::Type>::value>::value };
+
+			typedef Node<F0,
+				typename Build<Index + 1, OFFSET + sizeof(typename F0::Type),
+					BOOST_PP_ENUM_SHIFTED_PARAMS(ROWSTREAMS_SCHEMA_MAX_FIELDS, F), Nil>::Type,
+				Index, Start> Type;
+		};
+
+		template<size_t Index, size_t Start>
+		struct Build<Index, Start, BOOST_PP_ENUM(ROWSTREAMS_SCHEMA_MAX_FIELDS, ROWSTREAMS_SCHEMA_NIL, ~)>
+		{
+			typedef Nil Type;
+		};
+
+#undef ROWSTREAMS_SCHEMA_NIL
+
+		/// Finds the Node of a field tag. Fails to compile if the tag is
+		/// not part of the list.
+		template<class Fields, class Tag, bool found = boost::is_same<typename Fields::Field, Tag>::value>
+		struct Find
+		{
+			typedef typename Find<typename Fields::Next, Tag>::Type Type;
+		};
+
+		template<class Fields, class Tag>
+		struct Find<Fields, Tag, true>
+		{
+			typedef Fields Type;
+		};
+
+		template<class Tag>
+		struct Find<Nil, Tag, false>;
+
+		template<class Fields>
+		struct Count
+		{
+			enum { value = 1 + Count<typename Fields::Next>::value };
+		};
+
+		template<>
+		struct Count<Nil>
+		{
+			enum { value = 0 };
+		};
+
+		template<class Fields>
+		struct Layout
+		{
+			static void add(RowDef & rowDef)
+			{
+				rowDef.add(ColumnDefTpl<typename Fields::Type>(Fields::Field::name()));
+				Layout<typename Fields::Next>::add(rowDef);
+			}
+
+			static bool matches(const RowDef & rowDef)
+			{
+				if(rowDef.numColumns() <= size_t(Fields::INDEX))
+					return false;
+				ColumnDef * columnDef = *(rowDef.begin() + Fields::INDEX);
+				return columnDef->name() == Fields::Field::name()
+					&& columnDef->offset() == size_t(Fields::OFFSET)
+					&& columnDef->size() == sizeof(typename Fields::Type)
+					&& Layout<typename Fields::Next>::matches(rowDef);
+			}
+		};
+
+		template<>
+		struct Layout<Nil>
+		{
+			static void add(RowDef &)
+			{
+			}
+
+			static bool matches(const RowDef &)
+			{
+				return true;
+			}
+		};
+	}
+
+	/// Row layout known at compile time, given as a list of field tags
+	/// declared with ROWSTREAMS_FIELD:
+	///
+	///   ROWSTREAMS_FIELD(a, int)
+	///   ROWSTREAMS_FIELD(b, double)
+	///   typedef Schema<a, b> MySchema;
+	///
+	/// Offsets are laid out just like RowDef does, so rows of a schema are
+	/// ordinary rows described by rowDef() and can go through any stage.
+	/// Stages that know the schema read and write the values at constant
+	/// offsets, without virtual calls or column lookups by name.
+	template<BOOST_PP_ENUM_PARAMS_WITH_A_DEFAULT(ROWSTREAMS_SCHEMA_MAX_FIELDS, class F, SchemaDetail::Nil)>
+	class Schema
+	{
+	public:
+		typedef typename SchemaDetail::Build<0, 0,
+			BOOST_PP_ENUM_PARAMS(ROWSTREAMS_SCHEMA_MAX_FIELDS, F)>::Type Fields;
+
+		enum { NUM_FIELDS = SchemaDetail::Count<Fields>::value };
+
+		/// Runtime definition of the rows.
+		static RowDef rowDef()
+		{
+			RowDef rowDef;
+			SchemaDetail::Layout<Fields>::add(rowDef);
+			return rowDef;
+		}
+
+		/// Tells whether rowDef starts with the fields of the schema at the
+		/// same offsets, which still holds after columns have been added
+		/// further down the stream.
+		static bool matches(const RowDef & rowDef)
+		{
+			return SchemaDetail::Layout<Fields>::matches(rowDef);
+		}
+
+		/// Throws unless matches(rowDef).
+		static void check(const RowDef & rowDef)
+		{
+			if(!matches(rowDef))
+				throw std::runtime_error("Rows do not follow the layout of the schema");
+		}
+	};
+
+	/// Compile time place of a field in the rows of a schema.
+	template<class SchemaType, class Tag>
+	struct SchemaField
+	{
+		typedef typename SchemaDetail::Find<typename SchemaType::Fields, Tag>::Type Node;
+		typedef typename Tag::Type Type;
+
+		enum { INDEX = Node::INDEX, OFFSET = Node::OFFSET };
+
+		static Type get(const Row & row)
+		{
+			return row.get<Type>(INDEX, OFFSET);
+		}
+
+		static void set(Row & row, Type value)
+		{
+			row.set(INDEX, OFFSET, value);
+		}
+
+		static bool isNull(const Row & row)
+		{
+			return row.isNull(INDEX);
+		}
+	};
+
+	namespace Functions
+	{
+		/// Function that extracts a field value from a row of a known schema,
+		/// with a load from a constant offset.
+		template<class SchemaType, class Tag>
+		class Field
+		{
+		public:
+			typedef SchemaField<SchemaType, Tag> Place;
+			typedef typename Tag::Type Type;
+
+			Type operator()(const Row & row) const
+			{
+				return Place::get(row);
+			}
+
+			bool null(const Row & row) const
+			{
+				return Place::isNull(row);
+			}
+
+			const Type * evaluate(const ColumnBatch & batch, Type *, ColumnBatch::Word * valid) const
+			{
+				std::copy(batch.valid(Place::INDEX), batch.valid(Place::INDEX) + ColumnBatch::WORDS, valid);
+				return batch.values<Type>(Place::INDEX);
+			}
+
+			void init(const RowDef & rowDef)
+			{
+				SchemaType::check(rowDef);
+			}
+
+			void columns(std::vector<std::string> & names) const
+			{
+				names.push_back(Tag::name());
+			}
+		};
+
+		template<class SchemaType, class Tag>
+		Function<typename Tag::Type, Field<SchemaType, Tag> > field()
+		{
+			return Function<typename Tag::Type, Field<SchemaType, Tag> >(Field<SchemaType, Tag>());
+		}
+	}
+}
+
+#endif
\ No newline at end of file
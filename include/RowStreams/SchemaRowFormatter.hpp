@@ -0,0 +1,96 @@
+#ifndef ROWSTREAMS_SCHEMA_ROW_FORMATTER_HPP
+#define ROWSTREAMS_SCHEMA_ROW_FORMATTER_HPP
+
+#include "RowStreams/Schema.hpp"
+#include "RowStreams/OutputBuffer.hpp"
+#include "RowStreams/ValueFormatter.hpp"
+#include <vector>
+#include <string>
+#include <cstring>
+
+namespace RowStreams
+{
+	namespace SchemaDetail
+	{
+		template<class Fields, bool first = true>
+		struct FormatFields
+		{
+			static void header(char colSep, OutputBuffer & out)
+			{
+				if(!first)
+					out.append(colSep);
+				const char * name = Fields::Field::name();
+				out.append(name, ::strlen(name));
+				FormatFields<typename Fields::Next, false>::header(colSep, out);
+			}
+
+			static void columns(std::vector<std::string> & names)
+			{
+				names.push_back(Fields::Field::name());
+				FormatFields<typename Fields::Next, false>::columns(names);
+			}
+
+			static void format(const Row & row, char colSep, OutputBuffer & out)
+			{
+				if(!first)
+					out.append(colSep);
+				if(!row.isNull(Fields::INDEX))
+				{
+					ValueFormatter<typename Fields::Type> formatter;
+					formatter.format(row.get<typename Fields::Type>(Fields::INDEX, Fields::OFFSET), out);
+				}
+				FormatFields<typename Fields::Next, false>::format(row, colSep, out);
+			}
+		};
+
+		template<bool first>
+		struct FormatFields<Nil, first>
+		{
+			static void header(char, OutputBuffer &)
+			{
+			}
+
+			static void columns(std::vector<std::string> &)
+			{
+			}
+
+			static void format(const Row &, char, OutputBuffer &)
+			{
+			}
+		};
+	}
+
+	/// Drop-in replacement for TextRowFormatter when the row layout is known
+	/// at compile time: values are loaded from constant offsets and formatted
+	/// with no virtual calls. Only the fields of the schema are written, even
+	/// if columns have been added to the rows further up the stream.
+	template<class SchemaType>
+	class SchemaRowFormatter
+	{
+		typedef typename SchemaType::Fields Fields;
+
+	public:
+		void init(const RowDef & rowDef)
+		{
+			SchemaType::check(rowDef);
+		}
+
+		/// Appends the names of the columns written to names.
+		void columns(std::vector<std::string> & names) const
+		{
+			SchemaDetail::FormatFields<Fields>::columns(names);
+		}
+
+		void formatHeader(char colSep, OutputBuffer & out) const
+		{
+			SchemaDetail::FormatFields<Fields>::header(colSep, out);
+		}
+
+		void formatRow(const Row & row, char colSep, OutputBuffer & out) const
+		{
+			SchemaDetail::FormatFields<Fields>::format(row, colSep, out);
+		}
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,166 @@
+#ifndef ROWSTREAMS_SCHEMA_ROW_PARSER_HPP
+#define ROWSTREAMS_SCHEMA_ROW_PARSER_HPP
+
+#include "RowStreams/Schema.hpp"
+#include "RowStreams/TextRowParser.hpp"
+#include "RowStreams/ValueParser.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+
+namespace RowStreams
+{
+	namespace SchemaDetail
+	{
+		/// Parses the fields of a row one after the other, each with the
+		/// parser of its own type, straight into its offset.
+		template<class Fields>
+		struct ParseFields
+		{
+			static size_t parse(const size_t * positions, const bool * early, FieldSet fields, bool copy,
+				const TokenBlock & block, const char * base, size_t first, size_t last, Row & out)
+			{
+				size_t errors = 0;
+				const size_t position = positions[Fields::INDEX];
+				if(position < last - first
+					&& (fields == FIELDS_ALL || early[Fields::INDEX] == (fields == FIELDS_EARLY)))
+				{
+					const char * value;
+					const char * value_end;
+					TextRowParser::field(block, base, first + position, last, &value, &value_end);
+
+					ValueParser<typename Fields::Type> parser;
+					typename Fields::Type result;
+					switch(parser.parse(value, value_end - value, result))
+					{
+					case PARSE_OK:
+						if(ValueStorage<typename Fields::Type>::external && copy)
+							ValueStorage<typename Fields::Type>::own(result, out.arena());
+						out.set(Fields::INDEX, Fields::OFFSET, result);
+						break;
+					case PARSE_EMPTY: break;
+					default: ++errors; break;
+					}
+				}
+				return errors + ParseFields<typename Fields::Next>::parse(positions, early, fields, copy, block, base, first, last, out);
+			}
+		};
+
+		template<>
+		struct ParseFields<Nil>
+		{
+			static size_t parse(const size_t *, const bool *, FieldSet, bool, const TokenBlock &, const char *, size_t, size_t, Row &)
+			{
+				return 0;
+			}
+		};
+
+		template<class Fields>
+		struct FieldIndex
+		{
+			static size_t find(const std::string & name)
+			{
+				return name == Fields::Field::name() ? size_t(Fields::INDEX) : FieldIndex<typename Fields::Next>::find(name);
+			}
+		};
+
+		template<>
+		struct FieldIndex<Nil>
+		{
+			static size_t find(const std::string &)
+			{
+				return size_t(-1);
+			}
+		};
+	}
+
+	/// Drop-in replacement for TextRowParser when the row layout is known
+	/// at compile time: fields are parsed with no virtual calls, and values
+	/// are stored at constant offsets. The header row still decides which
+	/// field of the text goes into which column.
+	template<class SchemaType>
+	class SchemaRowParser
+	{
+		typedef typename SchemaType::Fields Fields;
+
+		/// Position in the text rows of each field, or -1 if it is missing.
+		size_t positions_[SchemaType::NUM_FIELDS];
+		/// Whether each field is parsed early, see FieldSet.
+		bool early_[SchemaType::NUM_FIELDS];
+		/// Whether external values are copied into the rows.
+		bool copy_;
+
+	public:
+		SchemaRowParser()
+			: copy_(false)
+		{
+			std::fill(positions_, positions_ + SchemaType::NUM_FIELDS, size_t(-1));
+			std::fill(early_, early_ + SchemaType::NUM_FIELDS, false);
+		}
+
+		void mapHeader(const RowDef & rowDef, const TokenBlock & block, const char * base, size_t row)
+		{
+			SchemaType::check(rowDef);
+
+			std::fill(positions_, positions_ + SchemaType::NUM_FIELDS, size_t(-1));
+			const size_t first = block.firstField(row);
+			const size_t last = block.lastField(row);
+			for(size_t index = first; index != last; ++index)
+			{
+				const char * name;
+				const char * name_end;
+				TextRowParser::field(block, base, index, last, &name, &name_end);
+				const size_t field = SchemaDetail::FieldIndex<Fields>::find(std::string(name, name_end));
+				if(field != size_t(-1))
+					positions_[field] = index - first;
+			}
+		}
+
+		/// Only parses the fields of the given columns from now on, leaving
+		/// the other fields null. Called after mapHeader().
+		void project(const std::vector<std::string> & columns)
+		{
+			bool used[SchemaType::NUM_FIELDS] = {};
+			for(std::vector<std::string>::const_iterator column = columns.begin(); column != columns.end(); ++column)
+			{
+				const size_t field = SchemaDetail::FieldIndex<Fields>::find(*column);
+				if(field != size_t(-1))
+					used[field] = true;
+			}
+			for(size_t field = 0; field != size_t(SchemaType::NUM_FIELDS); ++field)
+			{
+				if(!used[field])
+					positions_[field] = size_t(-1);
+			}
+		}
+
+		/// Tells whether the text is gone before the rows parsed from it, see
+		/// TextRowParser::copyValues().
+		void copyValues(bool copy)
+		{
+			copy_ = copy;
+		}
+
+		/// Makes the fields of the given columns the early ones.
+		void prioritize(const std::vector<std::string> & columns)
+		{
+			std::fill(early_, early_ + SchemaType::NUM_FIELDS, false);
+			for(std::vector<std::string>::const_iterator column = columns.begin(); column != columns.end(); ++column)
+			{
+				const size_t field = SchemaDetail::FieldIndex<Fields>::find(*column);
+				if(field != size_t(-1))
+					early_[field] = true;
+			}
+		}
+
+		/// Returns the number of fields that could not be parsed, which are left null.
+		size_t parseRow(const TokenBlock & block, const char * base, size_t row, Row & out,
+			FieldSet fields = FIELDS_ALL) const
+		{
+			return SchemaDetail::ParseFields<Fields>::parse(positions_, early_, fields, copy_, block, base,
+				block.firstField(row), block.lastField(row), out);
+		}
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,244 @@
+#ifndef ROWSTREAMS_SHORTEST_DIGITS_HPP
+#define ROWSTREAMS_SHORTEST_DIGITS_HPP
+
+#include <cstring>
+#include <boost/cstdint.hpp>
+
+namespace RowStreams
+{
+	/// The decimal digits of a float or a double that read back as the same
+	/// value, found with Grisu2 (Loitsch, "Printing Floating-Point Numbers
+	/// Quickly and Accurately with Integers", 2010). The value and the
+	/// bounds of the values that round to it are scaled by a cached power
+	/// of ten into 64 bit integers, and digits are generated until they fall
+	/// between the bounds, so they always read back, and are the shortest
+	/// that do for all but a few values. Only integers are used, so nothing
+	/// depends on the locale or on the C library.
+	namespace ShortestDigits
+	{
+		/// A number as f times 2 to the power of e.
+		struct DiyFp
+		{
+			boost::uint64_t f;
+			int e;
+
+			DiyFp(boost::uint64_t f_, int e_)
+				: f(f_), e(e_)
+			{
+			}
+
+			DiyFp operator-(const DiyFp & other) const
+			{
+				return DiyFp(f - other.f, e);
+			}
+
+			/// The product, rounded to its upper 64 bits.
+			DiyFp operator*(const DiyFp & other) const
+			{
+				const boost::uint64_t low = 0xFFFFFFFFu;
+				const boost::uint64_t a = f >> 32, b = f & low, c = other.f >> 32, d = other.f & low;
+				const boost::uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+				const boost::uint64_t middle = (bd >> 32) + (ad & low) + (bc & low) + (boost::uint64_t(1) << 31);
+				return DiyFp(ac + (ad >> 32) + (bc >> 32) + (middle >> 32), e + other.e + 64);
+			}
+
+			/// The same number with the top bit of f set.
+			DiyFp normalized() const
+			{
+				DiyFp result = *this;
+				while(!(result.f >> 63))
+				{
+					result.f <<= 1;
+					--result.e;
+				}
+				return result;
+			}
+		};
+
+		/// How the bits of a type are laid out: the significand without its
+		/// hidden bit, then the biased exponent, then the sign.
+		template<class T>
+		struct Bits;
+
+		template<>
+		struct Bits<double>
+		{
+			typedef boost::uint64_t Word;
+			enum { SIGNIFICAND = 52, EXPONENT_MASK = 0x7FF, BIAS = 1023 + SIGNIFICAND };
+		};
+
+		template<>
+		struct Bits<float>
+		{
+			typedef boost::uint32_t Word;
+			enum { SIGNIFICAND = 23, EXPONENT_MASK = 0xFF, BIAS = 127 + SIGNIFICAND };
+		};
+
+		/// The power of ten that brings a number with binary exponent e to
+		/// one with an exponent between -60 and -32, and minus its decimal
+		/// exponent.
+		inline DiyFp cachedPower(int e, int & k)
+		{
+			static const boost::uint64_t significands[] =
+			{
+				0xFA8FD5A0081C0288ULL, 0xBAAEE17FA23EBF76ULL, 0x8B16FB203055AC76ULL, 0xCF42894A5DCE35EAULL,
+				0x9A6BB0AA55653B2DULL, 0xE61ACF033D1A45DFULL, 0xAB70FE17C79AC6CAULL, 0xFF77B1FCBEBCDC4FULL,
+				0xBE5691EF416BD60CULL, 0x8DD01FAD907FFC3CULL, 0xD3515C2831559A83ULL, 0x9D71AC8FADA6C9B5ULL,
+				0xEA9C227723EE8BCBULL, 0xAECC49914078536DULL, 0x823C12795DB6CE57ULL, 0xC21094364DFB5637ULL,
+				0x9096EA6F3848984FULL, 0xD77485CB25823AC7ULL, 0xA086CFCD97BF97F4ULL, 0xEF340A98172AACE5ULL,
+				0xB23867FB2A35B28EULL, 0x84C8D4DFD2C63F3BULL, 0xC5DD44271AD3CDBAULL, 0x936B9FCEBB25C996ULL,
+				0xDBAC6C247D62A584ULL, 0xA3AB66580D5FDAF6ULL, 0xF3E2F893DEC3F126ULL, 0xB5B5ADA8AAFF80B8ULL,
+				0x87625F056C7C4A8BULL, 0xC9BCFF6034C13053ULL, 0x964E858C91BA2655ULL, 0xDFF9772470297EBDULL,
+				0xA6DFBD9FB8E5B88FULL, 0xF8A95FCF88747D94ULL, 0xB94470938FA89BCFULL, 0x8A08F0F8BF0F156BULL,
+				0xCDB02555653131B6ULL, 0x993FE2C6D07B7FACULL, 0xE45C10C42A2B3B06ULL, 0xAA242499697392D3ULL,
+				0xFD87B5F28300CA0EULL, 0xBCE5086492111AEBULL, 0x8CBCCC096F5088CCULL, 0xD1B71758E219652CULL,
+				0x9C40000000000000ULL, 0xE8D4A51000000000ULL, 0xAD78EBC5AC620000ULL, 0x813F3978F8940984ULL,
+				0xC097CE7BC90715B3ULL, 0x8F7E32CE7BEA5C70ULL, 0xD5D238A4ABE98068ULL, 0x9F4F2726179A2245ULL,
+				0xED63A231D4C4FB27ULL, 0xB0DE65388CC8ADA8ULL, 0x83C7088E1AAB65DBULL, 0xC45D1DF942711D9AULL,
+				0x924D692CA61BE758ULL, 0xDA01EE641A708DEAULL, 0xA26DA3999AEF774AULL, 0xF209787BB47D6B85ULL,
+				0xB454E4A179DD1877ULL, 0x865B86925B9BC5C2ULL, 0xC83553C5C8965D3DULL, 0x952AB45CFA97A0B3ULL,
+				0xDE469FBD99A05FE3ULL, 0xA59BC234DB398C25ULL, 0xF6C69A72A3989F5CULL, 0xB7DCBF5354E9BECEULL,
+				0x88FCF317F22241E2ULL, 0xCC20CE9BD35C78A5ULL, 0x98165AF37B2153DFULL, 0xE2A0B5DC971F303AULL,
+				0xA8D9D1535CE3B396ULL, 0xFB9B7CD9A4A7443CULL, 0xBB764C4CA7A44410ULL, 0x8BAB8EEFB6409C1AULL,
+				0xD01FEF10A657842CULL, 0x9B10A4E5E9913129ULL, 0xE7109BFBA19C0C9DULL, 0xAC2820D9623BF429ULL,
+				0x80444B5E7AA7CF85ULL, 0xBF21E44003ACDD2DULL, 0x8E679C2F5E44FF8FULL, 0xD433179D9C8CB841ULL,
+				0x9E19DB92B4E31BA9ULL, 0xEB96BF6EBADF77D9ULL, 0xAF87023B9BF0EE6BULL
+			};
+			static const short exponents[] =
+			{
+				-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927, -901, -874, -847, -821,
+				-794, -768, -741, -715, -688, -661, -635, -608, -582, -555, -529, -502, -475, -449, -422, -396,
+				-369, -343, -316, -289, -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+				56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348, 375, 402, 428, 455,
+				481, 508, 534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+				907, 933, 960, 986, 1013, 1039, 1066
+			};
+
+			const double estimate = (-61 - e) * 0.30102999566398114 + 347;
+			int power = int(estimate);
+			if(estimate - power > 0.0)
+				++power;
+			const size_t index = size_t((power >> 3) + 1);
+			k = -(-348 + int(index) * 8);
+			return DiyFp(significands[index], exponents[index]);
+		}
+
+		inline int countDigits(boost::uint32_t value)
+		{
+			int count = 1;
+			for(; value >= 10; value /= 10)
+				++count;
+			return count;
+		}
+
+		/// Moves the last digit down while the digits stay within delta of
+		/// the upper bound and get closer to the value, which is distance
+		/// below the upper bound. rest is how far the digits are below it.
+		inline void round(char * buffer, int length, boost::uint64_t delta, boost::uint64_t rest, boost::uint64_t tenKappa,
+			boost::uint64_t distance)
+		{
+			while(rest < distance && delta - rest >= tenKappa
+				&& (rest + tenKappa < distance || distance - rest > rest + tenKappa - distance))
+			{
+				--buffer[length - 1];
+				rest += tenKappa;
+			}
+		}
+
+		/// Generates the digits of the upper bound up, until they are within
+		/// delta of it.
+		inline int generate(const DiyFp & value, const DiyFp & upper, boost::uint64_t delta, char * buffer, int & k)
+		{
+			static const boost::uint64_t powers[] =
+			{
+				1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+				1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+				100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+				1000000000000000000ULL, 10000000000000000000ULL
+			};
+			const DiyFp one(boost::uint64_t(1) << -upper.e, upper.e);
+			const DiyFp distance = upper - value;
+			boost::uint32_t integral = boost::uint32_t(upper.f >> -one.e);
+			boost::uint64_t fraction = upper.f & (one.f - 1);
+			int kappa = countDigits(integral);
+			int length = 0;
+
+			while(kappa > 0)
+			{
+				const boost::uint32_t power = boost::uint32_t(powers[kappa - 1]);
+				const boost::uint32_t digit = integral / power;
+				integral %= power;
+				if(digit || length)
+					buffer[length++] = char('0' + digit);
+				--kappa;
+				const boost::uint64_t rest = (boost::uint64_t(integral) << -one.e) + fraction;
+				if(rest <= delta)
+				{
+					k += kappa;
+					round(buffer, length, delta, rest, powers[kappa] << -one.e, distance.f);
+					return length;
+				}
+			}
+
+			for(;;)
+			{
+				fraction *= 10;
+				delta *= 10;
+				const char digit = char(fraction >> -one.e);
+				if(digit || length)
+					buffer[length++] = char('0' + digit);
+				fraction &= one.f - 1;
+				--kappa;
+				if(fraction < delta)
+				{
+					k += kappa;
+					round(buffer, length, delta, fraction, one.f, -kappa < 20 ? distance.f * powers[-kappa] : 0);
+					return length;
+				}
+			}
+		}
+
+		/// Writes the digits of a positive, finite value into buffer, which
+		/// needs room for 20, and returns their number. The value is those
+		/// digits times ten to the power of exponent.
+		template<class T>
+		int digits(T value, char * buffer, int & exponent)
+		{
+			typedef typename Bits<T>::Word Word;
+			Word bits;
+			::memcpy(&bits, &value, sizeof(bits));
+			const boost::uint64_t hidden = boost::uint64_t(1) << Bits<T>::SIGNIFICAND;
+			const boost::uint64_t significand = bits & (hidden - 1);
+			const int biased = int((bits >> Bits<T>::SIGNIFICAND) & Bits<T>::EXPONENT_MASK);
+			const DiyFp exact = biased ? DiyFp(significand + hidden, biased - Bits<T>::BIAS)
+				: DiyFp(significand, 1 - Bits<T>::BIAS);
+
+			// Halfway to the next value either way, where the one below is
+			// closer at powers of two.
+			DiyFp upper((exact.f << 1) + 1, exact.e - 1);
+			while(!(upper.f & (hidden << 1)))
+			{
+				upper.f <<= 1;
+				--upper.e;
+			}
+			upper.f <<= 62 - Bits<T>::SIGNIFICAND;
+			upper.e -= 62 - Bits<T>::SIGNIFICAND;
+			DiyFp lower = exact.f == hidden ? DiyFp((exact.f << 2) - 1, exact.e - 2) : DiyFp((exact.f << 1) - 1, exact.e - 1);
+			lower.f <<= lower.e - upper.e;
+			lower.e = upper.e;
+
+			int k;
+			const DiyFp power = cachedPower(upper.e, k);
+			const DiyFp scaled = exact.normalized() * power;
+			DiyFp scaledUpper = upper * power;
+			DiyFp scaledLower = lower * power;
+			// Narrowed by the error of the products, so the digits are safe.
+			++scaledLower.f;
+			--scaledUpper.f;
+			exponent = k;
+			return generate(scaled, scaledUpper, scaledUpper.f - scaledLower.f, buffer, exponent);
+		}
+	}
+}
+
+#endif
\ No newline at end of file
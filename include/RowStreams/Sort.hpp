@@ -0,0 +1,542 @@
+#ifndef ROWSTREAMS_SORT_HPP
+#define ROWSTREAMS_SORT_HPP
+
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/RowPool.hpp"
+#include "RowStreams/RowBatch.hpp"
+#include "RowStreams/PipelinePlan.hpp"
+#include "RowStreams/RecordLayout.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <boost/cstdint.hpp>
+
+namespace RowStreams
+{
+	/// Hands on the rows of the stream in the order of the sort columns.
+	/// Rows with equal sort columns keep their order. The whole input is
+	/// read before the first row comes out.
+	///
+	/// Rows are copied into records of a fixed size, which start with a key
+	/// that compares with memcmp (see RecordLayout). What gets sorted is an
+	/// array of the first 16 bytes of every key, as integers, next to the
+	/// index of the record, so most comparisons never leave the array, and
+	/// those of keys of one or two numbers never do. When the records reach
+	/// the memory limit they are sorted and written to a temporary file as a
+	/// run, and the runs are merged at the end, along with the last one,
+	/// which stays in memory, through a loser tree. Every 64 runs written
+	/// are merged into one, so that there are never more files open, nor
+	/// read buffers in memory.
+	///
+	/// Long strings go to a heap next to the records, and count towards
+	/// the memory limit. A run written to disk gets a second file for them,
+	/// in the order of its records, so it is read back in step with them.
+	template<class Source>
+	class Sort
+	{
+		enum
+		{
+			/// Size of the blocks runs are written and read back in.
+			RUN_BLOCK = 1 << 18,
+			/// Number of runs merged at once.
+			MAX_RUNS = 64,
+			/// Bytes of the key kept next to the index of every record.
+			PREFIX = 2 * sizeof(boost::uint64_t)
+		};
+
+		struct Entry
+		{
+			/// First bytes of the key, most significant first.
+			boost::uint64_t prefix[2];
+			boost::uint32_t record;
+		};
+
+		/// Sorted records, either in a temporary file or in memory (file
+		/// is null), in which case the records are those of entries_.
+		struct Run
+		{
+			std::FILE * file;
+			/// The bytes of the records in the heap, if they have any.
+			std::FILE * strings;
+			std::vector<char> buffer;
+			/// Current record, and number of records in the buffer.
+			size_t pos;
+			size_t count;
+		};
+
+		/// Orders entries by key, then by arrival.
+		class EntryLess
+		{
+			const Sort * sort_;
+
+		public:
+			EntryLess(const Sort * sort)
+				: sort_(sort)
+			{
+			}
+
+			bool operator()(const Entry & left, const Entry & right) const
+			{
+				if(left.prefix[0] != right.prefix[0])
+					return left.prefix[0] < right.prefix[0];
+				if(left.prefix[1] != right.prefix[1])
+					return left.prefix[1] < right.prefix[1];
+				if(sort_->layout_.keySize() > PREFIX)
+				{
+					const int compared = ::memcmp(sort_->record(left.record) + PREFIX,
+						sort_->record(right.record) + PREFIX, sort_->layout_.keySize() - PREFIX);
+					if(compared)
+						return compared < 0;
+				}
+				return left.record < right.record;
+			}
+		};
+
+		friend class EntryLess;
+
+		/// Row source. We don't own it, so no deletes.
+		Source * source_;
+		std::vector<std::string> columns_;
+		size_t memoryLimit_;
+		SortOrder order_;
+
+		RowDef rowDef_;
+		RecordLayout layout_;
+		size_t recordSize_;
+		/// Number of records in a run.
+		size_t maxRecords_;
+		RowPool pool_;
+
+		std::vector<char> records_;
+		/// Heap of the records in memory (see RecordLayout).
+		std::vector<char> strings_;
+		std::vector<Entry> entries_;
+		std::vector<Run> runs_;
+		/// Loser tree over runs_: the run holding the least record comes
+		/// first, followed by the run that lost at every inner node.
+		std::vector<size_t> losers_;
+
+		bool built_;
+
+		Sort & operator=(const Sort &);
+
+		const char * record(size_t index) const
+		{
+			return &records_[index * recordSize_];
+		}
+
+		/// Reads 8 bytes of a key as an integer that compares the same way.
+		static boost::uint64_t word(const char * key)
+		{
+			boost::uint64_t word = 0;
+			for(size_t pos = 0; pos != sizeof(word); ++pos)
+				word = (word << 8) | static_cast<unsigned char>(key[pos]);
+			return word;
+		}
+
+		void add(const Row & row)
+		{
+			if(entries_.size() == maxRecords_ ||
+				(!entries_.empty() && strings_.size() >= memoryLimit_ - entries_.size() * (recordSize_ + sizeof(Entry))))
+				spill();
+
+			const size_t at = records_.size();
+			records_.resize(at + recordSize_);
+			layout_.pack(row, &records_[at], strings_);
+			const size_t keySize = layout_.keySize();
+			Entry entry;
+			entry.prefix[0] = keySize ? word(&records_[at]) : 0;
+			entry.prefix[1] = keySize > sizeof(boost::uint64_t) ? word(&records_[at] + sizeof(boost::uint64_t)) : 0;
+			entry.record = boost::uint32_t(entries_.size());
+			entries_.push_back(entry);
+		}
+
+		std::FILE * createRun() const
+		{
+			std::FILE * file = std::tmpfile();
+			if(!file)
+				throw std::runtime_error("Failed to create a temporary file to sort rows in");
+			return file;
+		}
+
+		void flush(std::FILE * file, std::vector<char> & block) const
+		{
+			if(!block.empty() && std::fwrite(&block[0], block.size(), 1, file) != 1)
+				throw std::runtime_error("Failed to write sorted rows to a temporary file");
+			block.clear();
+		}
+
+		void addRun(std::FILE * file, std::FILE * strings)
+		{
+			std::rewind(file);
+			if(strings)
+				std::rewind(strings);
+			Run run;
+			run.file = file;
+			run.strings = strings;
+			run.pos = run.count = 0;
+			runs_.push_back(run);
+		}
+
+		/// Writes the records in memory to a temporary file, in order.
+		void spill()
+		{
+			std::sort(entries_.begin(), entries_.end(), EntryLess(this));
+
+			std::FILE * file = createRun();
+			std::FILE * strings = layout_.external() ? createRun() : 0;
+			std::vector<char> block, stringsBlock;
+			block.reserve(RUN_BLOCK + recordSize_);
+			for(typename std::vector<Entry>::const_iterator entry = entries_.begin(); entry != entries_.end(); ++entry)
+			{
+				const char * from = record(entry->record);
+				block.insert(block.end(), from, from + recordSize_);
+				if(block.size() >= RUN_BLOCK)
+					flush(file, block);
+				const size_t size = layout_.stringsSize(from);
+				if(size)
+				{
+					const char * bytes = &strings_[layout_.stringsOffset(from)];
+					stringsBlock.insert(stringsBlock.end(), bytes, bytes + size);
+					if(stringsBlock.size() >= RUN_BLOCK)
+						flush(strings, stringsBlock);
+				}
+			}
+			flush(file, block);
+			if(strings)
+				flush(strings, stringsBlock);
+			addRun(file, strings);
+
+			records_.clear();
+			strings_.clear();
+			entries_.clear();
+			if(runs_.size() == MAX_RUNS)
+				compact();
+		}
+
+		/// Merges all runs into one, to keep the number of files open and
+		/// of read buffers in the final merge bounded.
+		void compact()
+		{
+			start();
+			std::FILE * file = createRun();
+			std::FILE * strings = layout_.external() ? createRun() : 0;
+			std::vector<char> block, stringsBlock;
+			block.reserve(RUN_BLOCK + recordSize_);
+			for(size_t winner = losers_[0]; !exhausted(winner); winner = losers_[0])
+			{
+				const char * from = head(winner);
+				block.insert(block.end(), from, from + recordSize_);
+				if(block.size() >= RUN_BLOCK)
+					flush(file, block);
+				const size_t size = layout_.stringsSize(from);
+				if(size)
+				{
+					const size_t at = stringsBlock.size();
+					stringsBlock.resize(at + size);
+					readStrings(runs_[winner], &stringsBlock[at], size);
+					if(stringsBlock.size() >= RUN_BLOCK)
+						flush(strings, stringsBlock);
+				}
+				advance(winner);
+				replay(winner);
+			}
+			flush(file, block);
+			if(strings)
+				flush(strings, stringsBlock);
+			closeFiles();
+			addRun(file, strings);
+		}
+
+		/// Reads the bytes in the heap of the current record of a run
+		/// written to disk, which comes next in its file of them.
+		void readStrings(Run & run, char * to, size_t size)
+		{
+			if(std::fread(to, size, 1, run.strings) != 1)
+				throw std::runtime_error("Failed to read back sorted rows");
+		}
+
+		bool exhausted(size_t run) const
+		{
+			return runs_[run].pos == runs_[run].count;
+		}
+
+		const char * head(size_t run) const
+		{
+			const Run & from = runs_[run];
+			return from.file ? &from.buffer[from.pos * recordSize_] : record(entries_[from.pos].record);
+		}
+
+		/// Reads the next block of a run from its file. The run is exhausted
+		/// if there is none.
+		void fill(Run & run)
+		{
+			run.pos = 0;
+			run.count = std::fread(&run.buffer[0], recordSize_, run.buffer.size() / recordSize_, run.file);
+			if(std::ferror(run.file))
+				throw std::runtime_error("Failed to read back sorted rows");
+		}
+
+		void advance(size_t run)
+		{
+			Run & from = runs_[run];
+			if(++from.pos == from.count && from.file)
+				fill(from);
+		}
+
+		/// Orders runs by their current record, exhausted runs last, and
+		/// runs written earlier first on equal keys, which keeps the sort
+		/// stable.
+		bool less(size_t left, size_t right) const
+		{
+			if(exhausted(left))
+				return false;
+			if(exhausted(right))
+				return true;
+			const int compared = ::memcmp(head(left), head(right), layout_.keySize());
+			return compared ? compared < 0 : left < right;
+		}
+
+		/// Plays the matches below a node of the loser tree, whose leaves are
+		/// the runs, numbered from runs_.size(). Returns the winner.
+		size_t play(size_t node)
+		{
+			if(node >= runs_.size())
+				return node - runs_.size();
+			const size_t left = play(2 * node);
+			const size_t right = play(2 * node + 1);
+			if(less(right, left))
+			{
+				losers_[node] = left;
+				return right;
+			}
+			losers_[node] = right;
+			return left;
+		}
+
+		/// Plays the matches on the way up from a run whose record changed.
+		void replay(size_t run)
+		{
+			size_t winner = run;
+			for(size_t node = (run + runs_.size()) / 2; node != 0; node /= 2)
+			{
+				if(less(losers_[node], winner))
+					std::swap(losers_[node], winner);
+			}
+			losers_[0] = winner;
+		}
+
+		/// Reads the first block of every run and plays the loser tree.
+		void start()
+		{
+			const size_t blockRecords = std::max(size_t(RUN_BLOCK) / recordSize_, size_t(1));
+			for(typename std::vector<Run>::iterator run = runs_.begin(); run != runs_.end(); ++run)
+			{
+				if(!run->file)
+					continue;
+				run->buffer.resize(blockRecords * recordSize_);
+				fill(*run);
+			}
+			losers_.assign(runs_.size(), 0);
+			losers_[0] = play(1);
+		}
+
+		/// Reads the whole input and gets the runs ready to be merged.
+		void build()
+		{
+			built_ = true;
+			RowBatch batch;
+			while(source_->nextBatch(batch))
+			{
+				for(size_t index = 0; index != batch.selected(); ++index)
+					add(*batch.selectedRow(index));
+				source_->releaseBatch(batch);
+			}
+
+			std::sort(entries_.begin(), entries_.end(), EntryLess(this));
+			Run last;
+			last.file = 0;
+			last.strings = 0;
+			last.pos = 0;
+			last.count = entries_.size();
+			runs_.push_back(last);
+			start();
+		}
+
+		/// Makes a row out of the next record, or returns 0 after the last.
+		Row * nextSorted()
+		{
+			if(!built_)
+				build();
+
+			const size_t winner = losers_[0];
+			if(exhausted(winner))
+				return 0;
+			Row * row = pool_.acquire();
+			const char * from = head(winner);
+			const char * strings = 0;
+			const size_t size = layout_.stringsSize(from);
+			if(size)
+			{
+				// The bytes of records read from disk go to the arena of the row.
+				if(runs_[winner].file)
+				{
+					char * to = row->arena().allocate(size);
+					readStrings(runs_[winner], to, size);
+					strings = to;
+				}
+				else
+					strings = &strings_[layout_.stringsOffset(from)];
+			}
+			layout_.unpack(from, strings, *row);
+			advance(winner);
+			replay(winner);
+			return row;
+		}
+
+		void closeFiles()
+		{
+			for(typename std::vector<Run>::iterator run = runs_.begin(); run != runs_.end(); ++run)
+			{
+				if(run->file)
+					std::fclose(run->file);
+				if(run->strings)
+					std::fclose(run->strings);
+			}
+			runs_.clear();
+		}
+
+	public:
+		Sort(const std::vector<std::string> & columns, size_t memoryLimit, SortOrder order)
+			: source_(0), columns_(columns), memoryLimit_(memoryLimit), order_(order), recordSize_(0),
+			maxRecords_(0), built_(false)
+		{
+		}
+
+		Sort(const Sort & other)
+			: source_(0), columns_(other.columns_), memoryLimit_(other.memoryLimit_), order_(other.order_),
+			recordSize_(0), maxRecords_(0), built_(false)
+		{
+		}
+
+		~Sort()
+		{
+			closeFiles();
+		}
+
+		void source(Source * source)
+		{
+			source_ = source;
+		}
+
+		void init()
+		{
+			source_->init();
+			rowDef_ = source_->rowDef();
+
+			layout_.init(rowDef_, columns_, order_);
+			recordSize_ = layout_.size();
+			maxRecords_ = std::max(memoryLimit_ / (recordSize_ + sizeof(Entry)), size_t(1));
+			maxRecords_ = std::min(maxRecords_, size_t(boost::uint32_t(-1)));
+
+			pool_.rowDef(&rowDef_);
+		}
+
+		/// Rows are created with the planned layout. The source gets a plan
+		/// of its own, with the same predicates and used columns, plus the
+		/// sort columns.
+		bool plan(PipelinePlan & plan)
+		{
+			if(plan.layout)
+				pool_.rowDef(plan.layout);
+
+			PipelinePlan input;
+			input.layout = &rowDef_;
+			input.predicates = plan.predicates;
+			input.allColumns = plan.allColumns;
+			input.usedColumns = plan.usedColumns;
+			input.use(columns_);
+			source_->plan(input);
+			return true;
+		}
+
+		void stop()
+		{
+			source_->stop();
+		}
+
+		const RowDef & rowDef()
+		{
+			return rowDef_;
+		}
+
+		Row * next()
+		{
+			return nextSorted();
+		}
+
+		void release(Row * row)
+		{
+			pool_.release(row);
+		}
+
+		bool nextBatch(RowBatch & batch)
+		{
+			batch.clear();
+			while(!batch.full())
+			{
+				Row * row = nextSorted();
+				if(!row)
+					break;
+				batch.add(row);
+			}
+			return !batch.empty();
+		}
+
+		void releaseBatch(RowBatch & batch)
+		{
+			for(size_t index = 0; index != batch.size(); ++index)
+				pool_.release(batch.row(index));
+			batch.clear();
+		}
+	};
+
+	/// Bridge class used in the pipeline construction syntax.
+	class SortPrototype
+	{
+		std::vector<std::string> columns_;
+		size_t memoryLimit_;
+		SortOrder order_;
+
+	public:
+		template<class Source>
+		struct ForSource
+		{
+			typedef Sort<Source> Type;
+		};
+
+		SortPrototype(const std::vector<std::string> & columns, size_t memoryLimit, SortOrder order)
+			: columns_(columns), memoryLimit_(memoryLimit), order_(order)
+		{
+		}
+
+		template<class Source>
+		Sort<Source> create() const
+		{
+			return Sort<Source>(columns_, memoryLimit_, order_);
+		}
+	};
+
+	/// Sorts the rows by the values of the given columns, keeping at most
+	/// about memoryLimit bytes of rows in memory before spilling to disk:
+	/// read_text_file(...) >> sort_by(ColumnNames() << "a" << "b") >> write_text_file(...)
+	SortPrototype sort_by(const ColumnNames & columns, size_t memoryLimit = 256 << 20, SortOrder order = SORT_ASCENDING)
+	{
+		return SortPrototype(columns, memoryLimit, order);
+	}
+}
+
+#endif
\ No newline at end of file
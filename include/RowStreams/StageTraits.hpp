@@ -0,0 +1,56 @@
+#ifndef ROWSTREAMS_STAGE_TRAITS_HPP
+#define ROWSTREAMS_STAGE_TRAITS_HPP
+
+namespace RowStreams
+{
+	/// Compile time facts about a stage. Stages that differ from the defaults
+	/// specialize it next to their definition.
+	template<class Stage>
+	struct StageTraits
+	{
+		/// Whether copies of the stage can work on different batches of the
+		/// same stream at once, between split_morsels() and merge_morsels().
+		/// Such stages have nextBatch(), keep no state from one batch to the
+		/// next, and hand on every batch they get with the same rows, so that
+		/// rows can be given back straight to the source of the segment.
+		enum { replicable = false };
+	};
+
+	/// Tells whether a stage can be told to stop early.
+	template<class Stage>
+	struct HasStop
+	{
+		typedef char Yes;
+		typedef char (&No)[2];
+
+		template<class T, void (T::*)()> struct Check;
+		template<class T> static Yes test(Check<T, &T::stop> *);
+		template<class T> static No test(...);
+
+		enum { value = sizeof(test<Stage>(0)) == sizeof(Yes) };
+	};
+
+	/// Calls stop() on the stages that have it. A stage stops when no more
+	/// rows will be pulled from it, which the stage passes on up the stream,
+	/// so that sources stop reading and threads stop working ahead. Rows
+	/// handed out before are still released as usual. Stages without stop()
+	/// just never get pulled again.
+	template<class Stage, bool stoppable = HasStop<Stage>::value>
+	struct StopAdapter
+	{
+		static void stop(Stage &)
+		{
+		}
+	};
+
+	template<class Stage>
+	struct StopAdapter<Stage, true>
+	{
+		static void stop(Stage & stage)
+		{
+			stage.stop();
+		}
+	};
+}
+
+#endif
\ No newline at end of file
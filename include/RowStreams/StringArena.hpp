@@ -0,0 +1,72 @@
+#ifndef ROWSTREAMS_STRING_ARENA_HPP
+#define ROWSTREAMS_STRING_ARENA_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+namespace RowStreams
+{
+	/// Memory for the bytes of values that do not fit in the buffer of a
+	/// row, like long strings, handed out in pieces that stay put until the
+	/// arena is cleared. Clearing keeps the memory for reuse, so a recycled
+	/// row stops allocating once it has seen its longest values.
+	/// Not thread safe.
+	class StringArena
+	{
+		enum { CHUNK_SIZE = 4096 };
+
+		/// Chunks of CHUNK_SIZE bytes, or more for values that big.
+		std::vector<char*> chunks_;
+		std::vector<size_t> sizes_;
+		/// Chunk pieces are handed out from, and how much of it is used.
+		size_t current_;
+		size_t used_;
+
+		StringArena(const StringArena &);
+		StringArena & operator=(const StringArena &);
+
+	public:
+		StringArena()
+			: current_(0), used_(0)
+		{
+		}
+
+		~StringArena()
+		{
+			for(std::vector<char*>::iterator chunk = chunks_.begin(); chunk != chunks_.end(); ++chunk)
+				delete [] *chunk;
+		}
+
+		/// Returns size bytes that stay valid until clear().
+		char * allocate(size_t size)
+		{
+			while(current_ != chunks_.size())
+			{
+				if(sizes_[current_] - used_ >= size)
+				{
+					char * piece = chunks_[current_] + used_;
+					used_ += size;
+					return piece;
+				}
+				++current_;
+				used_ = 0;
+			}
+
+			const size_t chunkSize = std::max(size, size_t(CHUNK_SIZE));
+			chunks_.push_back(new char[chunkSize]);
+			sizes_.push_back(chunkSize);
+			used_ = size;
+			return chunks_.back();
+		}
+
+		/// Makes all the memory handed out free for reuse.
+		void clear()
+		{
+			current_ = 0;
+			used_ = 0;
+		}
+	};
+}
+
+#endif
\ No newline at end of file
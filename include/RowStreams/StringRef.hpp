@@ -0,0 +1,238 @@
+#ifndef ROWSTREAMS_STRING_REF_HPP
+#define ROWSTREAMS_STRING_REF_HPP
+
+#include "RowStreams/StringArena.hpp"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <boost/cstdint.hpp>
+
+namespace RowStreams
+{
+	/// A string value of any length, in the 16 bytes of a column of a row:
+	/// the length, then strings of up to 12 bytes inline, and longer ones as
+	/// their first 4 bytes and a pointer to all of them. The pointer usually
+	/// goes into the text the row was parsed from, or into the StringArena
+	/// of the row, so a StringRef is only valid as long as those are.
+	///
+	/// Comparisons and hashing start with the length and the first bytes,
+	/// which are in the value itself, so most of them never follow the
+	/// pointer.
+	class StringRef
+	{
+		enum { INLINE_SIZE = 12, PREFIX_SIZE = 4 };
+
+		boost::uint32_t size_;
+		/// The first bytes, and zeros past the end of short strings.
+		char prefix_[PREFIX_SIZE];
+		union
+		{
+			/// Bytes past the prefix of inline strings, then zeros.
+			char rest_[INLINE_SIZE - PREFIX_SIZE];
+			const char * data_;
+		};
+
+		void assign(const char * data, size_t size)
+		{
+			size_ = boost::uint32_t(size);
+			if(size <= INLINE_SIZE)
+			{
+				::memset(prefix_, 0, INLINE_SIZE);
+				::memcpy(prefix_, data, size);
+			}
+			else
+			{
+				::memcpy(prefix_, data, PREFIX_SIZE);
+				data_ = data;
+			}
+		}
+
+		/// The length and the prefix as a single word.
+		boost::uint64_t head() const
+		{
+			boost::uint64_t head;
+			::memcpy(&head, this, sizeof(head));
+			return head;
+		}
+
+	public:
+		StringRef()
+		{
+			assign("", 0);
+		}
+
+		/// Refers to size bytes at data, which are not copied unless they fit
+		/// inline.
+		StringRef(const char * data, size_t size)
+		{
+			assign(data, size);
+		}
+
+		StringRef(const std::string & str)
+		{
+			assign(str.data(), str.size());
+		}
+
+		size_t size() const
+		{
+			return size_;
+		}
+
+		bool empty() const
+		{
+			return size_ == 0;
+		}
+
+		/// Whether the bytes are in the value itself rather than pointed to.
+		bool isInline() const
+		{
+			return size_ <= INLINE_SIZE;
+		}
+
+		const char * data() const
+		{
+			return isInline() ? prefix_ : data_;
+		}
+
+		std::string str() const
+		{
+			return std::string(data(), size());
+		}
+
+		/// Copies the bytes into arena, unless they are inline.
+		void own(StringArena & arena)
+		{
+			if(!isInline())
+			{
+				char * copy = arena.allocate(size_);
+				::memcpy(copy, data_, size_);
+				data_ = copy;
+			}
+		}
+
+		/// Returns a negative number, zero or a positive number if this string
+		/// comes before, is the same as, or comes after other, comparing bytes
+		/// as unsigned.
+		int compare(const StringRef & other) const
+		{
+			// The zeros after short strings sort before any byte, as the end of
+			// the string does.
+			const int prefix = ::memcmp(prefix_, other.prefix_, PREFIX_SIZE);
+			if(prefix)
+				return prefix;
+			const int rest = ::memcmp(data(), other.data(), std::min(size_, other.size_));
+			if(rest)
+				return rest;
+			return size_ < other.size_ ? -1 : size_ != other.size_;
+		}
+
+		bool operator==(const StringRef & other) const
+		{
+			if(head() != other.head())
+				return false;
+			if(isInline())
+				return ::memcmp(rest_, other.rest_, sizeof(rest_)) == 0;
+			return ::memcmp(data_ + PREFIX_SIZE, other.data_ + PREFIX_SIZE, size_ - PREFIX_SIZE) == 0;
+		}
+
+		bool operator!=(const StringRef & other) const
+		{
+			return !(*this == other);
+		}
+
+		bool operator<(const StringRef & other) const
+		{
+			return compare(other) < 0;
+		}
+
+		bool operator<=(const StringRef & other) const
+		{
+			return compare(other) <= 0;
+		}
+
+		bool operator>(const StringRef & other) const
+		{
+			return compare(other) > 0;
+		}
+
+		bool operator>=(const StringRef & other) const
+		{
+			return compare(other) >= 0;
+		}
+
+		/// Hash of the bytes, which only follows the pointer of long strings.
+		size_t hash() const
+		{
+			boost::uint64_t hash = (head() ^ 0x9E3779B97F4A7C15ULL) * 0xFF51AFD7ED558CCDULL;
+			const char * const bytes = data();
+			for(size_t pos = PREFIX_SIZE; pos < size_; pos += 8)
+			{
+				boost::uint64_t word = 0;
+				::memcpy(&word, bytes + pos, std::min(size_t(8), size_ - pos));
+				hash = (hash ^ (hash >> 32) ^ word) * 0xFF51AFD7ED558CCDULL;
+			}
+			hash ^= hash >> 33;
+			return size_t(hash);
+		}
+	};
+
+	/// For boost::hash.
+	inline size_t hash_value(const StringRef & value)
+	{
+		return value.hash();
+	}
+
+	/// How the values of a column type are kept. Values are stored in the
+	/// buffer of a row, unless they are external, and point to bytes
+	/// elsewhere, which own() copies into an arena. Where values are copied
+	/// without those bytes, stash() appends them to a heap kept alongside,
+	/// and attach() points a copy back to them. Encoded values are codes
+	/// that only mean something in this process, see DictString.
+	template<class T>
+	struct ValueStorage
+	{
+		enum { external = false, encoded = false };
+
+		static void own(T &, StringArena &)
+		{
+		}
+
+		static void stash(const T &, std::vector<char> &)
+		{
+		}
+
+		static size_t attach(T &, const char *)
+		{
+			return 0;
+		}
+	};
+
+	template<>
+	struct ValueStorage<StringRef>
+	{
+		enum { external = true, encoded = false };
+
+		static void own(StringRef & value, StringArena & arena)
+		{
+			value.own(arena);
+		}
+
+		static void stash(const StringRef & value, std::vector<char> & heap)
+		{
+			if(!value.isInline())
+				heap.insert(heap.end(), value.data(), value.data() + value.size());
+		}
+
+		/// Returns the number of bytes of data the value now points to.
+		static size_t attach(StringRef & value, const char * data)
+		{
+			if(value.isInline())
+				return 0;
+			value = StringRef(data, value.size());
+			return value.size();
+		}
+	};
+}
+
+#endif
\ No newline at end of file
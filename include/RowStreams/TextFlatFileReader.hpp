@@ -4,94 +4,259 @@
 #include "RowStreams/Row.hpp"
 #include "RowStreams/ColumnDef.hpp"
 #include "RowStreams/Pipeline.hpp"
+#include "RowStreams/TextRowParser.hpp"
+#include "RowStreams/SchemaRowParser.hpp"
+#include "RowStreams/RowPredicate.hpp"
+#include "RowStreams/RowPool.hpp"
+#include "RowStreams/RowBatch.hpp"
 #include <vector>
 #include <string>
 #include <fstream>
 #include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <boost/iostreams/device/mapped_file.hpp>
 
 namespace RowStreams
 {
+	/// How TextFlatFileReader gets at the contents of the file.
+	enum TextReadMode
+	{
+		/// The file is read through an input stream in large chunks.
+		READ_STREAMED,
+		/// The whole file is memory mapped and fields are parsed straight
+		/// from the mapping, so no line is ever copied or modified.
+		READ_MAPPED
+	};
+
 	/// Reads rows from a text file containing newline delimited rows of tab
 	/// (or other configurable character) delimited columns.
-	class TextFlatFileReader
+	/// Field boundaries for a whole block of rows are found at once by a Tokenizer,
+	/// and the fields are turned into values by a TextRowParser, or by another
+	/// class with the same methods, like SchemaRowParser.
+	template<class RowParser = TextRowParser>
+	class BasicTextFlatFileReader
 	{
+		enum { BLOCK_ROWS = 1024, READ_CHUNK = 1 << 20 };
+
 		RowDef         rowDef_;
 		std::string    fileName_;
 		char           sep_;
+		TextReadMode   mode_;
 		std::ifstream  ifs_;
-		std::string    line_;
+		/// Holds the unread part of the file in streamed mode.
+		std::vector<char> buffer_;
+		bool           eof_;
+
+		boost::iostreams::mapped_file_source mapped_;
+		/// Unread part of the mapping or buffer.
+		const char *   pos_;
+		const char *   end_;
+
+		Tokenizer      tokenizer_;
+		TokenBlock     block_;
+		/// Start of the text block_ refers to.
+		const char *   blockBase_;
+		/// Next row of block_ to be parsed.
+		size_t         blockRow_;
 
-		typedef std::vector<const ColumnDef*> ColAttrs;
-		ColAttrs       colAttrs_;
+		RowParser      parser_;
+		/// Predicates of the filters down the stream, checked while parsing.
+		PushedPredicates predicates_;
+		size_t         parseErrors_;
+		RowPool        pool_;
+
+		/// Reads more of the file into the buffer, keeping its unread part.
+		/// Returns false at end of file.
+		bool fill()
+		{
+			if(mode_ == READ_MAPPED || !ifs_)
+				return false;
+
+			const size_t unread = end_ - pos_;
+			if(unread)
+				::memmove(&buffer_[0], pos_, unread);
+			if(buffer_.size() < unread + READ_CHUNK)
+				buffer_.resize(unread + READ_CHUNK);
+
+			ifs_.read(&buffer_[unread], buffer_.size() - unread);
+			const size_t count = size_t(ifs_.gcount());
+			pos_ = &buffer_[0];
+			end_ = pos_ + unread + count;
+			return count != 0;
+		}
+
+		/// Tokenizes the next block of complete rows. Returns false at end of file.
+		bool nextBlock(size_t maxRows)
+		{
+			for(;;)
+			{
+				const bool final = mode_ == READ_MAPPED || eof_;
+				const size_t consumed = tokenizer_.scan(pos_, end_, maxRows, block_, final);
+				if(block_.numRows())
+				{
+					blockBase_ = pos_;
+					blockRow_ = 0;
+					pos_ += consumed;
+					return true;
+				}
+				if(final)
+				{
+					blockRow_ = 0;
+					return false;
+				}
+				eof_ = !fill();
+			}
+		}
 
 	public:
-		TextFlatFileReader(const RowDef & rowDef, const std::string & file_name, const char sep = '\t')
-			: rowDef_(rowDef), fileName_(file_name), sep_(sep)
+		BasicTextFlatFileReader(const RowDef & rowDef, const std::string & file_name, const char sep = '\t',
+			TextReadMode mode = READ_STREAMED)
+			: rowDef_(rowDef), fileName_(file_name), sep_(sep), mode_(mode), eof_(false),
+			pos_(0), end_(0), tokenizer_(sep), blockBase_(0), blockRow_(0), parseErrors_(0)
 		{
 		}
 
-		TextFlatFileReader(const TextFlatFileReader & other)
-			: rowDef_(other.rowDef_), fileName_(other.fileName_), sep_(other.sep_)
+		BasicTextFlatFileReader(const BasicTextFlatFileReader & other)
+			: rowDef_(other.rowDef_), fileName_(other.fileName_), sep_(other.sep_), mode_(other.mode_),
+			eof_(false), pos_(0), end_(0), tokenizer_(other.tokenizer_), blockBase_(0), blockRow_(0),
+			parseErrors_(0)
 		{
 		}
 
-		TextFlatFileReader & operator=(const TextFlatFileReader & other)
+		BasicTextFlatFileReader & operator=(const BasicTextFlatFileReader & other)
 		{
 			rowDef_ = other.rowDef_;
 			fileName_ = other.fileName_;
 			sep_ = other.sep_;
+			mode_ = other.mode_;
+			tokenizer_ = other.tokenizer_;
+			return *this;
 		}
 
 		void init()
 		{
-			ifs_.open(fileName_.c_str());
-			if(!ifs_)
-				throw std::runtime_error("Failed to open "+fileName_);
+			if(mode_ == READ_MAPPED)
+			{
+				try
+				{
+					if(mapped_.is_open())
+						mapped_.close();
+					mapped_.open(fileName_);
+				}
+				catch(std::exception &)
+				{
+					throw std::runtime_error("Failed to map "+fileName_);
+				}
+				pos_ = mapped_.data();
+				end_ = pos_ + mapped_.size();
+			}
+			else
+			{
+				ifs_.open(fileName_.c_str(), std::ios::in | std::ios::binary);
+				if(!ifs_)
+					throw std::runtime_error("Failed to open "+fileName_);
+				buffer_.resize(READ_CHUNK);
+				pos_ = end_ = &buffer_[0];
+				eof_ = false;
+			}
+
+			pool_.rowDef(&rowDef_);
+			// Streamed chunks are reused, so values that point into them are
+			// copied; the mapping stays for as long as the reader.
+			parser_.copyValues(mode_ != READ_MAPPED);
+
 			// read header
-			std::getline(ifs_, line_);
-			size_t pos1 = 0;
-
-			size_t pos2;
-			do {
-				pos2 = line_.find_first_of(sep_, pos1);
-				std::string name = line_.substr(pos1, pos2);
-				pos1 = pos2+1;
-				colAttrs_.push_back(rowDef_.columnDef(name));
-			}while(pos2 != std::string::npos);
+			if(nextBlock(1))
+				parser_.mapHeader(rowDef_, block_, blockBase_, blockRow_++);
 		}
 
 		Row * next()
 		{
-			if(!ifs_.good())
-				return 0;
+			Row * row = 0;
+			for(;;)
+			{
+				if(blockRow_ == block_.numRows() && !nextBlock(BLOCK_ROWS))
+				{
+					if(row)
+						pool_.release(row);
+					return 0;
+				}
 
-			std::getline(ifs_, line_);
-			// Although potentially ambiguous, ignoring single carriage return in last line of file.
-			if(!ifs_.good() && line_.empty())
-				return 0;
+				// A row that fails the predicates is used again for the next one.
+				if(!row)
+					row = pool_.acquire();
+				if(predicates_.parse(parser_, block_, blockBase_, blockRow_++, *row, parseErrors_))
+					return row;
+			}
+		}
 
-			line_.append(1, '\0');
-			std::replace(line_.begin(), line_.end(), sep_, '\0');
+		/// Rows are created with the planned layout, so that they have room
+		/// for the columns added down the stream. Only the fields of columns
+		/// read down the stream are parsed, and the predicates that only read
+		/// columns of the file are checked as soon as their fields are
+		/// parsed, and the other fields of rejected rows are never parsed.
+		bool plan(PipelinePlan & plan)
+		{
+			if(plan.layout)
+				pool_.rowDef(plan.layout);
+			if(!plan.allColumns)
+				parser_.project(plan.usedColumns);
+			predicates_.take(plan.predicates, rowDef_);
+			parser_.prioritize(predicates_.columns());
+			return true;
+		}
 
-			ColAttrs::const_iterator col_attr = colAttrs_.begin();
-			const ColAttrs::const_iterator col_attr_end = colAttrs_.end();
+		/// Stops reading: no more rows come out, and a streamed file is
+		/// closed. A mapping is kept until the reader goes, since the rows
+		/// handed out may still point into it.
+		void stop()
+		{
+			block_.clear();
+			blockRow_ = 0;
+			pos_ = end_ = 0;
+			eof_ = true;
+			if(mode_ != READ_MAPPED)
+				ifs_.close();
+		}
 
-			Row * row = new Row(&rowDef_);
+		/// Takes back a row handed out by next() for reuse.
+		void release(Row * row)
+		{
+			pool_.release(row);
+		}
 
-			const char * field_str = line_.c_str();
-			for(std::string::size_type sep_pos = line_.find_first_of('\0');
-				sep_pos != std::string::npos;
-				++sep_pos, field_str = line_.c_str() + sep_pos, sep_pos = line_.find_first_of('\0', sep_pos), ++col_attr)
+		bool nextBatch(RowBatch & batch)
+		{
+			batch.clear();
+			while(!batch.full())
 			{
-				const ColumnDef * columnDef = *col_attr;
+				if(blockRow_ == block_.numRows() && !nextBlock(BLOCK_ROWS))
+					break;
 
-				if(!columnDef)
-					continue;
-
-				columnDef->parseString(field_str, *row);
+				const size_t count = std::min(block_.numRows() - blockRow_, RowBatch::CAPACITY - batch.size());
+				Row * row = 0;
+				for(size_t index = 0; index != count; ++index)
+				{
+					if(!row)
+						row = pool_.acquire();
+					if(predicates_.parse(parser_, block_, blockBase_, blockRow_++, *row, parseErrors_))
+					{
+						batch.add(row);
+						row = 0;
+					}
+				}
+				if(row)
+					pool_.release(row);
 			}
+			return !batch.empty();
+		}
 
-			return row;
+		void releaseBatch(RowBatch & batch)
+		{
+			for(size_t index = 0; index != batch.size(); ++index)
+				pool_.release(batch.row(index));
+			batch.clear();
 		}
 
 		/// This can be removed with a bit of work, but for now, everybody needs to define
@@ -105,13 +270,33 @@ namespace RowStreams
 		{
 			return rowDef_;
 		}
+
+		/// Number of fields so far that could not be parsed and were left null.
+		size_t parseErrors() const
+		{
+			return parseErrors_;
+		}
 	};
 
+	typedef BasicTextFlatFileReader<> TextFlatFileReader;
+
 	/// Bridge used in the pipeline construction syntax.
+	/// Pass READ_MAPPED as mode to parse straight from a memory mapping of the file.
 	PartialPipeline<TextFlatFileReader> 
-		read_text_file(const RowDef & row_def, const std::string & file_name, const char sep = '\t')
+		read_text_file(const RowDef & row_def, const std::string & file_name, const char sep = '\t',
+			TextReadMode mode = READ_STREAMED)
+	{
+		return PartialPipeline<TextFlatFileReader>(NoModule(), TextFlatFileReader(row_def, file_name, sep, mode));
+	}
+
+	/// Reads rows laid out by a Schema, with no virtual calls per value.
+	/// Call as read_text_file<MySchema>(file_name).
+	template<class SchemaType>
+	PartialPipeline<BasicTextFlatFileReader<SchemaRowParser<SchemaType> > >
+		read_text_file(const std::string & file_name, const char sep = '\t', TextReadMode mode = READ_STREAMED)
 	{
-		return PartialPipeline<TextFlatFileReader>(NoModule(), TextFlatFileReader(row_def, file_name, sep));
+		typedef BasicTextFlatFileReader<SchemaRowParser<SchemaType> > Reader;
+		return PartialPipeline<Reader>(NoModule(), Reader(SchemaType::rowDef(), file_name, sep, mode));
 	}
 
 }
@@ -2,6 +2,10 @@
 #define ROWSTREAMS_TEXT_FLAT_FILE_WRITER_HPP
 
 #include "RowStreams/RowDef.hpp"
+#include "RowStreams/RowBatch.hpp"
+#include "RowStreams/OutputBuffer.hpp"
+#include "RowStreams/TextRowFormatter.hpp"
+#include "RowStreams/SchemaRowFormatter.hpp"
 #include <string>
 #include <fstream>
 #include <stdexcept>
@@ -11,9 +15,15 @@ namespace RowStreams
 	/// Stores a row stream in a text file.
 	/// By default uses tab characters are in between columns and
 	/// newline characters in between rows.
-	template<class Source>
+	/// Values are formatted straight into a buffer that is written out to
+	/// the file in big blocks, by TextRowFormatter or another class with the
+	/// same methods, like SchemaRowFormatter.
+	template<class Source, class RowFormatter = TextRowFormatter>
 	class TextFlatFileWriter
 	{
+		/// Size the buffer is written out at.
+		enum { FLUSH_SIZE = 1 << 20 };
+
 		/// Row source. We don't own it, so no deletes.
 		Source * source_;
 		std::string fileName_;
@@ -21,15 +31,18 @@ namespace RowStreams
 		char rowSep_;
 		std::ofstream ofs_;
 		RowDef rowDef_;
+		RowFormatter formatter_;
+		OutputBuffer buffer_;
 
 	public:
-		TextFlatFileWriter(const std::string & fileName)
-			: source_(0), fileName_(fileName), colSep_('\t'), rowSep_('\n')
+		TextFlatFileWriter(const std::string & fileName, const RowFormatter & formatter = RowFormatter())
+			: source_(0), fileName_(fileName), colSep_('\t'), rowSep_('\n'), formatter_(formatter)
 		{
 		}
 
 		TextFlatFileWriter(const TextFlatFileWriter & other)
-			: source_(0), fileName_(other.fileName_), colSep_(other.colSep_), rowSep_(other.rowSep_)
+			: source_(0), fileName_(other.fileName_), colSep_(other.colSep_), rowSep_(other.rowSep_),
+			formatter_(other.formatter_)
 		{
 		}
 
@@ -41,6 +54,7 @@ namespace RowStreams
 			fileName_ = other.fileName_;
 			colSep_ = other.colSep_;
 			rowSep_ = other.rowSep_;
+			formatter_ = other.formatter_;
 		}
 
 		void source(Source * source)
@@ -57,82 +71,112 @@ namespace RowStreams
 				throw new std::runtime_error("Could not open file "+fileName_);
 
 			rowDef_ = source_->rowDef();
+			formatter_.init(rowDef_);
+			buffer_.clear();
+			buffer_.reserve(FLUSH_SIZE + FLUSH_SIZE / 4);
 		}
 
-		void run()
+		/// Starts the plan with the layout of the rows that get here, and
+		/// the columns that are written.
+		bool plan(PipelinePlan & plan)
 		{
+			if(!plan.layout)
+				plan.layout = &rowDef_;
+			plan.allColumns = false;
+			plan.usedColumns.clear();
+			formatter_.columns(plan.usedColumns);
+			source_->plan(plan);
+			return false;
+		}
 
-			bool first = true;
-			for(RowDef::ConstAttrIter col_iter = rowDef_.begin();
-				col_iter != rowDef_.end();
-				++col_iter)
-			{
-				if(!first)
-				{
-					ofs_ << colSep_;
-				}
-				else
-				{
-					first = false;
-				}
-
-				ColumnDef * col = *col_iter;
-				ofs_ << col->name();
-			}
-			ofs_ << rowSep_;
+		void run()
+		{
+			formatter_.formatHeader(colSep_, buffer_);
+			buffer_.append(rowSep_);
 			
-			while(Row * row = source_->next())
+			RowBatch batch;
+			while(source_->nextBatch(batch))
 			{
-				bool first = true;
-				for(RowDef::ConstAttrIter col_iter = rowDef_.begin();
-					col_iter != rowDef_.end();
-					++col_iter)
-				{
-					if(!first)
-					{
-						ofs_ << colSep_;
-					}
-					else
-					{
-						first = false;
-					}
-
-					ColumnDef * col = *col_iter;
-					ofs_ << col->toString(*row);
-				}
-				ofs_ << rowSep_;
+				writeBatch(batch);
+				source_->releaseBatch(batch);
 			}
 
+			flush();
+			ofs_.flush();
+			if(!ofs_)
+				throw std::runtime_error("Could not write to file "+fileName_);
+		}
+
+		void writeRow(const Row & row)
+		{
+			formatter_.formatRow(row, colSep_, buffer_);
+			buffer_.append(rowSep_);
+
+			if(buffer_.size() >= FLUSH_SIZE)
+				flush();
+		}
+
+		/// Writes the selected rows of a batch.
+		void writeBatch(const RowBatch & batch)
+		{
+			for(size_t index = 0; index != batch.selected(); ++index)
+				writeRow(*batch.selectedRow(index));
+		}
+
+	private:
+		/// Hands the buffered text over to the file in one go.
+		void flush()
+		{
+			ofs_.write(buffer_.data(), buffer_.size());
+			buffer_.clear();
 		}
 	};
 
 	/// Bridge class used in the pipeline construction syntax.
+	template<class RowFormatter = TextRowFormatter>
 	class TextFlatFileWriterPrototype
 	{
 		std::string fileName_;
+		RowFormatter formatter_;
 	public:
 
 		template<class Source>
 		struct ForSource
 		{
-			typedef TextFlatFileWriter<Source> Type;
+			typedef TextFlatFileWriter<Source, RowFormatter> Type;
 		};
 		
-		TextFlatFileWriterPrototype(const std::string & fileName)
-			: fileName_(fileName)
+		TextFlatFileWriterPrototype(const std::string & fileName, const RowFormatter & formatter = RowFormatter())
+			: fileName_(fileName), formatter_(formatter)
 		{
 		}
 
 		template<class Source>
-		TextFlatFileWriter<Source> create() const
+		TextFlatFileWriter<Source, RowFormatter> create() const
 		{
-			return TextFlatFileWriter<Source>(fileName_);
+			return TextFlatFileWriter<Source, RowFormatter>(fileName_, formatter_);
 		}
 	};
 
-	TextFlatFileWriterPrototype write_text_file(const std::string & fileName)
+	TextFlatFileWriterPrototype<> write_text_file(const std::string & fileName)
+	{
+		return TextFlatFileWriterPrototype<>(fileName);
+	}
+
+	/// Writes only some of the columns, in the order given, which also
+	/// spares the reader the parsing of the others:
+	/// write_text_file("out.txt", ColumnNames() << "a" << "c")
+	TextFlatFileWriterPrototype<> write_text_file(const std::string & fileName, const ColumnNames & columns)
+	{
+		return TextFlatFileWriterPrototype<>(fileName, TextRowFormatter(columns));
+	}
+
+	/// Writes the fields of a Schema, with no virtual calls per value.
+	/// Call as write_text_file<MySchema>(fileName).
+	template<class SchemaType>
+	TextFlatFileWriterPrototype<SchemaRowFormatter<SchemaType> > write_text_file(const std::string & fileName)
 	{
-		return TextFlatFileWriterPrototype(fileName);
+		return TextFlatFileWriterPrototype<SchemaRowFormatter<SchemaType> >(fileName);
 	}
 
 } // end namespace RowStreams
@@ -0,0 +1,87 @@
+#ifndef ROWSTREAMS_TEXT_ROW_FORMATTER_HPP
+#define ROWSTREAMS_TEXT_ROW_FORMATTER_HPP
+
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/Row.hpp"
+#include "RowStreams/OutputBuffer.hpp"
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+namespace RowStreams
+{
+	/// Writes rows as text through the ColumnDefs of their RowDef, one
+	/// column after the other. Either all columns are written, or only those
+	/// given to the constructor, in that order.
+	class TextRowFormatter
+	{
+		typedef std::vector<const ColumnDef*> ColAttrs;
+		ColAttrs colAttrs_;
+		std::vector<std::string> names_;
+		/// Columns to write, or empty for all of them.
+		std::vector<std::string> selected_;
+
+	public:
+		TextRowFormatter()
+		{
+		}
+
+		explicit TextRowFormatter(const std::vector<std::string> & columns)
+			: selected_(columns)
+		{
+		}
+
+		/// The RowDef has to outlive the formatter.
+		void init(const RowDef & rowDef)
+		{
+			colAttrs_.clear();
+			names_.clear();
+			if(selected_.empty())
+			{
+				for(RowDef::ConstAttrIter col_iter = rowDef.begin(); col_iter != rowDef.end(); ++col_iter)
+				{
+					colAttrs_.push_back(*col_iter);
+					names_.push_back((*col_iter)->name());
+				}
+				return;
+			}
+
+			for(std::vector<std::string>::const_iterator name = selected_.begin(); name != selected_.end(); ++name)
+			{
+				const ColumnDef * columnDef = rowDef.columnDef(*name);
+				if(!columnDef)
+					throw std::runtime_error("No column "+*name+" to write");
+				colAttrs_.push_back(columnDef);
+				names_.push_back(*name);
+			}
+		}
+
+		/// Appends the names of the columns written to names.
+		void columns(std::vector<std::string> & names) const
+		{
+			names.insert(names.end(), names_.begin(), names_.end());
+		}
+
+		void formatHeader(char colSep, OutputBuffer & out) const
+		{
+			for(size_t col = 0; col != names_.size(); ++col)
+			{
+				if(col)
+					out.append(colSep);
+				out.append(names_[col].data(), names_[col].size());
+			}
+		}
+
+		void formatRow(const Row & row, char colSep, OutputBuffer & out) const
+		{
+			for(size_t col = 0; col != colAttrs_.size(); ++col)
+			{
+				if(col)
+					out.append(colSep);
+				colAttrs_[col]->format(row, out);
+			}
+		}
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,131 @@
+#ifndef ROWSTREAMS_TEXT_ROW_PARSER_HPP
+#define ROWSTREAMS_TEXT_ROW_PARSER_HPP
+
+#include "RowStreams/Row.hpp"
+#include "RowStreams/ColumnDef.hpp"
+#include "RowStreams/Tokenizer.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+
+namespace RowStreams
+{
+	/// Which fields of a row a parser parses. Sources that check predicates
+	/// while parsing do the fields the predicates need first, and the rest
+	/// only for rows that pass.
+	enum FieldSet
+	{
+		FIELDS_ALL,
+		/// The fields set with TextRowParser::prioritize().
+		FIELDS_EARLY,
+		FIELDS_LATE
+	};
+
+	/// Converts the fields of tokenized text rows into Row values, using a header
+	/// row to find out which ColumnDef each field position belongs to.
+	/// Parsing is const, so one parser can be shared by several threads.
+	class TextRowParser
+	{
+		typedef std::vector<const ColumnDef*> ColAttrs;
+		ColAttrs colAttrs_;
+		/// Whether the field at each position is parsed early, see FieldSet.
+		std::vector<char> early_;
+		/// Whether the column at each position has external values.
+		std::vector<char> external_;
+		/// Whether external values are copied into the rows.
+		bool copy_;
+
+	public:
+		TextRowParser()
+			: copy_(false)
+		{
+		}
+
+		/// Gets the text of a field in a block of rows starting at base.
+		static void field(const TokenBlock & block, const char * base, size_t index, size_t last,
+			const char ** begin, const char ** end)
+		{
+			*begin = base + block.fieldBegin(index);
+			*end = base + block.fieldEnd(index);
+			// Tolerate files with DOS line endings, which are read untranslated.
+			if(index + 1 == last && *end != *begin && (*end)[-1] == '\r')
+				--*end;
+		}
+
+		/// Maps the fields of a header row to the columns of rowDef with the same name.
+		/// Fields without a matching column are skipped when parsing.
+		void mapHeader(const RowDef & rowDef, const TokenBlock & block, const char * base, size_t row)
+		{
+			colAttrs_.clear();
+			const size_t last = block.lastField(row);
+			for(size_t index = block.firstField(row); index != last; ++index)
+			{
+				const char * name;
+				const char * name_end;
+				field(block, base, index, last, &name, &name_end);
+				colAttrs_.push_back(rowDef.columnDef(std::string(name, name_end)));
+			}
+			early_.assign(colAttrs_.size(), 0);
+			external_.assign(colAttrs_.size(), 0);
+			for(size_t col = 0; col != colAttrs_.size(); ++col)
+				external_[col] = colAttrs_[col] && colAttrs_[col]->external();
+		}
+
+		/// Tells whether the text is gone before the rows parsed from it, in
+		/// which case values that point into it, like strings, are copied into
+		/// the arena of the rows.
+		void copyValues(bool copy)
+		{
+			copy_ = copy;
+		}
+
+		/// Only parses the fields of the given columns from now on, leaving
+		/// the other columns null. Called after mapHeader().
+		void project(const std::vector<std::string> & columns)
+		{
+			for(size_t col = 0; col != colAttrs_.size(); ++col)
+			{
+				if(colAttrs_[col] && std::find(columns.begin(), columns.end(), colAttrs_[col]->name()) == columns.end())
+					colAttrs_[col] = 0;
+			}
+		}
+
+		/// Makes the fields of the given columns the early ones. Called after mapHeader().
+		void prioritize(const std::vector<std::string> & columns)
+		{
+			for(size_t col = 0; col != colAttrs_.size(); ++col)
+			{
+				early_[col] = colAttrs_[col]
+					&& std::find(columns.begin(), columns.end(), colAttrs_[col]->name()) != columns.end();
+			}
+		}
+
+		/// Returns the number of fields that could not be parsed, which are left null.
+		size_t parseRow(const TokenBlock & block, const char * base, size_t row, Row & out,
+			FieldSet fields = FIELDS_ALL) const
+		{
+			const size_t first = block.firstField(row);
+			const size_t last = block.lastField(row);
+			const size_t count = std::min(last - first, colAttrs_.size());
+			size_t errors = 0;
+
+			for(size_t col = 0; col != count; ++col)
+			{
+				const ColumnDef * columnDef = colAttrs_[col];
+				if(!columnDef || (fields != FIELDS_ALL && (early_[col] != 0) != (fields == FIELDS_EARLY)))
+					continue;
+
+				const char * value;
+				const char * value_end;
+				field(block, base, first + col, last, &value, &value_end);
+				const ParseResult result = columnDef->parseString(value, value_end - value, out);
+				if(result == PARSE_OK && copy_ && external_[col])
+					columnDef->own(out);
+				errors += result != PARSE_OK && result != PARSE_EMPTY;
+			}
+			return errors;
+		}
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,289 @@
+#ifndef ROWSTREAMS_TOKENIZER_HPP
+#define ROWSTREAMS_TOKENIZER_HPP
+
+#include <vector>
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#	define ROWSTREAMS_TOKENIZER_SSE2
+#	include <emmintrin.h>
+#	if defined(_MSC_VER)
+#		include <intrin.h>
+#		if _MSC_VER >= 1700
+#			define ROWSTREAMS_TOKENIZER_AVX2
+#			define ROWSTREAMS_TARGET_AVX2
+#			include <immintrin.h>
+#		endif
+#	elif defined(__GNUC__)
+#		define ROWSTREAMS_TOKENIZER_AVX2
+#		define ROWSTREAMS_TARGET_AVX2 __attribute__((target("avx2")))
+#		include <immintrin.h>
+#	endif
+#endif
+
+namespace RowStreams
+{
+	/// Field boundaries of a block of complete rows found by Tokenizer.
+	/// All offsets are relative to the start of the scanned buffer.
+	struct TokenBlock
+	{
+		typedef boost::uint32_t Offset;
+
+		/// Offset of the separator that ends each field, for all rows in the block.
+		std::vector<Offset> fieldEnds;
+		/// For each row, the index in fieldEnds one past its last field.
+		std::vector<Offset> rowEnds;
+
+		void clear()
+		{
+			fieldEnds.clear();
+			rowEnds.clear();
+		}
+
+		size_t numRows() const
+		{
+			return rowEnds.size();
+		}
+
+		/// Index in fieldEnds of the first field of a row.
+		size_t firstField(size_t row) const
+		{
+			return row ? rowEnds[row - 1] : 0;
+		}
+
+		size_t lastField(size_t row) const
+		{
+			return rowEnds[row];
+		}
+
+		/// Offset of the first character of a field.
+		Offset fieldBegin(size_t field) const
+		{
+			return field ? fieldEnds[field - 1] + 1 : 0;
+		}
+
+		Offset fieldEnd(size_t field) const
+		{
+			return fieldEnds[field];
+		}
+	};
+
+	namespace TokenizerKernels
+	{
+		typedef void (*Kernel)(const char * buf, size_t length, char colSep, char rowSep,
+			size_t maxRows, TokenBlock & block);
+
+		/// Records a separator found at pos. Returns true once the block is full.
+		inline bool record(const char * buf, size_t pos, char rowSep, size_t maxRows, TokenBlock & block)
+		{
+			block.fieldEnds.push_back(TokenBlock::Offset(pos));
+			if(buf[pos] != rowSep)
+				return false;
+			block.rowEnds.push_back(TokenBlock::Offset(block.fieldEnds.size()));
+			return block.rowEnds.size() == maxRows;
+		}
+
+		inline void scalarFrom(const char * buf, size_t pos, size_t length, char colSep, char rowSep,
+			size_t maxRows, TokenBlock & block)
+		{
+			for(; pos < length; ++pos)
+			{
+				const char c = buf[pos];
+				if((c == colSep || c == rowSep) && record(buf, pos, rowSep, maxRows, block))
+					return;
+			}
+		}
+
+		inline void scalar(const char * buf, size_t length, char colSep, char rowSep,
+			size_t maxRows, TokenBlock & block)
+		{
+			scalarFrom(buf, 0, length, colSep, rowSep, maxRows, block);
+		}
+
+#ifdef ROWSTREAMS_TOKENIZER_SSE2
+		inline unsigned countTrailingZeros(unsigned mask)
+		{
+#	ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return unsigned(index);
+#	else
+			return unsigned(__builtin_ctz(mask));
+#	endif
+		}
+
+		/// Walks the separator positions flagged in mask. Returns true once the block is full.
+		inline bool recordMask(const char * buf, size_t base, unsigned mask, char rowSep,
+			size_t maxRows, TokenBlock & block)
+		{
+			while(mask)
+			{
+				if(record(buf, base + countTrailingZeros(mask), rowSep, maxRows, block))
+					return true;
+				mask &= mask - 1;
+			}
+			return false;
+		}
+
+		inline void sse2(const char * buf, size_t length, char colSep, char rowSep,
+			size_t maxRows, TokenBlock & block)
+		{
+			const __m128i col = _mm_set1_epi8(colSep);
+			const __m128i row = _mm_set1_epi8(rowSep);
+			size_t pos = 0;
+			for(; pos + 16 <= length; pos += 16)
+			{
+				const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + pos));
+				const unsigned mask = unsigned(_mm_movemask_epi8(
+					_mm_or_si128(_mm_cmpeq_epi8(chunk, col), _mm_cmpeq_epi8(chunk, row))));
+				if(recordMask(buf, pos, mask, rowSep, maxRows, block))
+					return;
+			}
+			scalarFrom(buf, pos, length, colSep, rowSep, maxRows, block);
+		}
+#endif
+
+#ifdef ROWSTREAMS_TOKENIZER_AVX2
+		ROWSTREAMS_TARGET_AVX2
+		inline void avx2(const char * buf, size_t length, char colSep, char rowSep,
+			size_t maxRows, TokenBlock & block)
+		{
+			const __m256i col = _mm256_set1_epi8(colSep);
+			const __m256i row = _mm256_set1_epi8(rowSep);
+			size_t pos = 0;
+			for(; pos + 32 <= length; pos += 32)
+			{
+				const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + pos));
+				const unsigned mask = unsigned(_mm256_movemask_epi8(
+					_mm256_or_si256(_mm256_cmpeq_epi8(chunk, col), _mm256_cmpeq_epi8(chunk, row))));
+				if(recordMask(buf, pos, mask, rowSep, maxRows, block))
+					return;
+			}
+			scalarFrom(buf, pos, length, colSep, rowSep, maxRows, block);
+		}
+#endif
+
+		inline bool cpuHasSse2()
+		{
+#if defined(_M_X64) || defined(__x86_64__)
+			return true;
+#elif defined(ROWSTREAMS_TOKENIZER_SSE2) && defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 1);
+			return (info[3] & (1 << 26)) != 0;
+#elif defined(ROWSTREAMS_TOKENIZER_SSE2)
+			return __builtin_cpu_supports("sse2") != 0;
+#else
+			return false;
+#endif
+		}
+
+		inline bool cpuHasAvx2()
+		{
+#if defined(ROWSTREAMS_TOKENIZER_AVX2) && defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 1);
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool avx = (info[2] & (1 << 28)) != 0;
+			// The OS must also save the upper halves of the ymm registers.
+			if(!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+				return false;
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#elif defined(ROWSTREAMS_TOKENIZER_AVX2)
+			return __builtin_cpu_supports("avx2") != 0;
+#else
+			return false;
+#endif
+		}
+
+		/// Picks the widest kernel the running CPU supports.
+		inline Kernel best(const char ** name)
+		{
+#ifdef ROWSTREAMS_TOKENIZER_AVX2
+			if(cpuHasAvx2())
+			{
+				*name = "avx2";
+				return &avx2;
+			}
+#endif
+#ifdef ROWSTREAMS_TOKENIZER_SSE2
+			if(cpuHasSse2())
+			{
+				*name = "sse2";
+				return &sse2;
+			}
+#endif
+			*name = "scalar";
+			return &scalar;
+		}
+	}
+
+	/// Splits a buffer of text rows into fields, finding column and row separators
+	/// in a single vectorized pass. The instruction set is chosen at runtime.
+	class Tokenizer
+	{
+		char colSep_;
+		char rowSep_;
+		TokenizerKernels::Kernel kernel_;
+		const char * kernelName_;
+
+	public:
+		Tokenizer(char colSep = '\t', char rowSep = '\n')
+			: colSep_(colSep), rowSep_(rowSep), kernel_(TokenizerKernels::best(&kernelName_))
+		{
+		}
+
+		/// Finds the fields of up to maxRows complete rows at the start of [begin, end)
+		/// and returns the number of bytes they take. If final is set, trailing
+		/// characters without a row separator count as one last row.
+		size_t scan(const char * begin, const char * end, size_t maxRows, TokenBlock & block, bool final) const
+		{
+			block.clear();
+
+			// Offsets are 32 bits wide, which is plenty for one block of rows.
+			const size_t max_length = size_t(TokenBlock::Offset(-1));
+			size_t length = size_t(end - begin);
+			if(length > max_length)
+			{
+				length = max_length;
+				final = false;
+			}
+
+			kernel_(begin, length, colSep_, rowSep_, maxRows, block);
+
+			// Drop the fields of a trailing incomplete row...
+			const size_t complete_fields = block.numRows() ? block.rowEnds.back() : 0;
+			const size_t consumed = complete_fields ? block.fieldEnds[complete_fields - 1] + 1 : 0;
+			if(block.numRows() == maxRows || !final || consumed == length)
+			{
+				block.fieldEnds.resize(complete_fields);
+				return consumed;
+			}
+
+			// ...unless it is the last one in the input.
+			block.fieldEnds.push_back(TokenBlock::Offset(length));
+			block.rowEnds.push_back(TokenBlock::Offset(block.fieldEnds.size()));
+			return length;
+		}
+
+		char colSep() const
+		{
+			return colSep_;
+		}
+
+		char rowSep() const
+		{
+			return rowSep_;
+		}
+
+		/// Name of the instruction set used, for diagnostics.
+		const char * kernelName() const
+		{
+			return kernelName_;
+		}
+	};
+}
+
+#endif
\ No newline at end of file
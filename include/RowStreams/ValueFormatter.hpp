@@ -0,0 +1,361 @@
+#ifndef ROWSTREAMS_VALUE_FORMATTER_HPP
+#define ROWSTREAMS_VALUE_FORMATTER_HPP
+
+#include "RowStreams/OutputBuffer.hpp"
+#include "RowStreams/ValueParser.hpp"
+#include "RowStreams/StringRef.hpp"
+#include "RowStreams/Dictionary.hpp"
+#include "RowStreams/DateTime.hpp"
+#include "RowStreams/ShortestDigits.hpp"
+#include <sstream>
+#include <string>
+#include <locale>
+#include <limits>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include <boost/type_traits/make_unsigned.hpp>
+#include <boost/math/special_functions/sign.hpp>
+
+namespace RowStreams
+{
+	namespace ValueFormatters
+	{
+		/// Writes the digits of an unsigned integer so that they end right
+		/// before end, two at a time, and returns where they begin.
+		template<class Unsigned>
+		char * formatDigits(Unsigned value, char * end)
+		{
+			static const char pairs[] =
+				"00010203040506070809"
+				"10111213141516171819"
+				"20212223242526272829"
+				"30313233343536373839"
+				"40414243444546474849"
+				"50515253545556575859"
+				"60616263646566676869"
+				"70717273747576777879"
+				"80818283848586878889"
+				"90919293949596979899";
+
+			while(value >= 100)
+			{
+				const unsigned pair = unsigned(value % 100) * 2;
+				value /= 100;
+				*--end = pairs[pair + 1];
+				*--end = pairs[pair];
+			}
+			if(value >= 10)
+			{
+				const unsigned pair = unsigned(value) * 2;
+				*--end = pairs[pair + 1];
+				*--end = pairs[pair];
+			}
+			else
+			{
+				*--end = char('0' + value);
+			}
+			return end;
+		}
+
+		/// Writes count digits of value, zero padded, and returns the end.
+		inline char * formatFixed(unsigned value, size_t count, char * out)
+		{
+			for(size_t pos = count; pos-- != 0; )
+			{
+				out[pos] = char('0' + value % 10);
+				value /= 10;
+			}
+			return out + count;
+		}
+
+		/// Writes a date as YYYY-MM-DD, with a sign for years past 9999 or
+		/// before 0, as ValueParsers::parseDate() reads them. Needs room for
+		/// 16 characters.
+		inline char * formatDate(const Date & date, char * out)
+		{
+			int year;
+			unsigned month, day;
+			date.civil(year, month, day);
+			if(year >= 0 && year <= 9999)
+			{
+				out = formatFixed(unsigned(year), 4, out);
+			}
+			else
+			{
+				*out++ = year < 0 ? '-' : '+';
+				const unsigned magnitude = unsigned(year < 0 ? -year : year);
+				out = formatFixed(magnitude, magnitude > 999999 ? 7 : magnitude > 99999 ? 6 : magnitude > 9999 ? 5 : 4, out);
+			}
+			*out++ = '-';
+			out = formatFixed(month, 2, out);
+			*out++ = '-';
+			return formatFixed(day, 2, out);
+		}
+	}
+
+	/// Writes a value as text into an OutputBuffer, in a form ValueParser
+	/// reads back. Null values are written by not writing anything at all.
+	/// Uses stream insertion in the classic locale, so it is slow, but works
+	/// for any type with an output operator.
+	template<class T>
+	class ValueFormatter
+	{
+	public:
+		void format(const T & value, OutputBuffer & out) const
+		{
+			std::ostringstream os;
+			os.imbue(std::locale::classic());
+			os << value;
+			const std::string str = os.str();
+			out.append(str.data(), str.size());
+		}
+	};
+
+	/// Formatter for integers of any width, without going through the C or
+	/// C++ libraries.
+	template<class T>
+	class IntegerFormatter
+	{
+		typedef typename boost::make_unsigned<T>::type Unsigned;
+
+	public:
+		void format(T value, OutputBuffer & out) const
+		{
+			char digits[std::numeric_limits<Unsigned>::digits10 + 3];
+			char * const end = digits + sizeof(digits);
+
+			const bool negative = std::numeric_limits<T>::is_signed && value < T(0);
+			char * begin = ValueFormatters::formatDigits(
+				negative ? Unsigned(Unsigned(0) - Unsigned(value)) : Unsigned(value), end);
+			if(negative)
+				*--begin = '-';
+			out.append(begin, end - begin);
+		}
+	};
+
+	/// Formatter for float and double that writes the shortest text which
+	/// reads back as the very same value. Values with a few decimals, by far
+	/// the most common in flat files, are written as a scaled integer; the
+	/// rest as the shortest digits of ShortestDigits, in plain or scientific
+	/// notation, never depending on the locale.
+	template<class T>
+	class FloatFormatter
+	{
+		enum
+		{
+			/// Most decimals tried with the scaled integer path. Powers of ten
+			/// up to here are exact in both float and double.
+			MAX_DECIMALS = 9,
+			/// Most digits before the point written without an exponent.
+			MAX_PLAIN = 21
+		};
+
+		static bool formatScaled(T value, OutputBuffer & out)
+		{
+			const T limit = T(boost::uint64_t(1) << std::numeric_limits<T>::digits);
+			// The sign bit, so that -0 keeps its sign.
+			const bool negative = (boost::math::signbit)(value) != 0;
+			const T magnitude = negative ? -value : value;
+
+			T scale = 1;
+			for(int decimals = 0; decimals <= MAX_DECIMALS; ++decimals, scale *= 10)
+			{
+				const T scaled = magnitude * scale;
+				if(!(scaled < limit))
+					return false;
+
+				// The parser turns the text back into this same division, so
+				// passing this check guarantees the round trip.
+				const boost::uint64_t mantissa = boost::uint64_t(scaled + T(0.5));
+				if(T(mantissa) / scale != magnitude)
+					continue;
+
+				char digits[32];
+				char * const end = digits + sizeof(digits);
+				char * begin = ValueFormatters::formatDigits(mantissa, end);
+				while(end - begin <= decimals)
+					*--begin = '0';
+
+				char * dest = out.reserve(end - begin + 2);
+				char * const start = dest;
+				if(negative)
+					*dest++ = '-';
+				const char * point = end - decimals;
+				for(; begin != point; ++begin)
+					*dest++ = *begin;
+				if(decimals)
+				{
+					*dest++ = '.';
+					for(; begin != end; ++begin)
+						*dest++ = *begin;
+				}
+				out.commit(dest - start);
+				return true;
+			}
+			return false;
+		}
+
+		static void formatShortest(T value, OutputBuffer & out)
+		{
+			const bool negative = value < T(0);
+			char digits[32];
+			int exponent;
+			const int length = ShortestDigits::digits(negative ? -value : value, digits, exponent);
+			// Where the point goes, counted from the first digit.
+			const int point = length + exponent;
+
+			char * dest = out.reserve(length + 32);
+			char * const start = dest;
+			if(negative)
+				*dest++ = '-';
+			if(exponent >= 0 && point <= MAX_PLAIN)
+			{
+				dest = std::copy(digits, digits + length, dest);
+				for(int zeros = 0; zeros < exponent; ++zeros)
+					*dest++ = '0';
+			}
+			else if(point > 0 && point <= MAX_PLAIN)
+			{
+				dest = std::copy(digits, digits + point, dest);
+				*dest++ = '.';
+				dest = std::copy(digits + point, digits + length, dest);
+			}
+			else if(point > -6 && point <= 0)
+			{
+				*dest++ = '0';
+				*dest++ = '.';
+				for(int zeros = point; zeros < 0; ++zeros)
+					*dest++ = '0';
+				dest = std::copy(digits, digits + length, dest);
+			}
+			else
+			{
+				*dest++ = digits[0];
+				if(length > 1)
+				{
+					*dest++ = '.';
+					dest = std::copy(digits + 1, digits + length, dest);
+				}
+				*dest++ = 'e';
+				int power = point - 1;
+				if(power < 0)
+				{
+					*dest++ = '-';
+					power = -power;
+				}
+				char buffer[8];
+				char * const end = buffer + sizeof(buffer);
+				dest = std::copy(ValueFormatters::formatDigits(unsigned(power), end), end, dest);
+			}
+			out.commit(dest - start);
+		}
+
+	public:
+		void format(T value, OutputBuffer & out) const
+		{
+			if(value != value)
+			{
+				out.append("nan", 3);
+				return;
+			}
+			if(value - value != value - value)
+			{
+				if(value < T(0))
+					out.append("-inf", 4);
+				else
+					out.append("inf", 3);
+				return;
+			}
+
+			if(!formatScaled(value, out))
+				formatShortest(value, out);
+		}
+	};
+
+#define ROWSTREAMS_VALUE_FORMATTER(type, formatter) \
+	template<> \
+	class ValueFormatter<type> : public formatter<type> \
+	{ \
+	};
+
+	ROWSTREAMS_VALUE_FORMATTER(signed char, IntegerFormatter)
+	ROWSTREAMS_VALUE_FORMATTER(unsigned char, IntegerFormatter)
+	ROWSTREAMS_VALUE_FORMATTER(short, IntegerFormatter)
+	ROWSTREAMS_VALUE_FORMATTER(unsigned short, IntegerFormatter)
+	ROWSTREAMS_VALUE_FORMATTER(int, IntegerFormatter)
+	ROWSTREAMS_VALUE_FORMATTER(unsigned int, IntegerFormatter)
+	ROWSTREAMS_VALUE_FORMATTER(long, IntegerFormatter)
+	ROWSTREAMS_VALUE_FORMATTER(unsigned long, IntegerFormatter)
+	ROWSTREAMS_VALUE_FORMATTER(long long, IntegerFormatter)
+	ROWSTREAMS_VALUE_FORMATTER(unsigned long long, IntegerFormatter)
+	ROWSTREAMS_VALUE_FORMATTER(float, FloatFormatter)
+	ROWSTREAMS_VALUE_FORMATTER(double, FloatFormatter)
+
+#undef ROWSTREAMS_VALUE_FORMATTER
+
+	/// Dates as YYYY-MM-DD.
+	template<>
+	class ValueFormatter<Date>
+	{
+	public:
+		void format(const Date & value, OutputBuffer & out) const
+		{
+			char * const begin = out.reserve(16);
+			out.commit(ValueFormatters::formatDate(value, begin) - begin);
+		}
+	};
+
+	/// Timestamps are written in UTC as YYYY-MM-DDTHH:MM:SS, followed by the
+	/// microseconds when there are any.
+	template<>
+	class ValueFormatter<Timestamp>
+	{
+	public:
+		void format(const Timestamp & value, OutputBuffer & out) const
+		{
+			char * const begin = out.reserve(32);
+			char * dest = ValueFormatters::formatDate(value.date(), begin);
+			const boost::int64_t time = value.timeOfDay();
+			const unsigned seconds = unsigned(time / DateTimes::SECOND);
+			const unsigned micros = unsigned(time % DateTimes::SECOND);
+			*dest++ = 'T';
+			dest = ValueFormatters::formatFixed(seconds / 3600, 2, dest);
+			*dest++ = ':';
+			dest = ValueFormatters::formatFixed(seconds / 60 % 60, 2, dest);
+			*dest++ = ':';
+			dest = ValueFormatters::formatFixed(seconds % 60, 2, dest);
+			if(micros)
+			{
+				*dest++ = '.';
+				dest = ValueFormatters::formatFixed(micros, 6, dest);
+			}
+			out.commit(dest - begin);
+		}
+	};
+
+	/// Strings are written as they are.
+	template<>
+	class ValueFormatter<StringRef>
+	{
+	public:
+		void format(const StringRef & value, OutputBuffer & out) const
+		{
+			out.append(value.data(), value.size());
+		}
+	};
+
+	template<>
+	class ValueFormatter<DictString>
+	{
+	public:
+		void format(const DictString & value, OutputBuffer & out) const
+		{
+			const StringRef str = value.ref();
+			out.append(str.data(), str.size());
+		}
+	};
+
+}
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,122 @@
+#ifndef ROWSTREAMS_VALUE_NORMALIZER_HPP
+#define ROWSTREAMS_VALUE_NORMALIZER_HPP
+
+#include "RowStreams/DateTime.hpp"
+#include <cstring>
+#include <boost/cstdint.hpp>
+#include <boost/integer.hpp>
+#include <boost/type_traits/is_signed.hpp>
+#include <boost/type_traits/make_unsigned.hpp>
+
+namespace RowStreams
+{
+	namespace ValueNormalizers
+	{
+		/// Writes the bytes of an unsigned integer most significant first.
+		template<class Unsigned>
+		void writeBigEndian(Unsigned bits, char * out)
+		{
+			for(size_t pos = sizeof(Unsigned); pos-- != 0; )
+			{
+				out[pos] = char(bits & 0xFF);
+				bits = Unsigned(bits >> 8);
+			}
+		}
+	}
+
+	/// Turns a value into sizeof(T) bytes that compare with memcmp in the
+	/// same order as the values, so that sorting never has to know the type
+	/// of a column. The bytes of the value are used as they are, which is
+	/// only right for the types specialized below.
+	template<class T>
+	class ValueNormalizer
+	{
+	public:
+		void normalize(const T & value, char * out) const
+		{
+			::memcpy(out, &value, sizeof(T));
+		}
+	};
+
+	/// Integers are written big endian, with the sign bit flipped so that
+	/// negative values come first.
+	template<class T>
+	class IntegerNormalizer
+	{
+		typedef typename boost::make_unsigned<T>::type Unsigned;
+
+	public:
+		void normalize(const T & value, char * out) const
+		{
+			Unsigned bits = Unsigned(value);
+			if(boost::is_signed<T>::value)
+				bits ^= Unsigned(Unsigned(1) << (sizeof(T) * 8 - 1));
+			ValueNormalizers::writeBigEndian(bits, out);
+		}
+	};
+
+	/// IEEE floating point values are written big endian, with the sign bit
+	/// flipped for positive values, and every bit for negative values, whose
+	/// other bits grow with their magnitude. NaNs end up first or last
+	/// depending on their sign bit.
+	template<class T>
+	class FloatNormalizer
+	{
+		typedef typename boost::uint_t<sizeof(T) * 8>::exact Bits;
+
+	public:
+		void normalize(const T & value, char * out) const
+		{
+			Bits bits;
+			::memcpy(&bits, &value, sizeof(T));
+			const Bits sign = Bits(1) << (sizeof(T) * 8 - 1);
+			bits = (bits & sign) ? Bits(~bits) : Bits(bits | sign);
+			ValueNormalizers::writeBigEndian(bits, out);
+		}
+	};
+
+#define ROWSTREAMS_VALUE_NORMALIZER(type, normalizer) \
+	template<> \
+	class ValueNormalizer<type> : public normalizer<type> \
+	{ \
+	};
+
+	ROWSTREAMS_VALUE_NORMALIZER(signed char, IntegerNormalizer)
+	ROWSTREAMS_VALUE_NORMALIZER(unsigned char, IntegerNormalizer)
+	ROWSTREAMS_VALUE_NORMALIZER(short, IntegerNormalizer)
+	ROWSTREAMS_VALUE_NORMALIZER(unsigned short, IntegerNormalizer)
+	ROWSTREAMS_VALUE_NORMALIZER(int, IntegerNormalizer)
+	ROWSTREAMS_VALUE_NORMALIZER(unsigned int, IntegerNormalizer)
+	ROWSTREAMS_VALUE_NORMALIZER(long, IntegerNormalizer)
+	ROWSTREAMS_VALUE_NORMALIZER(unsigned long, IntegerNormalizer)
+	ROWSTREAMS_VALUE_NORMALIZER(long long, IntegerNormalizer)
+	ROWSTREAMS_VALUE_NORMALIZER(unsigned long long, IntegerNormalizer)
+	ROWSTREAMS_VALUE_NORMALIZER(float, FloatNormalizer)
+	ROWSTREAMS_VALUE_NORMALIZER(double, FloatNormalizer)
+
+#undef ROWSTREAMS_VALUE_NORMALIZER
+
+	/// Dates and timestamps sort as their count of days or microseconds.
+	template<>
+	class ValueNormalizer<Date>
+	{
+	public:
+		void normalize(const Date & value, char * out) const
+		{
+			IntegerNormalizer<boost::int32_t>().normalize(value.days(), out);
+		}
+	};
+
+	template<>
+	class ValueNormalizer<Timestamp>
+	{
+	public:
+		void normalize(const Timestamp & value, char * out) const
+		{
+			IntegerNormalizer<boost::int64_t>().normalize(value.micros(), out);
+		}
+	};
+
+}
+
+#endif
\ No newline at end of file
@@ -1,57 +1,554 @@
 #ifndef ROWSTREAMS_VALUE_PARSER_HPP
 #define ROWSTREAMS_VALUE_PARSER_HPP
 
-#include <iostream>
+#include "RowStreams/StringRef.hpp"
+#include "RowStreams/Dictionary.hpp"
+#include "RowStreams/DateTime.hpp"
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <locale>
+#include <limits>
+#include <boost/cstdint.hpp>
+#include <boost/type_traits/make_unsigned.hpp>
 
 namespace RowStreams
 {
-	/// Parses a value from a c-string.
-	/// TODO: Suitable for numeric types, but not for string values yet.
+	/// Outcome of parsing a field. Anything but PARSE_OK leaves the value null.
+	enum ParseResult
+	{
+		PARSE_OK,
+		/// Nothing but blanks, which stands for a null value.
+		PARSE_EMPTY,
+		PARSE_INVALID,
+		/// The value does not fit in the type.
+		PARSE_OVERFLOW
+	};
+
+	namespace ValueParsers
+	{
+		inline void trim(const char *& str, const char *& end)
+		{
+			while(str != end && *str == ' ')
+				++str;
+			while(end != str && end[-1] == ' ')
+				--end;
+		}
+
+		/// Fallback for anything the fast parsers can't handle, always
+		/// in the classic locale.
+		template<class T>
+		ParseResult parseStream(const char * str, size_t length, T & value)
+		{
+			std::istringstream is(std::string(str, length));
+			is.imbue(std::locale::classic());
+			is >> value;
+			if(is.fail())
+				return PARSE_INVALID;
+			is >> std::ws;
+			return is.eof() ? PARSE_OK : PARSE_INVALID;
+		}
+
+		/// Reads count digits, and sets bad if any of them is not a digit,
+		/// which is only checked once the whole value is read.
+		inline unsigned fixedDigits(const char * str, size_t count, unsigned & bad)
+		{
+			unsigned value = 0;
+			for(size_t pos = 0; pos != count; ++pos)
+			{
+				const unsigned digit = unsigned(str[pos] - '0');
+				bad |= digit > 9;
+				value = value * 10 + digit;
+			}
+			return value;
+		}
+
+		/// Reads a date as YYYY-MM-DD, or with a sign and up to 7 digits for
+		/// years past 9999 or before 0, and moves str past it. Dates too far
+		/// out for a Date to hold are refused.
+		inline bool parseDate(const char *& str, const char * end, boost::int32_t & days)
+		{
+			bool negative = false;
+			size_t yearDigits = 4;
+			if(str != end && (*str == '-' || *str == '+'))
+			{
+				negative = *str++ == '-';
+				for(yearDigits = 0; str + yearDigits != end && unsigned(str[yearDigits] - '0') <= 9; )
+					++yearDigits;
+				if(yearDigits < 4 || yearDigits > 7)
+					return false;
+			}
+			if(size_t(end - str) < yearDigits + 6)
+				return false;
+
+			unsigned bad = 0;
+			const int magnitude = int(fixedDigits(str, yearDigits, bad));
+			const int year = negative ? -magnitude : magnitude;
+			str += yearDigits;
+			bad |= unsigned(str[0] != '-') | unsigned(str[3] != '-');
+			const unsigned month = fixedDigits(str + 1, 2, bad);
+			const unsigned day = fixedDigits(str + 4, 2, bad);
+			str += 6;
+			if(bad || month - 1 > 11 || day - 1 >= DateTimes::daysInMonth(year, month))
+				return false;
+			const boost::int64_t civil = DateTimes::daysFromCivil(year, month, day);
+			if(civil < std::numeric_limits<boost::int32_t>::min() || civil > std::numeric_limits<boost::int32_t>::max())
+				return false;
+			days = boost::int32_t(civil);
+			return true;
+		}
+
+		/// Reads the rest of an ISO 8601 timestamp after its date: nothing,
+		/// or T or a blank, HH:MM:SS, an optional fraction of a second, and
+		/// an optional Z or offset from UTC as +HH:MM, +HHMM or +HH. Digits
+		/// of the fraction past the microseconds are dropped.
+		inline bool parseTime(const char * str, const char * end, boost::int64_t & micros)
+		{
+			micros = 0;
+			if(str == end)
+				return true;
+			if(end - str < 9 || (*str != 'T' && *str != ' '))
+				return false;
+
+			unsigned bad = 0;
+			const unsigned hour = fixedDigits(str + 1, 2, bad);
+			const unsigned minute = fixedDigits(str + 4, 2, bad);
+			const unsigned second = fixedDigits(str + 7, 2, bad);
+			bad |= unsigned(str[3] != ':') | unsigned(str[6] != ':');
+			str += 9;
+			if(bad || hour > 23 || minute > 59 || second > 59)
+				return false;
+			micros = boost::int64_t((hour * 60 + minute) * 60 + second) * DateTimes::SECOND;
+
+			if(str != end && (*str == '.' || *str == ','))
+			{
+				unsigned fraction = 0;
+				size_t count = 0;
+				for(++str; str != end && unsigned(*str - '0') <= 9; ++str, ++count)
+				{
+					if(count < 6)
+						fraction = fraction * 10 + unsigned(*str - '0');
+				}
+				if(!count)
+					return false;
+				for(; count < 6; ++count)
+					fraction *= 10;
+				micros += fraction;
+			}
+
+			if(str != end && *str == 'Z')
+			{
+				++str;
+			}
+			else if(str != end && (*str == '+' || *str == '-'))
+			{
+				const bool negative = *str++ == '-';
+				if(end - str < 2)
+					return false;
+				const unsigned offsetHours = fixedDigits(str, 2, bad);
+				unsigned offsetMinutes = 0;
+				str += 2;
+				if(str != end)
+				{
+					str += *str == ':';
+					if(end - str < 2)
+						return false;
+					offsetMinutes = fixedDigits(str, 2, bad);
+					str += 2;
+				}
+				if(bad || offsetHours > 23 || offsetMinutes > 59)
+					return false;
+				const boost::int64_t offset = boost::int64_t(offsetHours * 60 + offsetMinutes) * DateTimes::MINUTE;
+				micros += negative ? offset : -offset;
+			}
+			return str == end;
+		}
+	}
+
+	/// Parses a value from a string that need not be NUL-terminated.
+	/// Uses stream extraction, so it is slow, but works for any type with
+	/// an input operator. Strings are parsed as StringRef, see below.
 	template<class T>
 	class ValueParser
 	{
 	public:
-		T operator()(const char * str)
+		ParseResult parse(const char * str, size_t length, T & value) const
 		{
-			std::istringstream is(str);
-			T tmp;
-			is >> tmp;
+			const char * end = str + length;
+			ValueParsers::trim(str, end);
+			if(str == end)
+				return PARSE_EMPTY;
+			return ValueParsers::parseStream(str, end - str, value);
+		}
+
+		T operator()(const char * str, size_t length) const
+		{
+			T tmp = T();
+			parse(str, length, tmp);
 			return tmp;
 		}
+
+		T operator()(const char * str) const
+		{
+			return (*this)(str, ::strlen(str));
+		}
 	};
 
-	/// ValueParser specialization for ints. Notice that
-	/// the default template can handle ints, but specialization
-	/// will be useful to allow for faster, custom made parsers.
+	/// Parser for integers of any width. Works on the digits directly, only
+	/// checking for overflow once a value is long enough to possibly overflow.
+	template<class T>
+	class IntegerParser
+	{
+		typedef typename boost::make_unsigned<T>::type Unsigned;
+
+	public:
+		ParseResult parse(const char * str, size_t length, T & value) const
+		{
+			const char * end = str + length;
+			ValueParsers::trim(str, end);
+			if(str == end)
+				return PARSE_EMPTY;
+
+			const bool negative = *str == '-';
+			if(*str == '-' || *str == '+')
+				++str;
+			if(str == end)
+				return PARSE_INVALID;
+
+			// Any number this short fits, whatever its sign.
+			const char * fast_end = end - str > std::numeric_limits<T>::digits10
+				? str + std::numeric_limits<T>::digits10 : end;
+
+			Unsigned result = 0;
+			for(; str != fast_end; ++str)
+			{
+				const unsigned digit = unsigned(*str - '0');
+				if(digit > 9)
+					return PARSE_INVALID;
+				result = Unsigned(result * 10 + digit);
+			}
+
+			if(str != end)
+			{
+				const Unsigned limit = negative
+					? Unsigned(Unsigned(0) - Unsigned(std::numeric_limits<T>::min()))
+					: Unsigned(std::numeric_limits<T>::max());
+				for(; str != end; ++str)
+				{
+					const unsigned digit = unsigned(*str - '0');
+					if(digit > 9)
+						return PARSE_INVALID;
+					if(result > (limit - digit) / 10)
+						return PARSE_OVERFLOW;
+					result = Unsigned(result * 10 + digit);
+				}
+			}
+
+			if(negative && !std::numeric_limits<T>::is_signed && result != 0)
+				return PARSE_OVERFLOW;
+
+			value = negative ? T(Unsigned(0) - result) : T(result);
+			return PARSE_OK;
+		}
+
+		T operator()(const char * str, size_t length) const
+		{
+			T tmp = T();
+			parse(str, length, tmp);
+			return tmp;
+		}
+
+		T operator()(const char * str) const
+		{
+			return (*this)(str, ::strlen(str));
+		}
+	};
+
+	/// Parser for float and double. Decimal numbers with up to 19 significant
+	/// digits and a small enough exponent are converted exactly with a single
+	/// multiplication or division; the rest (very long mantissas, huge
+	/// exponents...) go through the stream based fallback, so no precision
+	/// is ever lost. Locale independent.
+	template<class T>
+	class FloatParser
+	{
+		static T power10(int exponent)
+		{
+			static const T powers[] = {
+				T(1e0), T(1e1), T(1e2), T(1e3), T(1e4), T(1e5), T(1e6), T(1e7), T(1e8), T(1e9), T(1e10),
+				T(1e11), T(1e12), T(1e13), T(1e14), T(1e15), T(1e16), T(1e17), T(1e18), T(1e19), T(1e20),
+				T(1e21), T(1e22) };
+			return powers[exponent];
+		}
+
+	public:
+		ParseResult parse(const char * str, size_t length, T & value) const
+		{
+			const char * end = str + length;
+			ValueParsers::trim(str, end);
+			if(str == end)
+				return PARSE_EMPTY;
+
+			const char * const start = str;
+			const bool negative = *str == '-';
+			if(*str == '-' || *str == '+')
+				++str;
+
+			boost::uint64_t mantissa = 0;
+			int digits = 0;
+			int exponent = 0;
+			bool any_digit = false;
+
+			for(; str != end && unsigned(*str - '0') <= 9; ++str)
+			{
+				any_digit = true;
+				if(digits < 19)
+				{
+					mantissa = mantissa * 10 + unsigned(*str - '0');
+					digits += mantissa != 0;
+				}
+				else
+				{
+					++exponent;
+					digits = 20;
+				}
+			}
+
+			if(str != end && *str == '.')
+			{
+				for(++str; str != end && unsigned(*str - '0') <= 9; ++str)
+				{
+					any_digit = true;
+					if(digits < 19)
+					{
+						mantissa = mantissa * 10 + unsigned(*str - '0');
+						digits += mantissa != 0;
+						--exponent;
+					}
+					else
+					{
+						digits = 20;
+					}
+				}
+			}
+
+			if(any_digit && str != end && (*str == 'e' || *str == 'E'))
+			{
+				++str;
+				const bool exp_negative = str != end && *str == '-';
+				if(str != end && (*str == '-' || *str == '+'))
+					++str;
+				int exp_value = 0;
+				const char * exp_digits = str;
+				for(; str != end && unsigned(*str - '0') <= 9; ++str)
+				{
+					if(exp_value < 100000)
+						exp_value = exp_value * 10 + (*str - '0');
+				}
+				if(str == exp_digits)
+					return PARSE_INVALID;
+				exponent += exp_negative ? -exp_value : exp_value;
+			}
+
+			if(!any_digit)
+			{
+				// What FloatFormatter writes for the special values.
+				if(end - str == 3 && (::strncmp(str, "inf", 3) == 0 || ::strncmp(str, "nan", 3) == 0))
+				{
+					const T special = *str == 'i' ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::quiet_NaN();
+					value = negative ? -special : special;
+					return PARSE_OK;
+				}
+				return ValueParsers::parseStream(start, end - start, value);
+			}
+			if(str != end)
+				return ValueParsers::parseStream(start, end - start, value);
+
+			// Exact when the mantissa and the power of ten are both exact in T.
+			const int max_exponent = std::numeric_limits<T>::digits > 24 ? 22 : 10;
+			const boost::uint64_t max_mantissa = boost::uint64_t(1) << std::numeric_limits<T>::digits;
+			if(digits > 19 || mantissa > max_mantissa || exponent > max_exponent || exponent < -max_exponent)
+			{
+				// The syntax has been checked already, so a failure means the
+				// value is out of range.
+				return ValueParsers::parseStream(start, end - start, value) == PARSE_OK
+					? PARSE_OK : PARSE_OVERFLOW;
+			}
+
+			T result = T(mantissa);
+			if(exponent < 0)
+				result /= power10(-exponent);
+			else
+				result *= power10(exponent);
+			value = negative ? -result : result;
+			return PARSE_OK;
+		}
+
+		T operator()(const char * str, size_t length) const
+		{
+			T tmp = T();
+			parse(str, length, tmp);
+			return tmp;
+		}
+
+		T operator()(const char * str) const
+		{
+			return (*this)(str, ::strlen(str));
+		}
+	};
+
+#define ROWSTREAMS_VALUE_PARSER(type, parser) \
+	template<> \
+	class ValueParser<type> : public parser<type> \
+	{ \
+	};
+
+	ROWSTREAMS_VALUE_PARSER(signed char, IntegerParser)
+	ROWSTREAMS_VALUE_PARSER(unsigned char, IntegerParser)
+	ROWSTREAMS_VALUE_PARSER(short, IntegerParser)
+	ROWSTREAMS_VALUE_PARSER(unsigned short, IntegerParser)
+	ROWSTREAMS_VALUE_PARSER(int, IntegerParser)
+	ROWSTREAMS_VALUE_PARSER(unsigned int, IntegerParser)
+	ROWSTREAMS_VALUE_PARSER(long, IntegerParser)
+	ROWSTREAMS_VALUE_PARSER(unsigned long, IntegerParser)
+	ROWSTREAMS_VALUE_PARSER(long long, IntegerParser)
+	ROWSTREAMS_VALUE_PARSER(unsigned long long, IntegerParser)
+	ROWSTREAMS_VALUE_PARSER(float, FloatParser)
+	ROWSTREAMS_VALUE_PARSER(double, FloatParser)
+
+#undef ROWSTREAMS_VALUE_PARSER
+
+	/// Strings are taken as they are, blanks included, and refer to the text
+	/// they are parsed from. Empty fields are null, as everywhere else.
+	template<>
+	class ValueParser<StringRef>
+	{
+	public:
+		ParseResult parse(const char * str, size_t length, StringRef & value) const
+		{
+			if(length == 0)
+				return PARSE_EMPTY;
+			value = StringRef(str, length);
+			return PARSE_OK;
+		}
+
+		StringRef operator()(const char * str, size_t length) const
+		{
+			StringRef tmp;
+			parse(str, length, tmp);
+			return tmp;
+		}
+
+		StringRef operator()(const char * str) const
+		{
+			return (*this)(str, ::strlen(str));
+		}
+	};
+
+	/// Dates as YYYY-MM-DD, with fixed positions for every field, so the
+	/// digits are all read before anything is checked.
+	template<>
+	class ValueParser<Date>
+	{
+	public:
+		ParseResult parse(const char * str, size_t length, Date & value) const
+		{
+			const char * end = str + length;
+			ValueParsers::trim(str, end);
+			if(str == end)
+				return PARSE_EMPTY;
+
+			boost::int32_t days;
+			if(!ValueParsers::parseDate(str, end, days) || str != end)
+				return PARSE_INVALID;
+			value = Date(days);
+			return PARSE_OK;
+		}
+
+		Date operator()(const char * str, size_t length) const
+		{
+			Date tmp;
+			parse(str, length, tmp);
+			return tmp;
+		}
+
+		Date operator()(const char * str) const
+		{
+			return (*this)(str, ::strlen(str));
+		}
+	};
+
+	/// Timestamps in ISO 8601, see ValueParsers::parseTime(). A date alone
+	/// is midnight UTC.
 	template<>
-	class ValueParser<int>
+	class ValueParser<Timestamp>
 	{
 	public:
-		int operator()(const char * str)
+		ParseResult parse(const char * str, size_t length, Timestamp & value) const
+		{
+			const char * end = str + length;
+			ValueParsers::trim(str, end);
+			if(str == end)
+				return PARSE_EMPTY;
+
+			boost::int32_t days;
+			boost::int64_t micros;
+			if(!ValueParsers::parseDate(str, end, days) || !ValueParsers::parseTime(str, end, micros))
+				return PARSE_INVALID;
+			// Microseconds in 64 bits reach about 292000 years either way. The
+			// midnight of the earliest day does not fit, so days before the
+			// epoch count from the midnight after.
+			const boost::int64_t maxDays = std::numeric_limits<boost::int64_t>::max() / DateTimes::DAY;
+			if(days > maxDays || days < -maxDays - 1)
+				return PARSE_INVALID;
+			const boost::int64_t before = days < 0;
+			const boost::int64_t midnight = (days + before) * DateTimes::DAY;
+			micros -= before * DateTimes::DAY;
+			if(micros > 0 ? midnight > std::numeric_limits<boost::int64_t>::max() - micros
+				: midnight < std::numeric_limits<boost::int64_t>::min() - micros)
+				return PARSE_INVALID;
+			value = Timestamp(midnight + micros);
+			return PARSE_OK;
+		}
+
+		Timestamp operator()(const char * str, size_t length) const
 		{
-			errno = 0;
-			int tmp = ::atoi(str);
-			if(errno != 0)
-				std::clog << "Error parsing " << str << " as an integer value" << std::endl;
+			Timestamp tmp;
+			parse(str, length, tmp);
 			return tmp;
 		}
+
+		Timestamp operator()(const char * str) const
+		{
+			return (*this)(str, ::strlen(str));
+		}
 	};
 
-	/// ValueParser specialization for doubles. Notice that
-	/// the default template can handle doubles, but specialization
-	/// will be useful to allow for faster, custom made parsers.
+	/// Strings of dictionary columns are taken as they are, and looked up in
+	/// the dictionary, which gets the new ones.
 	template<>
-	class ValueParser<double>
+	class ValueParser<DictString>
 	{
 	public:
-		double operator()(const char * str)
+		ParseResult parse(const char * str, size_t length, DictString & value) const
+		{
+			if(length == 0)
+				return PARSE_EMPTY;
+			value = DictString(str, length);
+			return PARSE_OK;
+		}
+
+		DictString operator()(const char * str, size_t length) const
 		{
-			errno = 0;
-			double tmp = ::atof(str);
-			if(errno != 0)
-				std::clog << "Error parsing " << str << " as a double value" << std::endl;
+			DictString tmp;
+			parse(str, length, tmp);
 			return tmp;
 		}
+
+		DictString operator()(const char * str) const
+		{
+			return (*this)(str, ::strlen(str));
+		}
 	};
 
 }
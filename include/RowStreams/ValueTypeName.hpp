@@ -0,0 +1,150 @@
+#ifndef ROWSTREAMS_VALUE_TYPE_NAME_HPP
+#define ROWSTREAMS_VALUE_TYPE_NAME_HPP
+
+#include "RowStreams/StringRef.hpp"
+#include "RowStreams/Dictionary.hpp"
+#include "RowStreams/DateTime.hpp"
+#include <typeinfo>
+#include <boost/type_traits/is_signed.hpp>
+
+namespace RowStreams
+{
+	/// Names the type of a column in files that store rows as they are laid
+	/// out in memory, so that the reader can rebuild the columns. The
+	/// default is the name the compiler gives the type, which no reader
+	/// knows, so only the types specialized below can be read back.
+	template<class T>
+	class ValueTypeName
+	{
+	public:
+		const char * name() const
+		{
+			return typeid(T).name();
+		}
+	};
+
+	/// Integers are named by size and sign, so that int and long of the
+	/// same size read back as the same type.
+	template<class T>
+	class IntegerTypeName
+	{
+	public:
+		const char * name() const
+		{
+			const bool isSigned = boost::is_signed<T>::value;
+			switch(sizeof(T))
+			{
+			case 1:
+				return isSigned ? "int8" : "uint8";
+			case 2:
+				return isSigned ? "int16" : "uint16";
+			case 4:
+				return isSigned ? "int32" : "uint32";
+			default:
+				return isSigned ? "int64" : "uint64";
+			}
+		}
+	};
+
+	template<>
+	class ValueTypeName<bool>
+	{
+	public:
+		const char * name() const
+		{
+			return "bool";
+		}
+	};
+
+	template<>
+	class ValueTypeName<char>
+	{
+	public:
+		const char * name() const
+		{
+			return "char";
+		}
+	};
+
+	template<>
+	class ValueTypeName<float>
+	{
+	public:
+		const char * name() const
+		{
+			return "float";
+		}
+	};
+
+	template<>
+	class ValueTypeName<double>
+	{
+	public:
+		const char * name() const
+		{
+			return "double";
+		}
+	};
+
+	template<>
+	class ValueTypeName<Date>
+	{
+	public:
+		const char * name() const
+		{
+			return "date";
+		}
+	};
+
+	template<>
+	class ValueTypeName<Timestamp>
+	{
+	public:
+		const char * name() const
+		{
+			return "timestamp";
+		}
+	};
+
+	template<>
+	class ValueTypeName<StringRef>
+	{
+	public:
+		const char * name() const
+		{
+			return "string";
+		}
+	};
+
+	template<>
+	class ValueTypeName<DictString>
+	{
+	public:
+		const char * name() const
+		{
+			return "dictionary";
+		}
+	};
+
+#define ROWSTREAMS_VALUE_TYPE_NAME(type) \
+	template<> \
+	class ValueTypeName<type> : public IntegerTypeName<type> \
+	{ \
+	};
+
+	ROWSTREAMS_VALUE_TYPE_NAME(signed char)
+	ROWSTREAMS_VALUE_TYPE_NAME(unsigned char)
+	ROWSTREAMS_VALUE_TYPE_NAME(short)
+	ROWSTREAMS_VALUE_TYPE_NAME(unsigned short)
+	ROWSTREAMS_VALUE_TYPE_NAME(int)
+	ROWSTREAMS_VALUE_TYPE_NAME(unsigned int)
+	ROWSTREAMS_VALUE_TYPE_NAME(long)
+	ROWSTREAMS_VALUE_TYPE_NAME(unsigned long)
+	ROWSTREAMS_VALUE_TYPE_NAME(long long)
+	ROWSTREAMS_VALUE_TYPE_NAME(unsigned long long)
+
+#undef ROWSTREAMS_VALUE_TYPE_NAME
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,388 @@
+#ifndef ROWSTREAMS_ZONE_MAP_HPP
+#define ROWSTREAMS_ZONE_MAP_HPP
+
+#include "RowStreams/Row.hpp"
+#include "RowStreams/RowDef.hpp"
+#include "RowStreams/DateTime.hpp"
+#include <vector>
+#include <limits>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <boost/cstdint.hpp>
+#include <boost/type_traits/is_arithmetic.hpp>
+#include <boost/type_traits/is_floating_point.hpp>
+
+namespace RowStreams
+{
+	/// What is known about the values of a column in a block of rows, as
+	/// stored in binary files after the header of every block.
+	struct ColumnZone
+	{
+		enum
+		{
+			/// min and max hold the least and greatest values of the block.
+			HAS_RANGE = 1,
+			/// Some values, like NaNs, do not fit in any range.
+			UNORDERED = 2
+		};
+
+		/// Values of the type of the column, in its first bytes.
+		char min[8];
+		char max[8];
+		/// Number of rows where the column is null.
+		boost::uint32_t nulls;
+		boost::uint32_t flags;
+	};
+
+	/// The zones of all the columns of a block of rows.
+	class ZoneMap
+	{
+		const ColumnZone * zones_;
+		size_t numColumns_;
+
+	public:
+		ZoneMap(const ColumnZone * zones, size_t numColumns)
+			: zones_(zones), numColumns_(numColumns)
+		{
+		}
+
+		/// Returns the zone of a column, or null if the block has no zone
+		/// for it.
+		const ColumnZone * column(size_t index) const
+		{
+			return index < numColumns_ ? zones_ + index : 0;
+		}
+	};
+
+	/// The values a function may take over the rows of a block. Nothing is
+	/// known of them unless known is set.
+	template<class T>
+	struct ValueRange
+	{
+		bool known;
+		T min;
+		T max;
+
+		ValueRange()
+			: known(false), min(), max()
+		{
+		}
+
+		ValueRange(const T & min_, const T & max_)
+			: known(true), min(min_), max(max_)
+		{
+		}
+	};
+
+	/// Keeps the range of the values of a column in a ColumnZone. Only
+	/// numbers, and the types given one below, have one.
+	template<class T, bool ranged = boost::is_arithmetic<T>::value && sizeof(T) <= 8>
+	struct ValueZone
+	{
+		static void widen(const T &, ColumnZone &)
+		{
+		}
+
+		static ValueRange<T> range(const ColumnZone &)
+		{
+			return ValueRange<T>();
+		}
+	};
+
+	template<class T>
+	struct ValueZone<T, true>
+	{
+		static void widen(const T & value, ColumnZone & zone)
+		{
+			if(value != value)
+			{
+				zone.flags |= ColumnZone::UNORDERED;
+				return;
+			}
+			if(!(zone.flags & ColumnZone::HAS_RANGE))
+			{
+				::memcpy(zone.min, &value, sizeof(T));
+				::memcpy(zone.max, &value, sizeof(T));
+				zone.flags |= ColumnZone::HAS_RANGE;
+				return;
+			}
+
+			T min, max;
+			::memcpy(&min, zone.min, sizeof(T));
+			::memcpy(&max, zone.max, sizeof(T));
+			if(value < min)
+				::memcpy(zone.min, &value, sizeof(T));
+			else if(max < value)
+				::memcpy(zone.max, &value, sizeof(T));
+		}
+
+		/// Nulls are left out of the range. A predicate is never met where it
+		/// is null, so the rows with non-null values are all it can match.
+		static ValueRange<T> range(const ColumnZone & zone)
+		{
+			if(zone.flags != ColumnZone::HAS_RANGE)
+				return ValueRange<T>();
+
+			ValueRange<T> range;
+			::memcpy(&range.min, zone.min, sizeof(T));
+			::memcpy(&range.max, zone.max, sizeof(T));
+			range.known = true;
+			return range;
+		}
+	};
+
+	/// Dates and timestamps have a range too, which is kept as it is for
+	/// numbers.
+	template<>
+	struct ValueZone<Date> : public ValueZone<Date, true>
+	{
+	};
+
+	template<>
+	struct ValueZone<Timestamp> : public ValueZone<Timestamp, true>
+	{
+	};
+
+	/// Builds the zones of the columns of a block of rows, one row at a time.
+	class ZoneMapBuilder
+	{
+		std::vector<const ColumnDef*> columns_;
+		std::vector<ColumnZone> zones_;
+
+	public:
+		void init(const RowDef & rowDef)
+		{
+			columns_.assign(rowDef.begin(), rowDef.end());
+			zones_.resize(columns_.size());
+			clear();
+		}
+
+		/// Starts a new block.
+		void clear()
+		{
+			if(!zones_.empty())
+				::memset(&zones_[0], 0, zones_.size() * sizeof(ColumnZone));
+		}
+
+		void add(const Row & row)
+		{
+			for(size_t index = 0; index != columns_.size(); ++index)
+			{
+				if(row.isNull(index))
+					++zones_[index].nulls;
+				else
+					columns_[index]->widen(row, zones_[index]);
+			}
+		}
+
+		/// Size of the zones of a block.
+		size_t size() const
+		{
+			return zones_.size() * sizeof(ColumnZone);
+		}
+
+		void write(char * out) const
+		{
+			if(!zones_.empty())
+				::memcpy(out, &zones_[0], size());
+		}
+	};
+
+	namespace ZoneMaps
+	{
+		/// Tells whether a value computed from the bounds of ranges in
+		/// double is exact, and fits in T, so that T gives the same value.
+		template<class T>
+		bool exact(double value)
+		{
+			if(boost::is_floating_point<T>::value)
+				return true;
+			const double limit = 9007199254740992.0;
+			return value >= -limit && value <= limit
+				&& value >= double(std::numeric_limits<T>::min()) && value <= double(std::numeric_limits<T>::max());
+		}
+	}
+
+	/// The range of the result of a binary operator of <functional>, from
+	/// the ranges of its operands, which are known. Nothing is known of the
+	/// result of other operators.
+	template<class BinOp>
+	struct OperatorRange
+	{
+		template<class T>
+		static ValueRange<T> range(const ValueRange<T> &, const ValueRange<T> &)
+		{
+			return ValueRange<T>();
+		}
+	};
+
+	/// Sums and differences grow with their first operand, and products
+	/// either grow or shrink with each operand, so their bounds are at the
+	/// bounds of the operands. Rounding keeps that order, so bounds are
+	/// computed in T as the values are. Integer bounds that would overflow
+	/// leave the result unknown.
+	template<class T>
+	struct OperatorRange<std::plus<T> >
+	{
+		static ValueRange<T> range(const ValueRange<T> & left, const ValueRange<T> & right)
+		{
+			if(!ZoneMaps::exact<T>(double(left.min) + double(right.min))
+				|| !ZoneMaps::exact<T>(double(left.max) + double(right.max)))
+			{
+				return ValueRange<T>();
+			}
+			const ValueRange<T> range(T(left.min + right.min), T(left.max + right.max));
+			return range.min == range.min && range.max == range.max ? range : ValueRange<T>();
+		}
+	};
+
+	template<class T>
+	struct OperatorRange<std::minus<T> >
+	{
+		static ValueRange<T> range(const ValueRange<T> & left, const ValueRange<T> & right)
+		{
+			if(!ZoneMaps::exact<T>(double(left.min) - double(right.max))
+				|| !ZoneMaps::exact<T>(double(left.max) - double(right.min)))
+			{
+				return ValueRange<T>();
+			}
+			const ValueRange<T> range(T(left.min - right.max), T(left.max - right.min));
+			return range.min == range.min && range.max == range.max ? range : ValueRange<T>();
+		}
+	};
+
+	template<class T>
+	struct OperatorRange<std::multiplies<T> >
+	{
+		static ValueRange<T> range(const ValueRange<T> & left, const ValueRange<T> & right)
+		{
+			const T lefts[] = { left.min, left.max };
+			const T rights[] = { right.min, right.max };
+			ValueRange<T> range;
+			for(size_t leftIndex = 0; leftIndex != 2; ++leftIndex)
+			{
+				for(size_t rightIndex = 0; rightIndex != 2; ++rightIndex)
+				{
+					if(!ZoneMaps::exact<T>(double(lefts[leftIndex]) * double(rights[rightIndex])))
+						return ValueRange<T>();
+					const T product = T(lefts[leftIndex] * rights[rightIndex]);
+					if(product != product)
+						return ValueRange<T>();
+					if(!range.known)
+						range = ValueRange<T>(product, product);
+					range.min = std::min(range.min, product);
+					range.max = std::max(range.max, product);
+				}
+			}
+			return range;
+		}
+	};
+
+	/// The range of a comparison of <functional>, from the ranges of its
+	/// operands, which are known: always false, always true, or either.
+	template<class Compare>
+	struct CompareRange
+	{
+		template<class T>
+		static ValueRange<bool> range(const ValueRange<T> &, const ValueRange<T> &)
+		{
+			return ValueRange<bool>(false, true);
+		}
+	};
+
+	template<class T>
+	struct CompareRange<std::less<T> >
+	{
+		static ValueRange<bool> range(const ValueRange<T> & left, const ValueRange<T> & right)
+		{
+			return ValueRange<bool>(left.max < right.min, left.min < right.max);
+		}
+	};
+
+	template<class T>
+	struct CompareRange<std::less_equal<T> >
+	{
+		static ValueRange<bool> range(const ValueRange<T> & left, const ValueRange<T> & right)
+		{
+			return ValueRange<bool>(left.max <= right.min, left.min <= right.max);
+		}
+	};
+
+	template<class T>
+	struct CompareRange<std::greater<T> >
+	{
+		static ValueRange<bool> range(const ValueRange<T> & left, const ValueRange<T> & right)
+		{
+			return ValueRange<bool>(left.min > right.max, left.max > right.min);
+		}
+	};
+
+	template<class T>
+	struct CompareRange<std::greater_equal<T> >
+	{
+		static ValueRange<bool> range(const ValueRange<T> & left, const ValueRange<T> & right)
+		{
+			return ValueRange<bool>(left.min >= right.max, left.max >= right.min);
+		}
+	};
+
+	template<class T>
+	struct CompareRange<std::equal_to<T> >
+	{
+		static ValueRange<bool> range(const ValueRange<T> & left, const ValueRange<T> & right)
+		{
+			const bool single = left.min == left.max && right.min == right.max && left.min == right.min;
+			const bool apart = left.max < right.min || right.max < left.min;
+			return ValueRange<bool>(single, !apart);
+		}
+	};
+
+	template<class T>
+	struct CompareRange<std::not_equal_to<T> >
+	{
+		static ValueRange<bool> range(const ValueRange<T> & left, const ValueRange<T> & right)
+		{
+			const bool single = left.min == left.max && right.min == right.max && left.min == right.min;
+			const bool apart = left.max < right.min || right.max < left.min;
+			return ValueRange<bool>(apart, !single);
+		}
+	};
+
+	/// Tells whether an operator of a Function returning T can tell its
+	/// range over a block of rows from a ZoneMap.
+	template<class Oper, class T>
+	struct HasRange
+	{
+		typedef char Yes;
+		typedef char (&No)[2];
+
+		template<class U, ValueRange<T> (U::*)(const ZoneMap &) const> struct Check;
+		template<class U> static Yes test(Check<U, &U::range> *);
+		template<class U> static No test(...);
+
+		enum { value = sizeof(test<Oper>(0)) == sizeof(Yes) };
+	};
+
+	/// Lets operators without a range() method be part of functions whose
+	/// range is asked for. Nothing is known of their range.
+	template<class Oper, class T, bool ranged = HasRange<Oper, T>::value>
+	struct RangeAdapter
+	{
+		static ValueRange<T> range(const Oper &, const ZoneMap &)
+		{
+			return ValueRange<T>();
+		}
+	};
+
+	template<class Oper, class T>
+	struct RangeAdapter<Oper, T, true>
+	{
+		static ValueRange<T> range(const Oper & oper, const ZoneMap & zones)
+		{
+			return oper.range(zones);
+		}
+	};
+}
+
+#endif
\ No newline at end of file
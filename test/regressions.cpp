@@ -0,0 +1,411 @@
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstring>
+#include <clocale>
+#include <cmath>
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem.hpp>
+#include "RowStreams.hpp"
+
+/*
+Checks for bugs that were fixed once, so they stay fixed. Build it with
+test/Regressions.vcxproj, or like src/main.cpp with the include directory
+on the include path and boost filesystem linked in. It writes its files to
+a new directory under the temporary directory, removes it unless a check
+fails, and returns 1 if any check fails.
+*/
+
+using namespace RowStreams;
+using namespace RowStreams::Functions;
+
+namespace
+{
+	int failures = 0;
+	boost::filesystem::path directory;
+
+	/// Where a check keeps the file of that name.
+	std::string testFile(const std::string & name)
+	{
+		return (directory / name).string();
+	}
+
+	void check(bool ok, const std::string & what)
+	{
+		if(!ok)
+		{
+			std::cerr << "FAILED: " << what << std::endl;
+			++failures;
+		}
+	}
+
+	void writeFile(const std::string & fileName, const std::string & text)
+	{
+		std::ofstream ofs(fileName.c_str(), std::ios::binary);
+		ofs << text;
+	}
+
+	/// The lines of a file, without the header.
+	std::vector<std::string> readRows(const std::string & fileName)
+	{
+		std::ifstream ifs(fileName.c_str(), std::ios::binary);
+		std::vector<std::string> rows;
+		std::string line;
+		std::getline(ifs, line);
+		while(std::getline(ifs, line))
+			rows.push_back(line);
+		return rows;
+	}
+
+	/// Nulls that come after non-null values, in rows recycled from them,
+	/// must not pass a filter, whether the reader checks the predicate or the
+	/// filter does.
+	void filterNullsAfterValues()
+	{
+		std::ostringstream text;
+		text << "a\n";
+		for(int value = 1; value <= 1500; ++value)
+			text << value << "\n";
+		for(int count = 0; count != 1500; ++count)
+			text << "\n";
+		writeFile(testFile("filter_nulls.txt"), text.str());
+
+		RowDef rowDef = RowDef() << column_def<int>("a");
+		{
+			Pipeline p(read_text_file(rowDef, testFile("filter_nulls.txt"))
+				>> filter(column<int>("a") > value(0))
+				>> write_text_file(testFile("filter_nulls_pushed.txt")));
+			p.run();
+		}
+		check(readRows(testFile("filter_nulls_pushed.txt")).size() == 1500, "filter on the reader lets nulls through");
+
+		// The filter reads a column set down the stream, so it is not pushed.
+		{
+			Pipeline p(read_text_file(rowDef, testFile("filter_nulls.txt"))
+				>> add_column<int>("b")
+				>> set_column("b", column<int>("a"))
+				>> filter(column<int>("b") > value(0))
+				>> write_text_file(testFile("filter_nulls_stage.txt")));
+			p.run();
+		}
+		check(readRows(testFile("filter_nulls_stage.txt")).size() == 1500, "filter stage lets nulls through");
+	}
+
+	/// A true operand of a disjunction, or a false operand of a conjunction,
+	/// decides the result even when the other operand is null.
+	void logicWithNulls()
+	{
+		std::ostringstream text;
+		text << "a\tb\n";
+		for(int count = 0; count != 1000; ++count)
+			text << "\t1\n" << "1\t\n" << "\t\n";
+		writeFile(testFile("logic_nulls.txt"), text.str());
+
+		RowDef rowDef = RowDef() << column_def<int>("a") << column_def<int>("b");
+		{
+			Pipeline p(read_text_file(rowDef, testFile("logic_nulls.txt"))
+				>> filter(column<int>("a") > value(0) || column<int>("b") > value(0))
+				>> write_text_file(testFile("logic_nulls_filter.txt")));
+			p.run();
+		}
+		check(readRows(testFile("logic_nulls_filter.txt")).size() == 2000, "disjunction with a null operand is null");
+
+		{
+			Pipeline p(read_text_file(rowDef, testFile("logic_nulls.txt"))
+				>> add_column<bool>("or")
+				>> add_column<bool>("and")
+				>> set_column("or", column<int>("a") > value(0) || column<int>("b") > value(0))
+				>> set_column("and", column<int>("a") < value(0) && column<int>("b") > value(0))
+				>> write_text_file(testFile("logic_nulls_set.txt")));
+			p.run();
+		}
+		const std::vector<std::string> rows = readRows(testFile("logic_nulls_set.txt"));
+		const char * expected[] = { "\t1\t1\t", "1\t\t1\t0", "\t\t\t" };
+		bool same = rows.size() == 3000;
+		for(size_t row = 0; same && row != rows.size(); ++row)
+			same = rows[row] == expected[row % 3];
+		check(same, "batch evaluation of logical operators with nulls");
+	}
+
+	/// Blocks of a binary file that hold nulls keep the range of their other
+	/// values, and a filter still sees the rows of the blocks it cannot skip.
+	void zonesWithNulls()
+	{
+		std::ostringstream text;
+		text << "a\n";
+		for(int value = 0; value != 12288; ++value)
+			text << (value % 2 ? "" : boost::lexical_cast<std::string>(value)) << "\n";
+		writeFile(testFile("zone_nulls.txt"), text.str());
+
+		{
+			Pipeline p(read_text_file(RowDef() << column_def<int>("a"), testFile("zone_nulls.txt"))
+				>> write_binary_file(testFile("zone_nulls.rows")));
+			p.run();
+		}
+		{
+			Pipeline p(read_binary_file(testFile("zone_nulls.rows"))
+				>> filter(column<int>("a") > value(12000))
+				>> write_text_file(testFile("zone_nulls_filter.txt")));
+			p.run();
+		}
+		check(readRows(testFile("zone_nulls_filter.txt")).size() == 143, "filter on blocks with nulls");
+	}
+
+	/// Whether a value written as text reads back the same.
+	template<class T>
+	bool readsBack(const T & value)
+	{
+		OutputBuffer out;
+		ValueFormatter<T>().format(value, out);
+		T back;
+		return ValueParser<T>().parse(out.data(), out.size(), back) == PARSE_OK && back == value;
+	}
+
+	/// Dates and timestamps out of the range of their values are refused
+	/// rather than wrapped, and the extremes read back as written.
+	void dateTimeRange()
+	{
+		const char * invalid[] = { "+300000-01-01T00:00:00", "+999999-12-31", "+294247-01-10T04:00:54.775808Z",
+			"-290308-12-21T19:59:05.224191Z" };
+		for(size_t index = 0; index != 4; ++index)
+		{
+			Timestamp timestamp;
+			check(ValueParser<Timestamp>().parse(invalid[index], ::strlen(invalid[index]), timestamp) == PARSE_INVALID,
+				std::string("timestamp out of range: ") + invalid[index]);
+		}
+		Date date;
+		check(ValueParser<Date>().parse("+5881580-07-12", 14, date) == PARSE_INVALID, "date out of range");
+
+		check(readsBack(Date(std::numeric_limits<boost::int32_t>::max())), "latest date reads back");
+		check(readsBack(Date(std::numeric_limits<boost::int32_t>::min())), "earliest date reads back");
+		check(readsBack(Timestamp(std::numeric_limits<boost::int64_t>::max())), "latest timestamp reads back");
+		check(readsBack(Timestamp(std::numeric_limits<boost::int64_t>::min())), "earliest timestamp reads back");
+	}
+
+	std::string formatted(double value)
+	{
+		OutputBuffer out;
+		ValueFormatter<double>().format(value, out);
+		return std::string(out.data(), out.size());
+	}
+
+	/// Floats and doubles are written with the digits that read back, and a
+	/// point whatever the locale says.
+	void floatsReadBack()
+	{
+		const char * commaLocales[] = { "de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "German" };
+		for(size_t index = 0; index != 5 && !::setlocale(LC_NUMERIC, commaLocales[index]); ++index)
+			;
+
+		check(formatted(0.1 + 0.2) == "0.30000000000000004", "shortest digits of 0.1 + 0.2");
+		check(formatted(1e22) == "1e22", "shortest digits of 1e22");
+		check(formatted(-2.5e-7 / 3) == "-8.333333333333333e-8", "shortest digits of -2.5e-7 / 3");
+		for(int step = 1; step != 20000; ++step)
+		{
+			check(readsBack(step / 7.0) && readsBack(float(step / 7.0)), "fraction reads back: " + formatted(step / 7.0));
+			check(readsBack(std::ldexp(1.0, step % 2098 - 1074)), "power of two reads back");
+		}
+		check(readsBack(std::numeric_limits<double>::max()) && readsBack(-std::numeric_limits<double>::min())
+			&& readsBack(std::numeric_limits<double>::denorm_min()), "extreme doubles read back");
+		check(readsBack(std::numeric_limits<float>::max()) && readsBack(std::numeric_limits<float>::denorm_min()),
+			"extreme floats read back");
+
+		::setlocale(LC_NUMERIC, "C");
+	}
+
+	std::string longName(int id)
+	{
+		return "a name too long to be inline " + boost::lexical_cast<std::string>(id);
+	}
+
+	/// Strings of the stream too long to sit in the row must stay with the
+	/// rows a join hands out, when these outlive the batch they came from.
+	void joinLongStrings()
+	{
+		std::ostringstream probe;
+		probe << "id\tname\n";
+		for(int id = 0; id != 5000; ++id)
+			probe << id << "\t" << longName(id) << "\n";
+		writeFile(testFile("join_probe.txt"), probe.str());
+
+		std::ostringstream lookup;
+		lookup << "id\tscore\n";
+		for(int id = 0; id < 5000; id += 3)
+			lookup << id << "\t" << id * 2 << "\n";
+		writeFile(testFile("join_lookup.txt"), lookup.str());
+
+		{
+			Pipeline p(read_text_file(RowDef() << column_def<int>("id") << column_def<StringRef>("name"), testFile("join_probe.txt"))
+				>> join(read_text_file(RowDef() << column_def<int>("id") << column_def<int>("score"), testFile("join_lookup.txt")),
+					ColumnNames() << "id")
+				>> write_text_file(testFile("join_long_strings.txt")));
+			p.run();
+		}
+
+		const std::vector<std::string> rows = readRows(testFile("join_long_strings.txt"));
+		bool same = rows.size() == 1667;
+		for(size_t row = 0; same && row != rows.size(); ++row)
+		{
+			const int id = boost::lexical_cast<int>(rows[row].substr(0, rows[row].find('\t')));
+			same = rows[row] == boost::lexical_cast<std::string>(id) + "\t" + longName(id) + "\t"
+				+ boost::lexical_cast<std::string>(id * 2);
+		}
+		check(same, "join hands out strings of released rows");
+	}
+
+	/// String columns of the build side of a join that are not keys come
+	/// out with the rows that match, and null with those that do not.
+	void joinStringPayload()
+	{
+		std::ostringstream probe;
+		probe << "id\n";
+		for(int id = 0; id != 3000; ++id)
+			probe << id << "\n";
+		writeFile(testFile("join_payload_probe.txt"), probe.str());
+
+		std::ostringstream lookup;
+		lookup << "id\tname\n";
+		for(int id = 0; id < 3000; id += 3)
+			lookup << id << "\t" << (id % 2 ? longName(id) : std::string("short")) << "\n";
+		writeFile(testFile("join_payload_lookup.txt"), lookup.str());
+
+		const JoinType types[] = { JOIN_INNER, JOIN_LEFT_OUTER };
+		for(size_t type = 0; type != 2; ++type)
+		{
+			{
+				Pipeline p(read_text_file(RowDef() << column_def<int>("id"), testFile("join_payload_probe.txt"))
+					>> join(read_text_file(RowDef() << column_def<int>("id") << column_def<StringRef>("name"),
+						testFile("join_payload_lookup.txt")), ColumnNames() << "id", types[type])
+					>> write_text_file(testFile("join_payload.txt")));
+				p.run();
+			}
+
+			const std::vector<std::string> rows = readRows(testFile("join_payload.txt"));
+			bool same = rows.size() == (types[type] == JOIN_INNER ? 1000u : 3000u);
+			for(size_t row = 0; same && row != rows.size(); ++row)
+			{
+				const int id = boost::lexical_cast<int>(rows[row].substr(0, rows[row].find('\t')));
+				const std::string name = id % 3 ? std::string() : id % 2 ? longName(id) : std::string("short");
+				same = rows[row] == boost::lexical_cast<std::string>(id) + "\t" + name;
+			}
+			check(same, "join with a string column on the build side");
+		}
+	}
+
+	/// The line of a row of ids and names, where every tenth name is null.
+	std::string nameLine(int id)
+	{
+		return boost::lexical_cast<std::string>(id) + "\t" + (id % 10 ? longName(id) : std::string());
+	}
+
+	/// Whether the rows of a file are the lines of the given ids.
+	bool sameNames(const std::string & fileName, const std::vector<int> & ids)
+	{
+		const std::vector<std::string> rows = readRows(fileName);
+		bool same = rows.size() == ids.size();
+		for(size_t row = 0; same && row != rows.size(); ++row)
+			same = rows[row] == nameLine(ids[row]);
+		return same;
+	}
+
+	/// Long strings that are not keys go through sorts, spilled or not, top
+	/// k and binary files.
+	void stringPayloads()
+	{
+		const int count = 20000;
+		std::ostringstream text;
+		text << "id\tname\n";
+		std::vector<int> shuffled;
+		for(int row = 0; row != count; ++row)
+		{
+			shuffled.push_back(int(row * 7919L % count));
+			text << nameLine(shuffled.back()) << "\n";
+		}
+		writeFile(testFile("string_payloads.txt"), text.str());
+		RowDef rowDef = RowDef() << column_def<int>("id") << column_def<StringRef>("name");
+
+		std::vector<int> ascending;
+		for(int id = 0; id != count; ++id)
+			ascending.push_back(id);
+		{
+			Pipeline p(read_text_file(rowDef, testFile("string_payloads.txt"))
+				>> sort_by(ColumnNames() << "id")
+				>> write_text_file(testFile("string_payloads_sorted.txt")));
+			p.run();
+		}
+		check(sameNames(testFile("string_payloads_sorted.txt"), ascending), "sort with string payloads");
+
+		// Small enough a memory limit to spill, and to merge the runs spilled.
+		{
+			Pipeline p(read_text_file(rowDef, testFile("string_payloads.txt"))
+				>> sort_by(ColumnNames() << "id", 16 << 10)
+				>> write_text_file(testFile("string_payloads_spilled.txt")));
+			p.run();
+		}
+		check(sameNames(testFile("string_payloads_spilled.txt"), ascending), "spilled sort with string payloads");
+
+		{
+			Pipeline p(read_text_file(rowDef, testFile("string_payloads.txt"))
+				>> top_k(1000, ColumnNames() << "id", SORT_DESCENDING)
+				>> write_text_file(testFile("string_payloads_top.txt")));
+			p.run();
+		}
+		check(sameNames(testFile("string_payloads_top.txt"), std::vector<int>(ascending.rbegin(), ascending.rbegin() + 1000)),
+			"top k with string payloads");
+
+		{
+			Pipeline p(read_text_file(rowDef, testFile("string_payloads.txt"))
+				>> write_binary_file(testFile("string_payloads.rows"), BINARY_CHECKSUMS));
+			p.run();
+		}
+		{
+			Pipeline p(read_binary_file(testFile("string_payloads.rows"))
+				>> write_text_file(testFile("string_payloads_binary.txt")));
+			p.run();
+		}
+		check(sameNames(testFile("string_payloads_binary.txt"), shuffled), "binary file with strings");
+
+		{
+			Pipeline p(read_binary_file(testFile("string_payloads.rows"))
+				>> filter(column<int>("id") < value(100))
+				>> sort_by(ColumnNames() << "id")
+				>> write_text_file(testFile("string_payloads_filtered.txt")));
+			p.run();
+		}
+		check(sameNames(testFile("string_payloads_filtered.txt"), std::vector<int>(ascending.begin(), ascending.begin() + 100)),
+			"filtered binary file with strings");
+	}
+}
+
+int main()
+{
+	try
+	{
+		directory = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("RowStreams-%%%%-%%%%-%%%%");
+		boost::filesystem::create_directories(directory);
+		filterNullsAfterValues();
+		logicWithNulls();
+		zonesWithNulls();
+		joinLongStrings();
+		joinStringPayload();
+		stringPayloads();
+		dateTimeRange();
+		floatsReadBack();
+	}
+	catch(std::runtime_error & e)
+	{
+		std::cerr << e.what() << std::endl;
+		++failures;
+	}
+	if(failures)
+	{
+		std::cerr << "Files kept in " << directory.string() << std::endl;
+		return 1;
+	}
+	boost::filesystem::remove_all(directory);
+	return 0;
+}
\ No newline at end of file